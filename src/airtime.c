@@ -0,0 +1,112 @@
+#include "airtime.h"
+
+struct AirtimeModulation
+{
+  int air_data_rate;
+  int sf;
+  int bw_hz;
+};
+
+static const struct AirtimeModulation modulations[] =
+{
+  {  300, 12, 125000},
+  { 1200, 11, 250000},
+  { 2400, 11, 500000},
+  { 4800, 10, 500000},
+  { 9600,  8, 500000},
+  {19200,  7, 500000}
+};
+
+int
+airtime_init(struct Airtime *airtime, int air_data_rate, int fec, int uart_baud)
+{
+  memset(airtime, 0, sizeof(struct Airtime));
+  airtime->scale = AIRTIME_SCALE_ONE;
+  airtime->uart_baud = uart_baud ? uart_baud : 9600;
+
+  for(int i=0; i<sizeof(modulations)/sizeof(modulations[0]); i++)
+  {
+    if(modulations[i].air_data_rate == air_data_rate)
+    {
+      airtime->air_data_rate = air_data_rate;
+      airtime->sf = modulations[i].sf;
+      airtime->bw_hz = modulations[i].bw_hz;
+      airtime->cr = fec ? 2 : 1;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/* time to move bytes over the UART with a start and stop bit */
+uint64_t
+airtime_uart_us(struct Airtime *airtime, size_t payload_len)
+{
+  return (uint64_t) payload_len * 10 * 1000000 / airtime->uart_baud;
+}
+
+/*
+ Time on air from the Semtech LoRa modem calculator with an explicit
+ header and a CRC, the preamble and payload symbols and nothing else.
+ This is what counts against a duty cycle limit.
+*/
+uint64_t
+airtime_lora_us(struct Airtime *airtime, size_t payload_len)
+{
+  uint64_t tsym_us, preamble_us, symbols;
+  int64_t num, den;
+  int de;
+
+  if(airtime->sf == 0)
+    return 0;
+
+  tsym_us = ((uint64_t) 1 << airtime->sf) * 1000000 / airtime->bw_hz;
+  de = tsym_us > 16000;
+
+  preamble_us = (AIRTIME_PREAMBLE_SYMBOLS*4 + 17) * tsym_us / 4;
+
+  num = 8*(int64_t)payload_len - 4*airtime->sf + 28 + 16;
+  den = 4*(airtime->sf - 2*de);
+  symbols = 8;
+  if(num > 0)
+    symbols += ((num + den - 1) / den) * (airtime->cr + 4);
+
+  return preamble_us + symbols*tsym_us;
+}
+
+/* the time on air with the UART transfer, the e32 receives the packet before sending it */
+uint64_t
+airtime_model_us(struct Airtime *airtime, size_t payload_len)
+{
+  if(airtime->sf == 0)
+    return 0;
+
+  return airtime_lora_us(airtime, payload_len) + airtime_uart_us(airtime, payload_len);
+}
+
+/* the modelled time with the calibration applied */
+uint64_t
+airtime_us(struct Airtime *airtime, size_t payload_len)
+{
+  return airtime_model_us(airtime, payload_len) * airtime->scale / AIRTIME_SCALE_ONE;
+}
+
+/* move the scale an eighth of the way to what was measured */
+void
+airtime_calibrate(struct Airtime *airtime, size_t payload_len, uint64_t measured_us)
+{
+  uint64_t model_us, scale;
+
+  model_us = airtime_model_us(airtime, payload_len);
+  if(model_us == 0)
+    return;
+
+  scale = measured_us * AIRTIME_SCALE_ONE / model_us;
+  if(scale < AIRTIME_SCALE_MIN)
+    scale = AIRTIME_SCALE_MIN;
+  if(scale > AIRTIME_SCALE_MAX)
+    scale = AIRTIME_SCALE_MAX;
+
+  airtime->scale = (7*airtime->scale + scale) / 8;
+}
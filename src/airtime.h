@@ -0,0 +1,51 @@
+#ifndef AIRTIME_H
+#define AIRTIME_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ The e32 doesn't say which LoRa spreading factor and bandwidth are used
+ for each air data rate. These were picked so the bit rate of the LoRa
+ modulation is close to the air data rate the datasheet gives. With FEC
+ on a coding rate of 4/6 is assumed, otherwise 4/5.
+
+ The model is calibrated against how long AUX is actually low for a
+ packet so an error in these assumptions is corrected as packets are
+ sent.
+*/
+#define AIRTIME_PREAMBLE_SYMBOLS 8
+#define AIRTIME_SCALE_ONE 1000
+#define AIRTIME_SCALE_MIN 250
+#define AIRTIME_SCALE_MAX 4000
+
+struct Airtime
+{
+  int air_data_rate;
+  int sf;
+  int bw_hz;
+  int cr;
+  int uart_baud;
+  uint64_t scale;
+};
+
+int
+airtime_init(struct Airtime *airtime, int air_data_rate, int fec, int uart_baud);
+
+uint64_t
+airtime_lora_us(struct Airtime *airtime, size_t payload_len);
+
+uint64_t
+airtime_model_us(struct Airtime *airtime, size_t payload_len);
+
+uint64_t
+airtime_us(struct Airtime *airtime, size_t payload_len);
+
+uint64_t
+airtime_uart_us(struct Airtime *airtime, size_t payload_len);
+
+void
+airtime_calibrate(struct Airtime *airtime, size_t payload_len, uint64_t measured_us);
+
+#endif
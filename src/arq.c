@@ -0,0 +1,368 @@
+#include "arq.h"
+
+void
+arq_init(struct Arq *arq, uint8_t session, uint64_t rto_us, uint64_t rto_min_us, uint64_t ack_delay_us)
+{
+  memset(arq, 0, sizeof(struct Arq));
+  arq->session = session ? session : 1;
+  arq->rto_us = rto_us;
+  arq->rto_min_us = rto_min_us;
+  arq->ack_delay_us = ack_delay_us;
+}
+
+/* new frames can be sent while the window has room and a poll isn't being answered */
+int
+arq_window_open(struct Arq *arq)
+{
+  return !arq->polling && !arq->poll_due && (uint8_t) (arq->next - arq->base) < ARQ_WINDOW;
+}
+
+size_t
+arq_outstanding(struct Arq *arq)
+{
+  return (uint8_t) (arq->next - arq->base);
+}
+
+/*
+  Keep a frame until it's acknowledged giving it the next sequence
+  number. The prefix goes in front of the ARQ header, it's the address
+  in fixed mode. Returns NULL if the window is closed.
+*/
+struct ArqSlot*
+arq_push(struct Arq *arq, const uint8_t *prefix, size_t prefix_len, const uint8_t *frame, size_t frame_len)
+{
+  struct ArqSlot *slot;
+
+  if(!arq_window_open(arq) || prefix_len + ARQ_DATA_HEADER_LENGTH + frame_len > ARQ_MAX_FRAME)
+    return NULL;
+
+  slot = &arq->tx[arq->next % ARQ_WINDOW];
+  memset(slot, 0, sizeof(struct ArqSlot));
+  slot->used = 1;
+  slot->seq = arq->next++;
+  slot->offset = prefix_len;
+  slot->len = prefix_len + ARQ_DATA_HEADER_LENGTH + frame_len;
+  memcpy(slot->data, prefix, prefix_len);
+  memcpy(slot->data + prefix_len + ARQ_DATA_HEADER_LENGTH, frame, frame_len);
+
+  return slot;
+}
+
+/* the oldest frame which has to be sent again */
+struct ArqSlot*
+arq_lost(struct Arq *arq)
+{
+  struct ArqSlot *slot;
+
+  for(uint8_t seq = arq->base; seq != arq->next; seq++)
+  {
+    slot = &arq->tx[seq % ARQ_WINDOW];
+    if(slot->used && slot->lost)
+      return slot;
+  }
+
+  return NULL;
+}
+
+/* what has been received, the next sequence number and a bitmap of the ones after */
+static void
+arq_write_acks(struct Arq *arq, uint8_t *ack)
+{
+  uint16_t bitmap = 0;
+
+  for(int i=0; i<ARQ_WINDOW-1; i++)
+  {
+    if(arq->rx[(uint8_t) (arq->expected+1+i) % ARQ_WINDOW].used)
+      bitmap |= 1 << i;
+  }
+
+  ack[0] = arq->peer_session;
+  ack[1] = arq->expected;
+  ack[2] = bitmap & 0xff;
+  ack[3] = bitmap >> 8;
+
+  arq->ack_pending = 0;
+  arq->ack_final = 0;
+}
+
+static void
+arq_write_poll(struct Arq *arq, uint8_t *header, uint64_t now_us)
+{
+  header[0] |= ARQ_FLAG_POLL;
+  arq->polling = 1;
+  arq->poll_due = 0;
+  arq->poll_us = now_us;
+}
+
+/*
+  Fill in the ARQ header of a frame just before it's written. When
+  there's nothing more which can be sent after it the frame polls for
+  an answer.
+*/
+void
+arq_write(struct Arq *arq, struct ArqSlot *slot, int more, uint64_t now_us)
+{
+  uint8_t *header;
+
+  header = slot->data + slot->offset;
+  slot->lost = 0;
+  if(slot->sent)
+    arq->retransmits++;
+  slot->sent = 1;
+
+  header[0] = FRAME_TYPE_ARQ_DATA << FRAME_TYPE_SHIFT;
+  if(arq->ack_final)
+    header[0] |= ARQ_FLAG_FINAL;
+  header[1] = arq->session;
+  header[2] = slot->seq;
+  arq_write_acks(arq, header+3);
+
+  if(arq_lost(arq) == NULL && (!more || !arq_window_open(arq)))
+    arq_write_poll(arq, header, now_us);
+}
+
+/* an ack on its own, it's also a poll if the last one went unanswered */
+size_t
+arq_write_ack(struct Arq *arq, uint8_t *frame, uint64_t now_us)
+{
+  frame[0] = FRAME_TYPE_ARQ_ACK << FRAME_TYPE_SHIFT;
+  if(arq->ack_final)
+    frame[0] |= ARQ_FLAG_FINAL;
+  frame[1] = arq->session;
+  arq_write_acks(arq, frame+2);
+
+  if(arq->poll_due)
+    arq_write_poll(arq, frame, now_us);
+
+  return ARQ_ACK_LENGTH;
+}
+
+static void
+arq_rtt_sample(struct Arq *arq, uint64_t rtt_us)
+{
+  uint64_t delta;
+
+  if(arq->srtt_us == 0)
+  {
+    arq->srtt_us = rtt_us;
+    arq->rttvar_us = rtt_us / 2;
+  }
+  else
+  {
+    delta = arq->srtt_us > rtt_us ? arq->srtt_us - rtt_us : rtt_us - arq->srtt_us;
+    arq->rttvar_us = (3 * arq->rttvar_us + delta) / 4;
+    arq->srtt_us = (7 * arq->srtt_us + rtt_us) / 8;
+  }
+
+  arq->rto_us = arq->srtt_us + 4 * arq->rttvar_us;
+  if(arq->rto_us < arq->rto_min_us)
+    arq->rto_us = arq->rto_min_us;
+}
+
+/* what the other end says it has received from us */
+static void
+arq_read_acks(struct Arq *arq, const uint8_t *ack, int final, uint64_t now_us)
+{
+  struct ArqSlot *slot;
+  uint16_t bitmap;
+  uint8_t seq, highest;
+  int acked;
+
+  if(ack[0] != arq->session || (uint8_t) (ack[1] - arq->base) > arq_outstanding(arq))
+    return;
+
+  while(arq->base != ack[1])
+    arq->tx[arq->base++ % ARQ_WINDOW].used = 0;
+
+  /* frames after the one expected which have arrived */
+  acked = 0;
+  highest = ack[1];
+  bitmap = ack[2] | (ack[3] << 8);
+  for(int i=0; i<ARQ_WINDOW-1; i++)
+  {
+    seq = ack[1]+1+i;
+    if(!(bitmap & (1 << i)) || (uint8_t) (seq - arq->base) >= arq_outstanding(arq))
+      continue;
+    arq->tx[seq % ARQ_WINDOW].used = 0;
+    highest = seq;
+    acked = 1;
+  }
+
+  /*
+    Frames arrive in order so a gap before one which arrived was lost.
+    When answering a poll everything not acknowledged was lost.
+  */
+  for(seq = arq->base; seq != arq->next; seq++)
+  {
+    slot = &arq->tx[seq % ARQ_WINDOW];
+    if(slot->used && slot->sent && (final || (acked && (uint8_t) (seq - arq->base) < (uint8_t) (highest - arq->base))))
+      slot->lost = 1;
+  }
+
+  while(arq->base != arq->next && !arq->tx[arq->base % ARQ_WINDOW].used)
+    arq->base++;
+
+  if(final && arq->polling)
+  {
+    /* only time polls which were answered the first time */
+    if(arq->polls == 0)
+      arq_rtt_sample(arq, now_us - arq->poll_us);
+    arq->polling = 0;
+    arq->polls = 0;
+  }
+}
+
+/* a frame from a new session, forget what was received from the old one */
+static void
+arq_read_session(struct Arq *arq, uint8_t session)
+{
+  if(session == arq->peer_session)
+    return;
+
+  arq->peer_session = session;
+  arq->expected = 0;
+  for(int i=0; i<ARQ_WINDOW; i++)
+    arq->rx[i].used = 0;
+}
+
+/* answer right away when polled, otherwise after the ack delay */
+static void
+arq_read_poll(struct Arq *arq, int poll, uint64_t now_us)
+{
+  if(poll)
+  {
+    arq->ack_final = 1;
+    arq->ack_deadline_us = now_us;
+  }
+  else if(!arq->ack_pending)
+  {
+    arq->ack_deadline_us = now_us + arq->ack_delay_us;
+  }
+  arq->ack_pending = 1;
+}
+
+/*
+  Read an ARQ frame, taking in what it acknowledges and keeping the frame
+  it carries until the ones before it have arrived. Returns -1 if it's
+  not an ARQ frame.
+*/
+int
+arq_read(struct Arq *arq, uint8_t *frame, size_t len, uint64_t now_us)
+{
+  struct ArqSlot *slot;
+  int type, poll, final;
+  uint8_t seq;
+
+  if(len < 1)
+    return -1;
+
+  type = frame[0] >> FRAME_TYPE_SHIFT;
+  poll = (frame[0] & ARQ_FLAG_POLL) != 0;
+  final = (frame[0] & ARQ_FLAG_FINAL) != 0;
+
+  if(type == FRAME_TYPE_ARQ_ACK && len == ARQ_ACK_LENGTH)
+  {
+    arq_read_session(arq, frame[1]);
+    arq_read_acks(arq, frame+2, final, now_us);
+    if(poll)
+      arq_read_poll(arq, poll, now_us);
+    return 0;
+  }
+
+  if(type != FRAME_TYPE_ARQ_DATA || len <= ARQ_DATA_HEADER_LENGTH || len - ARQ_DATA_HEADER_LENGTH > ARQ_MAX_FRAME)
+    return -1;
+
+  arq_read_session(arq, frame[1]);
+  arq_read_acks(arq, frame+3, final, now_us);
+  arq_read_poll(arq, poll, now_us);
+
+  seq = frame[2];
+  slot = &arq->rx[seq % ARQ_WINDOW];
+  if((uint8_t) (seq - arq->expected) >= ARQ_WINDOW || (slot->used && slot->seq == seq))
+  {
+    arq->duplicates++;
+    return 0;
+  }
+
+  slot->used = 1;
+  slot->seq = seq;
+  slot->len = len - ARQ_DATA_HEADER_LENGTH;
+  memcpy(slot->data, frame + ARQ_DATA_HEADER_LENGTH, slot->len);
+  return 0;
+}
+
+/* copy out the next frame in order, returns 0 when it hasn't arrived */
+ssize_t
+arq_deliver(struct Arq *arq, uint8_t *buf, size_t len)
+{
+  struct ArqSlot *slot;
+
+  slot = &arq->rx[arq->expected % ARQ_WINDOW];
+  if(!slot->used || slot->seq != arq->expected || slot->len > len)
+    return 0;
+
+  memcpy(buf, slot->data, slot->len);
+  slot->used = 0;
+  arq->expected++;
+  return slot->len;
+}
+
+/* the timeout doubles with each poll, up to ARQ_MAX_BACKOFF times */
+static uint64_t
+arq_poll_deadline(struct Arq *arq)
+{
+  return arq->poll_us + (arq->rto_us << (arq->polls < ARQ_MAX_BACKOFF ? arq->polls : ARQ_MAX_BACKOFF));
+}
+
+int
+arq_ack_due(struct Arq *arq, uint64_t now_us)
+{
+  return arq->ack_pending && arq->ack_deadline_us <= now_us;
+}
+
+/* when an ack or the answer to a poll is due, 0 if neither */
+uint64_t
+arq_deadline(struct Arq *arq)
+{
+  uint64_t deadline = 0;
+
+  if(arq->polling)
+    deadline = arq_poll_deadline(arq);
+
+  if(arq->ack_pending && (deadline == 0 || arq->ack_deadline_us < deadline))
+    deadline = arq->ack_deadline_us;
+
+  return deadline;
+}
+
+/*
+  Poll again when a poll wasn't answered in time. Returns the number of
+  frames given up on when there's been no answer to too many polls.
+*/
+int
+arq_timeout(struct Arq *arq, uint64_t now_us)
+{
+  int dropped;
+
+  if(!arq->polling || now_us < arq_poll_deadline(arq))
+    return 0;
+
+  arq->polling = 0;
+  arq->polls++;
+  if(arq->polls <= ARQ_MAX_POLLS)
+  {
+    arq->poll_due = 1;
+    return 0;
+  }
+
+  dropped = arq_outstanding(arq);
+  arq->failed += dropped;
+  for(int i=0; i<ARQ_WINDOW; i++)
+    arq->tx[i].used = 0;
+  arq->base = arq->next = 0;
+  arq->polls = 0;
+  if(++arq->session == 0)
+    arq->session = 1;
+
+  return dropped;
+}
@@ -0,0 +1,130 @@
+#ifndef ARQ_H
+#define ARQ_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "frame.h"
+
+/*
+ Selective repeat ARQ between a pair of e32 modules. Each frame is
+ wrapped with a sequence number and up to a window of frames are sent
+ before they're acknowledged. Every frame also acknowledges what has
+ been received from the other end, the next sequence number expected
+ and a bitmap of which of the ARQ_WINDOW-1 after it have arrived, the
+ rest of the window.
+
+ Data
+
+ +--------+---------+-----+-------------+-----+--------+
+ | header | session | seq | ack session | ack | bitmap |  frame ...
+ +--------+---------+-----+-------------+-----+--------+
+
+ Ack
+
+ +--------+---------+-------------+-----+--------+
+ | header | session | ack session | ack | bitmap |
+ +--------+---------+-------------+-----+--------+
+
+ The header byte has the frame type and the poll and final flags. The
+ radio is half duplex so the receiver only acknowledges right away
+ when the sender sets poll, which it does on the last frame it has to
+ send or the last one the window allows. The answer has final set and
+ anything it doesn't acknowledge which was sent before the poll is
+ lost and sent again. If the answer doesn't come within the timeout
+ the sender polls again with an ack frame, the timeout is from the
+ measured round trip time and backs off with each poll.
+
+ The session is picked when the sender starts, when the receiver sees
+ a new session it starts over from sequence number 0. After too many
+ polls without an answer the sender gives up on what's outstanding
+ and starts a new session.
+*/
+#define ARQ_WINDOW 16
+#define ARQ_FLAG_POLL 0x10
+#define ARQ_FLAG_FINAL 0x08
+#define ARQ_DATA_HEADER_LENGTH 7
+#define ARQ_ACK_LENGTH 6
+#define ARQ_MAX_FRAME 64
+#define ARQ_MAX_POLLS 8
+#define ARQ_MAX_BACKOFF 3
+
+struct ArqSlot
+{
+  int used;
+  int sent;
+  int lost;
+  uint8_t seq;
+  size_t offset;
+  size_t len;
+  uint8_t data[ARQ_MAX_FRAME];
+};
+
+struct Arq
+{
+  /* sending */
+  uint8_t session;
+  uint8_t base;
+  uint8_t next;
+  struct ArqSlot tx[ARQ_WINDOW];
+  int polling;
+  int poll_due;
+  int polls;
+  uint64_t poll_us;
+  uint64_t srtt_us;
+  uint64_t rttvar_us;
+  uint64_t rto_us;
+  uint64_t rto_min_us;
+
+  /* receiving */
+  uint8_t peer_session;
+  uint8_t expected;
+  struct ArqSlot rx[ARQ_WINDOW];
+  int ack_pending;
+  int ack_final;
+  uint64_t ack_deadline_us;
+  uint64_t ack_delay_us;
+
+  size_t retransmits;
+  size_t duplicates;
+  size_t failed;
+};
+
+void
+arq_init(struct Arq *arq, uint8_t session, uint64_t rto_us, uint64_t rto_min_us, uint64_t ack_delay_us);
+
+int
+arq_window_open(struct Arq *arq);
+
+size_t
+arq_outstanding(struct Arq *arq);
+
+struct ArqSlot*
+arq_push(struct Arq *arq, const uint8_t *prefix, size_t prefix_len, const uint8_t *frame, size_t frame_len);
+
+struct ArqSlot*
+arq_lost(struct Arq *arq);
+
+void
+arq_write(struct Arq *arq, struct ArqSlot *slot, int more, uint64_t now_us);
+
+size_t
+arq_write_ack(struct Arq *arq, uint8_t *frame, uint64_t now_us);
+
+int
+arq_read(struct Arq *arq, uint8_t *frame, size_t len, uint64_t now_us);
+
+ssize_t
+arq_deliver(struct Arq *arq, uint8_t *buf, size_t len);
+
+int
+arq_ack_due(struct Arq *arq, uint64_t now_us);
+
+uint64_t
+arq_deadline(struct Arq *arq);
+
+int
+arq_timeout(struct Arq *arq, uint64_t now_us);
+
+#endif
@@ -0,0 +1,260 @@
+#include "bond.h"
+
+/* how far sequence number a is after b, negative if it's before */
+static int
+bond_diff(uint16_t a, uint16_t b)
+{
+  return (int16_t) (a - b);
+}
+
+int
+bond_init(struct Bond *bond, int links, uint8_t stream, uint64_t timeout_us)
+{
+  if(links < 1 || links > BOND_MAX_LINKS)
+    return -1;
+
+  memset(bond, 0, sizeof(struct Bond));
+  bond->links = links;
+  bond->tx_stream = stream & ~BOND_REPORT;
+  bond->timeout_us = timeout_us;
+  return 0;
+}
+
+/* write the sequence numbers of the next packet going over a link */
+size_t
+bond_header(struct Bond *bond, int link, uint8_t *header)
+{
+  header[0] = bond->tx_stream;
+  header[1] = bond->tx_seq >> 8;
+  header[2] = bond->tx_seq & 0xFF;
+  header[3] = bond->link[link].tx_seq++;
+
+  bond->tx_seq++;
+  return BOND_HEADER_LENGTH;
+}
+
+/*
+  The time on air of a packet over a link over the part of what's sent
+  over it which arrives, as reported by the other end and as seen here.
+*/
+static uint64_t
+bond_goodput_us(struct Bond *bond, int link, uint64_t air_us)
+{
+  struct BondLink *l = &bond->link[link];
+  size_t received, lost;
+
+  received = l->received + l->far_received;
+  lost = l->lost + l->far_lost;
+  return air_us * (received + lost + 1) / (received + 1);
+}
+
+/*
+  The link which would be done with a packet first, ready_us is when
+  each link is free and air_us how long the packet takes on it.
+*/
+int
+bond_pick(struct Bond *bond, const uint64_t ready_us[], const uint64_t air_us[])
+{
+  uint64_t finish, best_finish;
+  int best;
+
+  best = 0;
+  best_finish = ready_us[0] + bond_goodput_us(bond, 0, air_us[0]);
+  for(int i = 1; i < bond->links; i++)
+  {
+    finish = ready_us[i] + bond_goodput_us(bond, i, air_us[i]);
+    if(finish < best_finish || (finish == best_finish && ready_us[i] < ready_us[best]))
+    {
+      best = i;
+      best_finish = finish;
+    }
+  }
+
+  return best;
+}
+
+/*
+  A new stream from the other end, forget what's left of the last one.
+  A stream starts from 0 so if this packet is near the start the ones
+  before it are still to come over other links.
+*/
+static void
+bond_restart(struct Bond *bond, uint8_t stream, uint16_t seq)
+{
+  for(int i = 0; i < BOND_REORDER_FRAMES; i++)
+    bond->reorder[i].used = 0;
+  for(int i = 0; i < bond->links; i++)
+    bond->link[i].rx_seen = 0;
+
+  bond->buffered = 0;
+  bond->rx_started = 1;
+  bond->rx_stream = stream;
+  bond->rx_next = seq < BOND_REORDER_FRAMES ? 0 : seq;
+}
+
+/*
+  Write a report of what arrived over a link once BOND_REPORT_PACKETS
+  have been received on it since the last one. Returns its length, 0 if
+  none is due.
+*/
+size_t
+bond_report(struct Bond *bond, int link, uint8_t *report)
+{
+  struct BondLink *l = &bond->link[link];
+
+  if(l->unreported < BOND_REPORT_PACKETS)
+    return 0;
+
+  report[0] = BOND_REPORT;
+  report[1] = l->received < 0xFF ? l->received : 0xFF;
+  report[2] = l->lost < 0xFF ? l->lost : 0xFF;
+  report[3] = 0;
+
+  l->unreported = 0;
+  return BOND_HEADER_LENGTH;
+}
+
+/*
+  Keep a packet received on a link until it's next in the stream.
+  Returns 1 if it was a duplicate or too far ahead to keep, 2 if it was
+  a report from the other end, -1 if it's too short or too long.
+*/
+int
+bond_receive(struct Bond *bond, int link, const uint8_t *buf, size_t len, uint64_t now_us)
+{
+  struct BondLink *l;
+  struct BondFrame *frame;
+  uint16_t seq;
+  uint8_t gap;
+
+  if(link < 0 || link >= bond->links || len < BOND_HEADER_LENGTH || len - BOND_HEADER_LENGTH > BOND_FRAME_BYTES)
+    return -1;
+
+  l = &bond->link[link];
+  if(buf[0] & BOND_REPORT)
+  {
+    l->far_received = buf[1];
+    l->far_lost = buf[2];
+    return 2;
+  }
+
+  seq = (buf[1] << 8) | buf[2];
+
+  if(!bond->rx_started || buf[0] != bond->rx_stream)
+    bond_restart(bond, buf[0], seq);
+
+  if(l->rx_seen)
+  {
+    gap = buf[3] - l->rx_seq - 1;
+    if(gap < 0x80)
+      l->lost += gap;
+  }
+  if(!l->rx_seen || bond_diff(seq, l->rx_highest) > 0)
+    l->rx_highest = seq;
+  l->rx_seen = 1;
+  l->rx_seq = buf[3];
+  l->received++;
+  l->unreported++;
+
+  /* only recent losses count */
+  if(l->received + l->lost > BOND_LOSS_WINDOW)
+  {
+    l->received /= 2;
+    l->lost /= 2;
+  }
+
+  if(bond_diff(seq, bond->rx_next) < 0)
+    return 1;
+
+  /* the other end started over or everything buffered is stale */
+  if(bond_diff(seq, bond->rx_next) >= BOND_REORDER_FRAMES)
+  {
+    if(bond->buffered > 0)
+      return 1;
+    bond->rx_next = seq;
+  }
+
+  frame = &bond->reorder[seq % BOND_REORDER_FRAMES];
+  if(frame->used)
+    return 1;
+
+  frame->used = 1;
+  frame->seq = seq;
+  frame->len = len - BOND_HEADER_LENGTH;
+  frame->arrived_us = now_us;
+  memcpy(frame->data, buf + BOND_HEADER_LENGTH, frame->len);
+  bond->buffered++;
+
+  return 0;
+}
+
+/* when the oldest packet waiting behind a gap arrived */
+static uint64_t
+bond_oldest(struct Bond *bond)
+{
+  uint64_t oldest = UINT64_MAX;
+
+  for(int i = 0; i < BOND_REORDER_FRAMES; i++)
+  {
+    if(bond->reorder[i].used && bond->reorder[i].arrived_us < oldest)
+      oldest = bond->reorder[i].arrived_us;
+  }
+
+  return oldest;
+}
+
+/* the next packet in the stream is lost if every link is past it or it's late */
+static int
+bond_lost(struct Bond *bond, uint64_t now_us)
+{
+  int passed = 1;
+
+  for(int i = 0; i < bond->links; i++)
+  {
+    if(!bond->link[i].rx_seen || bond_diff(bond->link[i].rx_highest, bond->rx_next) <= 0)
+      passed = 0;
+  }
+
+  return passed || bond_oldest(bond) + bond->timeout_us <= now_us;
+}
+
+/*
+  Copy out the next packet of the stream, skipping ones which were lost.
+  Returns its length, -1 if it hasn't arrived yet.
+*/
+ssize_t
+bond_pop(struct Bond *bond, uint8_t *buf, uint64_t now_us)
+{
+  struct BondFrame *frame;
+
+  while(bond->buffered > 0)
+  {
+    frame = &bond->reorder[bond->rx_next % BOND_REORDER_FRAMES];
+    if(frame->used && frame->seq == bond->rx_next)
+    {
+      memcpy(buf, frame->data, frame->len);
+      frame->used = 0;
+      bond->buffered--;
+      bond->rx_next++;
+      return frame->len;
+    }
+
+    if(!bond_lost(bond, now_us))
+      break;
+
+    bond->rx_next++;
+    bond->skipped++;
+  }
+
+  return -1;
+}
+
+/* when a gap in the stream is given up on, 0 if there's no gap */
+uint64_t
+bond_deadline(struct Bond *bond)
+{
+  if(bond->buffered == 0)
+    return 0;
+
+  return bond_oldest(bond) + bond->timeout_us;
+}
@@ -0,0 +1,110 @@
+#ifndef BOND_H
+#define BOND_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+/*
+ Channel bonding stripes one stream over several e32 modules, each on
+ its own channel and paired with a module on the same channel at the
+ other end. Every packet carries the stream it's part of, a sequence
+ number for the stream and one for the link it went over.
+
+ +--------+------------+----------+
+ | stream | stream seq | link seq |  packet ...
+ +--------+------------+----------+
+
+ The stream is picked when the sender starts, when the receiver sees a
+ new stream it starts over from its first packet rather than taking
+ the packets as ones it already had.
+
+ A packet goes to the link which would finish it first, from when the
+ link is free and the time on air measured for it, so a slower link
+ gets fewer packets rather than holding the stream back. The time on
+ air is scaled by how much of what was sent over the link arrived, over
+ the last BOND_LOSS_WINDOW or so packets, so a link losing a lot is
+ only used when it would still be done well before the others.
+
+ A sender which only sends never sees what arrived, so every
+ BOND_REPORT_PACKETS packets a receiver sends a report back over the
+ link they came in on. The top bit of the stream byte marks a report,
+ after it come how many packets the link received and lost.
+
+ +--------+----------+------+---+
+ | 0x80   | received | lost | 0 |
+ +--------+----------+------+---+
+
+ The receiver puts packets back in stream order. Each link delivers in
+ order so once every link has passed a missing sequence number it was
+ lost, otherwise it's given up on after the timeout. The link sequence
+ numbers count what each link lost.
+*/
+#define BOND_MAX_LINKS 4
+#define BOND_HEADER_LENGTH 4
+#define BOND_REORDER_FRAMES 64
+#define BOND_FRAME_BYTES 64
+#define BOND_LOSS_WINDOW 64
+#define BOND_REPORT 0x80
+#define BOND_REPORT_PACKETS 16
+
+struct BondLink
+{
+  uint8_t tx_seq;
+  int rx_seen;
+  uint8_t rx_seq;
+  uint16_t rx_highest;
+  size_t received;
+  size_t lost;
+  size_t unreported;
+  size_t far_received;
+  size_t far_lost;
+};
+
+struct BondFrame
+{
+  int used;
+  uint16_t seq;
+  size_t len;
+  uint64_t arrived_us;
+  uint8_t data[BOND_FRAME_BYTES];
+};
+
+struct Bond
+{
+  int links;
+  struct BondLink link[BOND_MAX_LINKS];
+  uint8_t tx_stream;
+  uint16_t tx_seq;
+  int rx_started;
+  uint8_t rx_stream;
+  uint16_t rx_next;
+  size_t buffered;
+  size_t skipped;
+  uint64_t timeout_us;
+  struct BondFrame reorder[BOND_REORDER_FRAMES];
+};
+
+int
+bond_init(struct Bond *bond, int links, uint8_t stream, uint64_t timeout_us);
+
+size_t
+bond_header(struct Bond *bond, int link, uint8_t *header);
+
+int
+bond_pick(struct Bond *bond, const uint64_t ready_us[], const uint64_t air_us[]);
+
+size_t
+bond_report(struct Bond *bond, int link, uint8_t *report);
+
+int
+bond_receive(struct Bond *bond, int link, const uint8_t *buf, size_t len, uint64_t now_us);
+
+ssize_t
+bond_pop(struct Bond *bond, uint8_t *buf, uint64_t now_us);
+
+uint64_t
+bond_deadline(struct Bond *bond);
+
+#endif
@@ -0,0 +1,85 @@
+#include "burst.h"
+
+void
+burst_init(struct Burst *burst, size_t first, size_t chunk, uint64_t us_per_byte)
+{
+  memset(burst, 0, sizeof(struct Burst));
+  burst->first = first;
+  burst->chunk = chunk < first ? first : chunk;
+  burst->us_per_byte = us_per_byte ? us_per_byte : 1;
+}
+
+/* take off what the e32 has sent since the last update */
+static void
+burst_update(struct Burst *burst, uint64_t now_us)
+{
+  uint64_t sent;
+
+  if(burst->draining && now_us > burst->updated_us)
+  {
+    sent = (now_us - burst->updated_us) / burst->us_per_byte;
+    if(sent >= burst->in_flight)
+      burst->in_flight = 0;
+    else
+      burst->in_flight -= sent;
+  }
+  burst->updated_us = now_us;
+}
+
+void
+burst_aux(struct Burst *burst, int aux, uint64_t now_us)
+{
+  burst_update(burst, now_us);
+
+  if(aux)
+  {
+    burst->draining = 0;
+    burst->in_flight = 0;
+    burst->frames = 0;
+  }
+  else
+  {
+    burst->draining = 1;
+  }
+}
+
+/* bytes which can be written to the e32 without overrunning its buffer */
+size_t
+burst_room(struct Burst *burst, uint64_t now_us)
+{
+  size_t limit;
+
+  burst_update(burst, now_us);
+
+  limit = burst->draining ? burst->chunk : burst->first;
+  if(burst->in_flight >= limit)
+    return 0;
+  return limit - burst->in_flight;
+}
+
+void
+burst_wrote(struct Burst *burst, size_t bytes, uint64_t now_us)
+{
+  burst_update(burst, now_us);
+  burst->in_flight += bytes;
+  burst->frames++;
+}
+
+/*
+ How long until there's room for bytes in the buffer. Returns -1 if only
+ an AUX transition will make room.
+*/
+int64_t
+burst_wait_us(struct Burst *burst, size_t bytes, uint64_t now_us)
+{
+  size_t room;
+
+  room = burst_room(burst, now_us);
+  if(room >= bytes)
+    return 0;
+
+  if(!burst->draining || bytes > burst->chunk)
+    return -1;
+
+  return (bytes - room) * burst->us_per_byte;
+}
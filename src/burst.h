@@ -0,0 +1,44 @@
+#ifndef BURST_H
+#define BURST_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ A model of how full the TX buffer of the e32 is. Bytes written to the
+ UART add to the buffer and while AUX is low the e32 is draining it at
+ the pacing rate measured for the module. When AUX goes high the buffer
+ is known to be empty.
+
+ Writing more than a packet into an empty buffer has been seen to
+ corrupt data so only first bytes are written while the buffer is empty,
+ once AUX goes low the buffer is filled up to chunk bytes.
+*/
+struct Burst
+{
+  size_t first;
+  size_t chunk;
+  uint64_t us_per_byte;
+  size_t in_flight;
+  int draining;
+  uint64_t updated_us;
+  size_t frames;
+};
+
+void
+burst_init(struct Burst *burst, size_t first, size_t chunk, uint64_t us_per_byte);
+
+void
+burst_aux(struct Burst *burst, int aux, uint64_t now_us);
+
+size_t
+burst_room(struct Burst *burst, uint64_t now_us);
+
+void
+burst_wrote(struct Burst *burst, size_t bytes, uint64_t now_us);
+
+int64_t
+burst_wait_us(struct Burst *burst, size_t bytes, uint64_t now_us);
+
+#endif
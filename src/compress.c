@@ -0,0 +1,383 @@
+#include "compress.h"
+
+static uint32_t
+compress_hash3(const uint8_t *p)
+{
+  uint32_t v;
+  v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - COMPRESS_HASH_BITS);
+}
+
+static ssize_t
+compress_lzss(const struct Dictionary *dict, const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+  uint8_t *buf, *flags;
+  int32_t head[1 << COMPRESS_HASH_BITS];
+  int32_t *prev;
+  size_t dict_len, total, pos, o, best_len, best_off, len, item;
+  int32_t cand;
+  ssize_t ret;
+
+  dict_len = dict != NULL ? dict->len : 0;
+  total = dict_len + in_len;
+
+  buf = malloc(total);
+  prev = malloc(total * sizeof(int32_t));
+  if(buf == NULL || prev == NULL)
+  {
+    free(buf);
+    free(prev);
+    return -1;
+  }
+
+  if(dict_len)
+    memcpy(buf, dict->data, dict_len);
+  memcpy(buf+dict_len, in, in_len);
+
+  for(int i=0; i < (1 << COMPRESS_HASH_BITS); i++)
+    head[i] = -1;
+
+  /* the dictionary is only searched, never output */
+  for(pos = 0; pos + COMPRESS_MIN_MATCH <= dict_len; pos++)
+  {
+    uint32_t h = compress_hash3(buf+pos);
+    prev[pos] = head[h];
+    head[h] = pos;
+  }
+
+  o = 0;
+  item = 8;
+  flags = NULL;
+  ret = -1;
+  pos = dict_len;
+
+  while(pos < total)
+  {
+    if(item == 8)
+    {
+      if(o >= out_len)
+        goto done;
+      flags = &out[o++];
+      *flags = 0;
+      item = 0;
+    }
+
+    best_len = 0;
+    best_off = 0;
+
+    if(pos + COMPRESS_MIN_MATCH <= total)
+    {
+      uint32_t h = compress_hash3(buf+pos);
+      int chain = COMPRESS_MAX_CHAIN;
+
+      for(cand = head[h]; cand != -1 && chain-- > 0; cand = prev[cand])
+      {
+        if(pos - cand > COMPRESS_WINDOW)
+          break;
+
+        len = 0;
+        while(len < COMPRESS_MAX_MATCH && pos+len < total && buf[cand+len] == buf[pos+len])
+          len++;
+
+        if(len > best_len)
+        {
+          best_len = len;
+          best_off = pos - cand;
+          if(len == COMPRESS_MAX_MATCH)
+            break;
+        }
+      }
+    }
+
+    if(best_len >= COMPRESS_MIN_MATCH)
+    {
+      if(o + 2 > out_len)
+        goto done;
+      out[o++] = (best_off-1) >> 4;
+      out[o++] = ((best_off-1) & 0x0f) << 4 | (best_len - COMPRESS_MIN_MATCH);
+      *flags |= 1 << item;
+    }
+    else
+    {
+      best_len = 1;
+      if(o >= out_len)
+        goto done;
+      out[o++] = buf[pos];
+    }
+    item++;
+
+    for(len = 0; len < best_len; len++, pos++)
+    {
+      if(pos + COMPRESS_MIN_MATCH <= total)
+      {
+        uint32_t h = compress_hash3(buf+pos);
+        prev[pos] = head[h];
+        head[h] = pos;
+      }
+    }
+  }
+
+  ret = o;
+
+done:
+  free(buf);
+  free(prev);
+  return ret;
+}
+
+static ssize_t
+decompress_lzss(const struct Dictionary *dict, const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+  size_t i, o, off, len, dict_len;
+  uint8_t flags;
+
+  dict_len = dict != NULL ? dict->len : 0;
+  i = o = 0;
+
+  while(i < in_len)
+  {
+    flags = in[i++];
+    for(int item = 0; item < 8 && i < in_len; item++)
+    {
+      if(!(flags & (1 << item)))
+      {
+        if(o >= out_len)
+          return -1;
+        out[o++] = in[i++];
+        continue;
+      }
+
+      if(i + 2 > in_len)
+        return -1;
+
+      off = ((size_t) in[i] << 4 | in[i+1] >> 4) + 1;
+      len = (in[i+1] & 0x0f) + COMPRESS_MIN_MATCH;
+      i += 2;
+
+      if(off > o + dict_len || o + len > out_len)
+        return -1;
+
+      /* a match can start in the dictionary and run into the output */
+      for(size_t j = 0; j < len; j++, o++)
+      {
+        if(off > o)
+          out[o] = dict->data[dict_len - (off - o)];
+        else
+          out[o] = out[o - off];
+      }
+    }
+  }
+
+  return o;
+}
+
+static const struct Codec codecs[] =
+{
+  {"lzss", compress_lzss, decompress_lzss}
+};
+
+const struct Codec*
+compress_codec(const char *name)
+{
+  for(int i=0; i<sizeof(codecs)/sizeof(codecs[0]); i++)
+  {
+    if(strcmp(codecs[i].name, name) == 0)
+      return &codecs[i];
+  }
+  return NULL;
+}
+
+void
+compress_dictionary_init(struct Dictionary *dict)
+{
+  dict->data = NULL;
+  dict->len = 0;
+}
+
+void
+compress_dictionary_destroy(struct Dictionary *dict)
+{
+  free(dict->data);
+  compress_dictionary_init(dict);
+}
+
+/* only the end of a dictionary larger than the window can be used */
+int
+compress_dictionary_load(struct Dictionary *dict, const char *filename)
+{
+  FILE *file;
+  uint8_t buf[COMPRESS_DICTIONARY_MAX];
+  size_t bytes, len;
+
+  file = fopen(filename, "r");
+  if(file == NULL)
+    return -1;
+
+  len = 0;
+  while((bytes = fread(buf + (len % COMPRESS_DICTIONARY_MAX), 1, COMPRESS_DICTIONARY_MAX - (len % COMPRESS_DICTIONARY_MAX), file)) > 0)
+    len += bytes;
+
+  if(ferror(file))
+  {
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+
+  compress_dictionary_destroy(dict);
+
+  if(len == 0)
+    return 0;
+
+  dict->len = len < COMPRESS_DICTIONARY_MAX ? len : COMPRESS_DICTIONARY_MAX;
+  dict->data = malloc(dict->len);
+  if(dict->data == NULL)
+    return -1;
+
+  /* the buffer is a ring when the file was larger than it */
+  if(len <= COMPRESS_DICTIONARY_MAX)
+  {
+    memcpy(dict->data, buf, len);
+  }
+  else
+  {
+    size_t split = len % COMPRESS_DICTIONARY_MAX;
+    memcpy(dict->data, buf+split, COMPRESS_DICTIONARY_MAX-split);
+    memcpy(dict->data+COMPRESS_DICTIONARY_MAX-split, buf, split);
+  }
+
+  return 0;
+}
+
+int
+compress_dictionary_save(struct Dictionary *dict, const char *filename)
+{
+  FILE *file;
+  int err;
+
+  file = fopen(filename, "w");
+  if(file == NULL)
+    return -1;
+
+  err = fwrite(dict->data, 1, dict->len, file) != dict->len;
+  err |= fclose(file) != 0;
+  return err ? -1 : 0;
+}
+
+static uint32_t
+compress_train_hash(const uint8_t *p)
+{
+  uint64_t v = 0;
+  for(int i=0; i<COMPRESS_TRAIN_DMER; i++)
+    v |= (uint64_t) p[i] << (8*i);
+  return (v * 0x9E3779B97F4A7C15ull) >> (64 - COMPRESS_TRAIN_HASH_BITS);
+}
+
+struct TrainSegment
+{
+  size_t pos;
+  uint64_t score;
+};
+
+static int
+compress_train_compare(const void *a, const void *b)
+{
+  const struct TrainSegment *sa = a, *sb = b;
+  if(sa->score < sb->score)
+    return -1;
+  return sa->score > sb->score;
+}
+
+int
+compress_dictionary_train(struct Dictionary *dict, const uint8_t *samples, size_t samples_len, size_t dict_size)
+{
+  uint32_t *counts;
+  struct TrainSegment *segments;
+  size_t nsegments, epoch, start, end, pos, used, dmers;
+  uint64_t score, best;
+
+  if(dict_size > COMPRESS_DICTIONARY_MAX)
+    dict_size = COMPRESS_DICTIONARY_MAX;
+
+  compress_dictionary_destroy(dict);
+
+  /* not enough to choose from, use all of it */
+  if(samples_len <= dict_size)
+  {
+    dict->data = malloc(samples_len ? samples_len : 1);
+    if(dict->data == NULL)
+      return -1;
+    memcpy(dict->data, samples, samples_len);
+    dict->len = samples_len;
+    return 0;
+  }
+
+  counts = calloc(1 << COMPRESS_TRAIN_HASH_BITS, sizeof(uint32_t));
+  nsegments = dict_size / COMPRESS_TRAIN_SEGMENT;
+  segments = calloc(nsegments, sizeof(struct TrainSegment));
+  dict->data = malloc(dict_size);
+  if(counts == NULL || segments == NULL || dict->data == NULL)
+  {
+    free(counts);
+    free(segments);
+    compress_dictionary_destroy(dict);
+    return -1;
+  }
+
+  for(pos = 0; pos + COMPRESS_TRAIN_DMER <= samples_len; pos++)
+    counts[compress_train_hash(samples+pos)]++;
+
+  dmers = COMPRESS_TRAIN_SEGMENT - COMPRESS_TRAIN_DMER + 1;
+  epoch = samples_len / nsegments;
+  used = 0;
+
+  for(size_t e = 0; e < nsegments; e++)
+  {
+    start = e * epoch;
+    end = start + epoch;
+    if(end > samples_len)
+      end = samples_len;
+    if(end - start < COMPRESS_TRAIN_SEGMENT)
+      continue;
+
+    /* slide a segment across the epoch scoring it by its dmers */
+    score = 0;
+    for(size_t j = 0; j < dmers; j++)
+      score += counts[compress_train_hash(samples+start+j)];
+
+    best = score;
+    segments[used].pos = start;
+    for(pos = start+1; pos + COMPRESS_TRAIN_SEGMENT <= end; pos++)
+    {
+      score -= counts[compress_train_hash(samples+pos-1)];
+      score += counts[compress_train_hash(samples+pos+dmers-1)];
+      if(score > best)
+      {
+        best = score;
+        segments[used].pos = pos;
+      }
+    }
+
+    if(best == 0)
+      continue;
+
+    /* don't pick the same strings again */
+    segments[used].score = best;
+    for(size_t j = 0; j < dmers; j++)
+      counts[compress_train_hash(samples+segments[used].pos+j)] = 0;
+    used++;
+  }
+
+  qsort(segments, used, sizeof(struct TrainSegment), compress_train_compare);
+
+  dict->len = 0;
+  for(size_t i = 0; i < used; i++)
+  {
+    memcpy(dict->data+dict->len, samples+segments[i].pos, COMPRESS_TRAIN_SEGMENT);
+    dict->len += COMPRESS_TRAIN_SEGMENT;
+  }
+
+  free(counts);
+  free(segments);
+  return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+/*
+ Payloads are compressed with a codec looked up by name. The built in
+ codec is LZSS with a 4096 byte window. The window starts out filled
+ with a preset dictionary, which both ends must share, so even a short
+ message can refer back to strings which are common in the traffic.
+
+ Each group of up to 8 items starts with a byte of flags, least
+ significant bit first. A clear flag is a literal byte, a set flag is a
+ match of two bytes with a 12 bit offset back and a 4 bit length.
+
+ A dictionary is trained from captured traffic by splitting it into
+ epochs and taking the segment from each epoch whose substrings are the
+ most frequent in the whole capture, the best segments go at the end of
+ the dictionary where they're closest to the data.
+*/
+#define COMPRESS_WINDOW 4096
+#define COMPRESS_MIN_MATCH 3
+#define COMPRESS_MAX_MATCH 18
+#define COMPRESS_MAX_CHAIN 64
+#define COMPRESS_HASH_BITS 12
+
+#define COMPRESS_DICTIONARY_MAX COMPRESS_WINDOW
+#define COMPRESS_TRAIN_SEGMENT 32
+#define COMPRESS_TRAIN_DMER 6
+#define COMPRESS_TRAIN_HASH_BITS 16
+#define COMPRESS_TRAIN_MAX_SAMPLES (4*1024*1024)
+
+struct Dictionary
+{
+  uint8_t *data;
+  size_t len;
+};
+
+struct Codec
+{
+  const char *name;
+  ssize_t (*compress)(const struct Dictionary *dict, const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+  ssize_t (*decompress)(const struct Dictionary *dict, const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+};
+
+const struct Codec*
+compress_codec(const char *name);
+
+void
+compress_dictionary_init(struct Dictionary *dict);
+
+void
+compress_dictionary_destroy(struct Dictionary *dict);
+
+int
+compress_dictionary_load(struct Dictionary *dict, const char *filename);
+
+int
+compress_dictionary_save(struct Dictionary *dict, const char *filename);
+
+int
+compress_dictionary_train(struct Dictionary *dict, const uint8_t *samples, size_t samples_len, size_t dict_size);
+
+#endif
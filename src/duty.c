@@ -0,0 +1,87 @@
+#include "duty.h"
+
+/*
+  The burst holds at least min_burst_us so the longest packet can go,
+  but never more than half the budget. The bucket starts full, nothing
+  is known to have been sent in the last window.
+*/
+void
+duty_init(struct Duty *duty, uint32_t ppm, uint64_t min_burst_us, uint64_t now_us)
+{
+  uint64_t budget;
+
+  memset(duty, 0, sizeof(struct Duty));
+
+  if(ppm > DUTY_PPM)
+    ppm = DUTY_PPM;
+
+  budget = DUTY_WINDOW_US * ppm;
+  duty->ppm = ppm;
+  duty->capacity = budget / 100 * DUTY_BURST_PERCENT;
+  if(duty->capacity < min_burst_us * DUTY_PPM)
+    duty->capacity = min_burst_us * DUTY_PPM;
+  if(duty->capacity > budget / 2)
+    duty->capacity = budget / 2;
+  duty->refill = (budget - duty->capacity) / DUTY_WINDOW_US;
+  duty->tokens = duty->capacity;
+  duty->updated_us = now_us;
+}
+
+static void
+duty_update(struct Duty *duty, uint64_t now_us)
+{
+  if(now_us > duty->updated_us)
+  {
+    duty->tokens += (now_us - duty->updated_us) * duty->refill;
+    if(duty->tokens > duty->capacity)
+      duty->tokens = duty->capacity;
+  }
+  duty->updated_us = now_us;
+}
+
+/* microseconds on air which can be sent right now */
+uint64_t
+duty_available_us(struct Duty *duty, uint64_t now_us)
+{
+  duty_update(duty, now_us);
+  return duty->tokens / DUTY_PPM;
+}
+
+uint64_t
+duty_capacity_us(struct Duty *duty)
+{
+  return duty->capacity / DUTY_PPM;
+}
+
+/* take off the time on air of what was just written */
+void
+duty_charge(struct Duty *duty, uint64_t air_us, uint64_t now_us)
+{
+  uint64_t cost;
+
+  duty_update(duty, now_us);
+
+  cost = air_us * DUTY_PPM;
+  duty->tokens = cost < duty->tokens ? duty->tokens - cost : 0;
+  duty->charged_us += air_us;
+}
+
+/*
+  When there will be enough for air_us on air, now if there is already.
+  Returns 0 if there never will be.
+*/
+uint64_t
+duty_ready_us(struct Duty *duty, uint64_t air_us, uint64_t now_us)
+{
+  uint64_t cost;
+
+  duty_update(duty, now_us);
+
+  cost = air_us * DUTY_PPM;
+  if(cost <= duty->tokens)
+    return now_us;
+  if(cost > duty->capacity || duty->refill == 0)
+    return 0;
+
+  return now_us + (cost - duty->tokens + duty->refill - 1) / duty->refill;
+}
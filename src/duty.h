@@ -0,0 +1,52 @@
+#ifndef DUTY_H
+#define DUTY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ A token bucket of time on air which keeps transmits under a duty cycle
+ limit. Regulations measure the duty cycle over a window, an hour in
+ the 868 MHz band, so over any window the e32 may be on air for the
+ duty cycle times the window.
+
+ A bucket which refills at the duty cycle and holds a burst lets the
+ burst plus a full window of refill through, which is over the limit.
+ So the burst is a share of the window budget and the bucket refills
+ at the rest of the budget spread over the window, then the burst and
+ the refill over any window add up to exactly the budget.
+
+ Time on air is kept in microseconds times parts per million so the
+ refill has no rounding.
+*/
+#define DUTY_PPM 1000000
+#define DUTY_WINDOW_US 3600000000ULL
+#define DUTY_BURST_PERCENT 10
+
+struct Duty
+{
+  uint32_t ppm;
+  uint64_t refill;
+  uint64_t capacity;
+  uint64_t tokens;
+  uint64_t updated_us;
+  uint64_t charged_us;
+};
+
+void
+duty_init(struct Duty *duty, uint32_t ppm, uint64_t min_burst_us, uint64_t now_us);
+
+uint64_t
+duty_available_us(struct Duty *duty, uint64_t now_us);
+
+uint64_t
+duty_capacity_us(struct Duty *duty);
+
+void
+duty_charge(struct Duty *duty, uint64_t air_us, uint64_t now_us);
+
+uint64_t
+duty_ready_us(struct Duty *duty, uint64_t air_us, uint64_t now_us);
+
+#endif
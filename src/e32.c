@@ -2,17 +2,15 @@
 
 uint8_t txbuf[TX_BUF_BYTES];
 uint8_t rxbuf[RX_BUF_BYTES];
+uint8_t rxbuf_pair[RX_BUF_BYTES];
+uint8_t rxbuf_link[BOND_MAX_LINKS][RX_BUF_BYTES];
+uint8_t zbuf[TX_BUF_BYTES];
+uint8_t tunbuf[OPTIONS_TUN_MTU];
+uint8_t iphcbuf[TX_BUF_BYTES+IPHC_IPV6_HEADER_LENGTH+IPHC_UDP_HEADER_LENGTH];
 
- /* define these indices so we don't have to reference pfd[3] */
-#define PFD_STDIN 0
-#define PFD_UART 1
-#define PFD_INPUT_FILE 2
-#define PFD_SOCKET_UNIX_DATA 3
-#define PFD_GPIO_AUX 4
-#define PFD_SOCKET_UNIX_CONTROL 5
 
 static int
-e32_init_gpio(struct options *opts, struct E32 *dev)
+e32_init_gpio(struct E32 *dev, int gpio_m0, int gpio_m1, int gpio_aux)
 {
   int inputs[64], outputs[64];
   int ninputs, noutputs;
@@ -24,13 +22,13 @@ e32_init_gpio(struct options *opts, struct E32 *dev)
   if(gpio_exists())
     return 1;
 
-  if(gpio_valid(opts->gpio_m0))
+  if(gpio_valid(gpio_m0))
     return 2;
 
-  if(gpio_valid(opts->gpio_m1))
+  if(gpio_valid(gpio_m1))
     return 3;
 
-  if(gpio_valid(opts->gpio_aux))
+  if(gpio_valid(gpio_aux))
     return 4;
 
   /* check if gpio is already set */
@@ -39,65 +37,65 @@ e32_init_gpio(struct options *opts, struct E32 *dev)
 
   for(int i=0; i<noutputs; i++)
   {
-    if(outputs[i] == opts->gpio_m0)
+    if(outputs[i] == gpio_m0)
       hm0 = 1;
-    if(outputs[i] == opts->gpio_m1)
+    if(outputs[i] == gpio_m1)
       hm1 = 1;
   }
 
   for(int i=0; i<ninputs; i++)
   {
-    if(inputs[i] == opts->gpio_aux)
+    if(inputs[i] == gpio_aux)
       haux = 1;
   }
 
   if(!hm0)
   {
-    if(gpio_export(opts->gpio_m0))
+    if(gpio_export(gpio_m0))
       return 6;
 
-    if(gpio_set_output(opts->gpio_m0))
+    if(gpio_set_output(gpio_m0))
       return 7;
   }
 
   if(!hm1)
   {
-    if(gpio_export(opts->gpio_m1))
+    if(gpio_export(gpio_m1))
       return 7;
 
-    if(gpio_set_output(opts->gpio_m1))
+    if(gpio_set_output(gpio_m1))
       return 8;
   }
 
   if(!haux)
   {
-    if(gpio_export(opts->gpio_aux))
+    if(gpio_export(gpio_aux))
       return 9;
 
-    if(gpio_set_input(opts->gpio_aux))
+    if(gpio_set_input(gpio_aux))
       return 10;
 
-    if(gpio_set_edge_both(opts->gpio_aux))
+    if(gpio_set_edge_both(gpio_aux))
       return 11;
   }
 
   int edge;
-  if(gpio_get_edge(opts->gpio_aux, &edge))
+  if(gpio_get_edge(gpio_aux, &edge))
     return 12;
 
   if(edge != 3)
-    if(gpio_set_edge_both(opts->gpio_aux))
+    if(gpio_set_edge_both(gpio_aux))
         return 13;
 
-  dev->fd_gpio_m0 = gpio_open(opts->gpio_m0);
+  dev->fd_gpio_m0 = gpio_open(gpio_m0);
   if(dev->fd_gpio_m0 == -1)
     return 14;
 
-  dev->fd_gpio_m1 = gpio_open(opts->gpio_m1);
+  dev->fd_gpio_m1 = gpio_open(gpio_m1);
   if(dev->fd_gpio_m1 == -1)
     return 15;
 
-  dev->fd_gpio_aux = gpio_open(opts->gpio_aux);
+  dev->fd_gpio_aux = gpio_open(gpio_aux);
   if(dev->fd_gpio_aux == -1)
     return 16;
 
@@ -117,22 +115,198 @@ e32_init_uart(struct E32 *dev, char *tty_name)
   return ret;
 }
 
-static int
-socket_match(void *a, void *b)
+static uint64_t
+e32_now_us()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static uint64_t
+e32_now_ms()
+{
+  return e32_now_us() / 1000;
+}
+
+/* milliseconds from now until a time, 0 if it has passed */
+static uint64_t
+e32_until_ms(uint64_t us)
+{
+  uint64_t now;
+
+  now = e32_now_us();
+  return us > now ? (us - now) / 1000 : 0;
+}
+
+/* bytes of each packet left for data after the fixed mode, ARQ and bond headers */
+static size_t
+e32_packet_length(struct E32 *dev)
+{
+  size_t len;
+
+  len = E32_MAX_PACKET_LENGTH;
+  if(dev->transmission_mode)
+    len -= E32_FIXED_HEADER_LENGTH;
+  if(dev->arq != NULL)
+    len -= ARQ_DATA_HEADER_LENGTH;
+  if(dev->bond != NULL)
+    len -= BOND_HEADER_LENGTH;
+  return len;
+}
+
+/* bytes of a packet written to the e32 which go over the air */
+static size_t
+e32_air_length(struct E32 *dev, size_t len)
 {
-  struct sockaddr_un *socka;
-  struct sockaddr_un *sockb;
+  if(dev->transmission_mode && len >= E32_FIXED_DEST_LENGTH)
+    return len - E32_FIXED_DEST_LENGTH;
+  return len;
+}
 
-  socka = (struct sockaddr_un*) a;
-  sockb = (struct sockaddr_un*) b;
+/*
+  What a frame costs when clients take turns sending, its time on air
+  from the model so calibration doesn't shift the balance. Without a
+  model its length is used.
+*/
+static uint64_t
+e32_frame_cost(struct E32 *dev, size_t len)
+{
+  uint64_t cost;
 
-  return strcmp(socka->sun_path, sockb->sun_path);
+  cost = airtime_model_us(&dev->airtime, len);
+  return cost > 0 ? cost : len;
 }
 
+/*
+  The ARQ timeouts from the time on air of a full packet. A poll and its
+  answer each take at most a packet and the turnaround, a receiver waits
+  that long twice before acknowledging on its own so it doesn't talk
+  over a sender with more to send.
+*/
 static void
-socket_free(void *socket)
+e32_arq_timing(struct E32 *dev)
+{
+  uint64_t packet_us;
+
+  packet_us = airtime_us(&dev->airtime, E32_MAX_PACKET_LENGTH);
+  if(packet_us == 0)
+    packet_us = E32_ARQ_DEFAULT_PACKET_US;
+  packet_us += E32_ARQ_TURNAROUND_US;
+
+  dev->arq->rto_min_us = packet_us;
+  dev->arq->ack_delay_us = 2*packet_us;
+  if(dev->arq->srtt_us == 0)
+    dev->arq->rto_us = 3*packet_us;
+}
+
+/* block until AUX is at level, returns 1 on a timeout */
+static int
+e32_wait_aux(struct E32 *dev, int level, int timeout_ms)
+{
+  struct pollfd pfd;
+  uint64_t deadline, now;
+  int aux, ret;
+
+  pfd.fd = dev->fd_gpio_aux;
+  pfd.events = POLLPRI;
+  deadline = e32_now_ms() + timeout_ms;
+
+  while(1)
+  {
+    lseek(dev->fd_gpio_aux, 0, SEEK_SET);
+    if(gpio_read(dev->fd_gpio_aux, &aux) != 2)
+      return -1;
+
+    if(aux == level)
+      return 0;
+
+    now = e32_now_ms();
+    if(now >= deadline)
+      return 1;
+
+    ret = poll(&pfd, 1, deadline - now);
+    if(ret == -1)
+    {
+      errno_output("e32_wait_aux: poll\n");
+      return -1;
+    }
+  }
+}
+
+/*
+  Wait for the e32 to be ready after a mode change or a command rather
+  than sleeping for the worst case. With low_ms AUX is first given that
+  long to go low, for when the e32 may not have started yet. How long it
+  took is kept in settle_us. A timeout isn't an error, the e32 is taken
+  to be ready as it was when sleeping.
+*/
+static int
+e32_wait_ready(struct E32 *dev, const char *what, int low_ms, int timeout_ms)
+{
+  uint64_t start;
+  int err;
+
+  start = e32_now_us();
+  err = low_ms ? e32_wait_aux(dev, 0, low_ms) : 0;
+  if(err != -1)
+    err = e32_wait_aux(dev, 1, timeout_ms);
+  if(err == -1)
+  {
+    err_output("e32_wait_ready: unable to read aux after %s\n", what);
+    return -1;
+  }
+  else if(err)
+    err_output("e32_wait_ready: aux still low %d ms after %s\n", timeout_ms, what);
+
+  usleep(E32_AUX_SETTLE_US);
+
+  dev->settle_us = e32_now_us() - start;
+  if(dev->settle_us > dev->settle_max_us)
+    dev->settle_max_us = dev->settle_us;
+
+  if(dev->verbose)
+    debug_output("e32_wait_ready: ready %llu us after %s, at most %llu us\n", (unsigned long long) dev->settle_us, what, (unsigned long long) dev->settle_max_us);
+
+  return 0;
+}
+
+/*
+  Another e32 driven along with this one, the rx e32 of a pair or a
+  bonded e32. It has its own UART and pins but what it receives is
+  handled by this one, so it needs nothing else.
+*/
+static int
+e32_init_module(struct E32 **module, struct options *opts, char *tty_name, int gpio_m0, int gpio_m1, int gpio_aux)
 {
-  free(socket);
+  struct E32 *dev;
+  int ret;
+
+  dev = calloc(1, sizeof(struct E32));
+  *module = dev;
+  if(dev == NULL)
+  {
+    err_output("unable to allocate the e32 on %s\n", tty_name);
+    return -1;
+  }
+
+  dev->verbose = opts->verbose;
+  dev->uart_fd = -1;
+  dev->fd_gpio_m0 = -1;
+  dev->fd_gpio_m1 = -1;
+  dev->fd_gpio_aux = -1;
+  dev->fd_timer = -1;
+  dev->prev_mode = -1;
+  dev->state = IDLE;
+
+  ret = e32_init_gpio(dev, gpio_m0, gpio_m1, gpio_aux);
+  if(ret)
+  {
+    err_output("unable to initialize the gpio of the e32 on %s: %d\n", tty_name, ret);
+    return ret;
+  }
+
+  return e32_init_uart(dev, tty_name);
 }
 
 int
@@ -141,9 +315,50 @@ e32_init(struct E32 *dev, struct options *opts)
   int ret;
 
   dev->verbose = opts->verbose;
-  dev->socket_list = NULL;
-
-  ret = e32_init_gpio(opts, dev);
+  dev->clients = NULL;
+  dev->tx_queue = NULL;
+  dev->reassembly = NULL;
+  dev->burst = NULL;
+  dev->burst_chunk = E32_MAX_PACKET_LENGTH;
+  dev->burst_us_per_byte = 0;
+  dev->fd_timer = -1;
+  dev->tx_start_us = 0;
+  dev->tx_done_us = 0;
+  dev->tx_len = 0;
+  dev->tx_frames = 0;
+  dev->timer_us = 0;
+  dev->rx_aux_us = 0;
+  dev->rx_gap_us = 0;
+  dev->settle_us = 0;
+  dev->settle_max_us = 0;
+  airtime_init(&dev->airtime, 0, 0, 0);
+  dev->codec = NULL;
+  compress_dictionary_init(&dev->dictionary);
+  dev->compress_in = 0;
+  dev->compress_out = 0;
+  dev->coalesce_us = opts->coalesce_ms * 1000ULL;
+  memset(dev->coalesce, 0, sizeof(dev->coalesce));
+  dev->arq = NULL;
+  memset(dev->arq_peer, 0xFF, sizeof(dev->arq_peer));
+  dev->fountain_tx = NULL;
+  dev->fountain_rx = NULL;
+  dev->duty = NULL;
+  dev->socket_batch = NULL;
+  dev->udp_batch = NULL;
+  iphc_context(&dev->iphc, opts->tun_net, opts->tun_prefix);
+
+  dev->rx = NULL;
+  dev->bond = NULL;
+  dev->sessions = NULL;
+  dev->nsessions = 0;
+  dev->session_id = 0;
+  dev->notify = NULL;
+  dev->control = NULL;
+  dev->version_cached = 0;
+  dev->settings_cached = 0;
+  memset(dev->link, 0, sizeof(dev->link));
+
+  ret = e32_init_gpio(dev, opts->gpio_m0, opts->gpio_m1, opts->gpio_aux);
 
   if(ret)
     return ret;
@@ -154,8 +369,153 @@ e32_init(struct E32 *dev, struct options *opts)
 
   dev->prev_mode = -1;
 
-  dev->socket_list = calloc(1, sizeof(struct List));
-  list_init(dev->socket_list, socket_match, socket_free);
+  if(opts->rx_tty_name[0])
+  {
+    ret = e32_init_module(&dev->rx, opts, opts->rx_tty_name, opts->rx_gpio_m0, opts->rx_gpio_m1, opts->rx_gpio_aux);
+    if(ret)
+      return ret;
+  }
+
+  /* this e32 is the first bonded link */
+  if(opts->bond_modules)
+  {
+    dev->bond = calloc(1, sizeof(struct Bond));
+    if(dev->bond == NULL || bond_init(dev->bond, opts->bond_modules + 1, (getpid() ^ time(NULL)) & 0xFF, 0))
+    {
+      err_output("unable to allocate the bond\n");
+      return -1;
+    }
+
+    dev->link[0] = dev;
+    for(int i = 0; i < opts->bond_modules; i++)
+    {
+      ret = e32_init_module(&dev->link[i+1], opts, opts->bond[i].tty_name,
+          opts->bond[i].gpio_m0, opts->bond[i].gpio_m1, opts->bond[i].gpio_aux);
+      if(ret)
+        return ret;
+    }
+  }
+
+  dev->clients = calloc(1, sizeof(struct Registry));
+  if(dev->clients == NULL || registry_init(dev->clients))
+  {
+    err_output("unable to allocate the client registry\n");
+    return -1;
+  }
+
+  if(opts->tx_notify && opts->fd_socket_unix_data != -1)
+  {
+    dev->notify = calloc(1, sizeof(struct E32Notifier));
+    if(dev->notify == NULL)
+    {
+      err_output("unable to allocate the transmit notifications\n");
+      return -1;
+    }
+    dev->notify->fd = opts->fd_socket_unix_data;
+  }
+
+  if(opts->fd_socket_unix_control != -1)
+  {
+    dev->control = calloc(1, sizeof(struct E32Control));
+    if(dev->control == NULL)
+    {
+      err_output("unable to allocate the control requests\n");
+      return -1;
+    }
+    dev->control->fd = opts->fd_socket_unix_control;
+  }
+
+  if(opts->fd_socket_unix_seqpacket != -1)
+  {
+    dev->sessions = calloc(E32_MAX_SESSIONS, sizeof(struct E32Session));
+    if(dev->sessions == NULL)
+    {
+      err_output("unable to allocate the sessions\n");
+      return -1;
+    }
+  }
+
+  if(opts->fd_socket_unix_data != -1)
+  {
+    dev->socket_batch = calloc(1, sizeof(struct E32SocketBatch));
+    if(dev->socket_batch == NULL)
+    {
+      err_output("unable to allocate the socket batch\n");
+      return -1;
+    }
+  }
+
+  if(opts->fd_socket_udp != -1)
+  {
+    dev->udp_batch = calloc(1, sizeof(struct UdpBatch));
+    if(dev->udp_batch == NULL)
+    {
+      err_output("unable to allocate the udp batch\n");
+      return -1;
+    }
+  }
+
+  dev->tx_queue = calloc(1, sizeof(struct Queue));
+  if(dev->tx_queue == NULL || queue_init(dev->tx_queue, E32_TX_QUEUE_FRAMES, E32_MAX_PACKET_LENGTH))
+  {
+    err_output("unable to allocate the transmit queue\n");
+    return -1;
+  }
+  queue_set_quota(dev->tx_queue, QUEUE_SOURCE_STDIN, E32_TX_QUOTA_STDIN);
+  queue_set_quota(dev->tx_queue, QUEUE_SOURCE_FILE, E32_TX_QUOTA_FILE);
+  queue_set_quota(dev->tx_queue, QUEUE_SOURCE_SOCKET_UNIX_DATA, E32_TX_QUOTA_SOCKET_UNIX_DATA);
+  queue_set_quota(dev->tx_queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION, E32_TX_QUOTA_SOCKET_UNIX_SESSION);
+  queue_set_quota(dev->tx_queue, QUEUE_SOURCE_SOCKET_UDP, E32_TX_QUOTA_SOCKET_UDP);
+  queue_set_quota(dev->tx_queue, QUEUE_SOURCE_TUN, E32_TX_QUOTA_TUN);
+  queue_set_quantum(dev->tx_queue, e32_frame_cost(dev, E32_MAX_PACKET_LENGTH));
+
+  /* a new session each run so the other e32 doesn't take frames as duplicates */
+  if(opts->reliable)
+  {
+    dev->arq = calloc(1, sizeof(struct Arq));
+    if(dev->arq == NULL)
+    {
+      err_output("unable to allocate the ARQ\n");
+      return -1;
+    }
+    arq_init(dev->arq, (getpid() ^ time(NULL)) & 0xFF, 0, 0, 0);
+    e32_arq_timing(dev);
+  }
+
+  dev->frame_id = 0;
+  dev->reassembly = calloc(1, sizeof(struct FrameReassembly));
+  if(dev->reassembly == NULL)
+  {
+    err_output("unable to allocate the reassembly\n");
+    return -1;
+  }
+  frame_reassembly_init(dev->reassembly,
+      e32_packet_length(dev) - FRAME_FRAGMENT_HEADER_LENGTH,
+      E32_MAX_MESSAGE_LENGTH,
+      FRAME_REASSEMBLY_MAX_BYTES,
+      FRAME_REASSEMBLY_TIMEOUT_MS);
+
+  if(opts->burst)
+  {
+    dev->burst = calloc(1, sizeof(struct Burst));
+    if(dev->burst == NULL)
+    {
+      err_output("unable to allocate the burst model\n");
+      return -1;
+    }
+  }
+
+  if(opts->compress)
+  {
+    dev->codec = compress_codec("lzss");
+    if(opts->dictionary_file[0] && compress_dictionary_load(&dev->dictionary, opts->dictionary_file))
+    {
+      errno_output("unable to load dictionary %s\n", opts->dictionary_file);
+      return -1;
+    }
+    if(dev->verbose)
+      debug_output("compressing with %s and a %d byte dictionary\n", dev->codec->name, dev->dictionary.len);
+  }
 
   dev->state = IDLE;
   dev->isatty = 0;
@@ -163,15 +523,16 @@ e32_init(struct E32 *dev, struct options *opts)
   return 0;
 }
 
-int
-e32_set_mode(struct E32 *dev, int mode)
+/* change the mode pins, returns -1 on error and 1 if the mode changed */
+static int
+e32_write_mode(struct E32 *dev, int mode)
 {
   int ret;
 
   if(e32_get_mode(dev))
   {
     err_output("unable to get mode\n");
-    return 1;
+    return -1;
   }
 
   dev->prev_mode = dev->mode;
@@ -193,18 +554,25 @@ e32_set_mode(struct E32 *dev, int mode)
 
   if(ret)
   {
-    return ret;
+    return -1;
   }
 
   if(dev->verbose)
     debug_output("new mode %d, prev mode is %d\n", dev->mode, dev->prev_mode);
 
-  if(dev->prev_mode != dev->mode)
-  {
-    usleep(20000);
-  }
+  return 1;
+}
 
-  return ret;
+int
+e32_set_mode(struct E32 *dev, int mode)
+{
+  int ret;
+
+  ret = e32_write_mode(dev, mode);
+  if(ret == 1)
+    ret = e32_wait_ready(dev, "mode change", E32_AUX_LOW_MS, E32_MODE_TIMEOUT_MS) != 0;
+
+  return ret != 0;
 }
 
 int
@@ -229,6 +597,28 @@ e32_get_mode(struct E32 *dev)
   return ret;
 }
 
+/* close what e32_init_module opened and free the e32 */
+static int
+e32_deinit_module(struct E32 *module)
+{
+  int ret = 0;
+
+  if(module == NULL)
+    return 0;
+
+  if(module->fd_gpio_m0 != -1)
+    ret |= gpio_close(module->fd_gpio_m0);
+  if(module->fd_gpio_m1 != -1)
+    ret |= gpio_close(module->fd_gpio_m1);
+  if(module->fd_gpio_aux != -1)
+    ret |= gpio_close(module->fd_gpio_aux);
+  if(module->uart_fd != -1)
+    ret |= close(module->uart_fd);
+
+  free(module);
+  return ret;
+}
+
 int
 e32_deinit(struct E32 *dev, struct options* opts)
 {
@@ -247,12 +637,59 @@ e32_deinit(struct E32 *dev, struct options* opts)
 
   ret |= close(dev->uart_fd);
 
-  if(dev->socket_list != NULL)
+  ret |= e32_deinit_module(dev->rx);
+
+  for(int i = 1; i < BOND_MAX_LINKS; i++)
+    ret |= e32_deinit_module(dev->link[i]);
+  free(dev->bond);
+
+  for(size_t i = 0; i < dev->nsessions; i++)
+    close(dev->sessions[i].fd);
+  free(dev->sessions);
+  free(dev->notify);
+  free(dev->control);
+
+  if(dev->clients != NULL)
+  {
+    registry_destroy(dev->clients);
+    free(dev->clients);
+  }
+
+  if(dev->tx_queue != NULL)
+  {
+    queue_destroy(dev->tx_queue);
+    free(dev->tx_queue);
+  }
+
+  if(dev->reassembly != NULL)
+  {
+    frame_reassembly_destroy(dev->reassembly);
+    free(dev->reassembly);
+  }
+
+  free(dev->burst);
+  free(dev->arq);
+  free(dev->duty);
+  free(dev->socket_batch);
+  free(dev->udp_batch);
+
+  if(dev->fountain_tx != NULL)
+  {
+    free(dev->fountain_tx->file);
+    free(dev->fountain_tx);
+  }
+
+  if(dev->fountain_rx != NULL)
   {
-    list_destroy(dev->socket_list);
-    free(dev->socket_list);
+    fountain_decoder_destroy(&dev->fountain_rx->dec);
+    free(dev->fountain_rx);
   }
 
+  compress_dictionary_destroy(&dev->dictionary);
+
+  if(dev->fd_timer != -1)
+    close(dev->fd_timer);
+
   return ret;
 }
 
@@ -295,31 +732,11 @@ e32_read_uart(struct E32* dev, uint8_t buf[], int n_bytes)
 
 }
 
-int
-e32_cmd_read_settings(struct E32 *dev)
+/* take the fields of the settings the e32 replied with */
+static int
+e32_parse_settings(struct E32 *dev)
 {
-  ssize_t bytes;
-  int err;
-  const uint8_t cmd[3] = {0xC1, 0xC1, 0xC1};
-
-  if(dev->verbose)
-    debug_output("sending command to read settings\n");
-
-  bytes = write(dev->uart_fd, cmd, 3);
-  if(bytes == -1)
-   return -1;
-
-  if(dev->verbose)
-    debug_output("reading settings\n");
-
-  // set a .5 second timout
-  tty_set_read_with_timeout(dev->uart_fd, &dev->tty, 5);
-  err = e32_read_uart(dev, dev->settings, sizeof(dev->settings));
-  if(err)
-  {
-    return err;
-  }
-
+  dev->settings_cached = 0;
   if(dev->settings[0] != 0xC0 && dev->settings[0] != 0xC2)
     return -2;
 
@@ -394,6 +811,10 @@ e32_cmd_read_settings(struct E32 *dev)
   dev->transmission_mode = dev->settings[5] & 0b10000000;
   dev->transmission_mode >>= 7;
 
+  /* fragments fill what's left of a packet after the fixed mode header */
+  if(dev->reassembly != NULL)
+    dev->reassembly->fragment_payload = e32_packet_length(dev) - FRAME_FRAGMENT_HEADER_LENGTH;
+
   dev->io_drive = dev->settings[5] & 0b01000000;
   dev->io_drive >>= 6;
 
@@ -433,6 +854,16 @@ e32_cmd_read_settings(struct E32 *dev)
   dev->fec = dev->settings[5] & 0b00000100;
   dev->fec >>= 2;
 
+  if(dev->airtime.air_data_rate != dev->air_data_rate || dev->airtime.cr != (dev->fec ? 2 : 1) || dev->airtime.uart_baud != dev->uart_baud)
+  {
+    if(airtime_init(&dev->airtime, dev->air_data_rate, dev->fec, dev->uart_baud))
+      warn_output("no air time model for %d bps\n", dev->air_data_rate);
+    if(dev->tx_queue != NULL)
+      queue_set_quantum(dev->tx_queue, e32_frame_cost(dev, E32_MAX_PACKET_LENGTH));
+    if(dev->arq != NULL)
+      e32_arq_timing(dev);
+  }
+
   dev->tx_power_attn_dbm = dev->settings[5] & 0b00000011;
   switch(dev->tx_power_attn_dbm)
   {
@@ -452,11 +883,42 @@ e32_cmd_read_settings(struct E32 *dev)
       dev->tx_power_attn_dbm = 0;
   }
 
-  usleep(54000);
-
+  dev->settings_cached = 1;
   return 0;
 }
 
+int
+e32_cmd_read_settings(struct E32 *dev)
+{
+  ssize_t bytes;
+  int err;
+  const uint8_t cmd[3] = {0xC1, 0xC1, 0xC1};
+
+  if(dev->verbose)
+    debug_output("sending command to read settings\n");
+
+  bytes = write(dev->uart_fd, cmd, 3);
+  if(bytes == -1)
+   return -1;
+
+  if(dev->verbose)
+    debug_output("reading settings\n");
+
+  // set a .5 second timout
+  tty_set_read_with_timeout(dev->uart_fd, &dev->tty, 5);
+  err = e32_read_uart(dev, dev->settings, sizeof(dev->settings));
+  if(err)
+  {
+    return err;
+  }
+
+  err = e32_parse_settings(dev);
+  if(err)
+    return err;
+
+  return e32_wait_ready(dev, "reading settings", 0, E32_CMD_TIMEOUT_MS);
+}
+
 void
 e32_print_settings(struct E32 *dev)
 {
@@ -492,13 +954,14 @@ e32_print_settings(struct E32 *dev)
 
   info_output("UART Baud Rate:           %d bps\n", dev->uart_baud);
   info_output("Air Data Rate:            %d bps\n", dev->air_data_rate);
+  info_output("Packet Time On Air:       %llu ms\n", (unsigned long long) airtime_us(&dev->airtime, E32_MAX_PACKET_LENGTH) / 1000);
   info_output("Channel:                  %d\n", dev->channel);
   info_output("Frequency                 %d MHz\n", dev->channel+dev->frequency_min_mhz);
 
   if(dev->transmission_mode)
-    info_output("Transmission Mode:        Transparent\n");
-  else
     info_output("Transmission Mode:        Fixed\n");
+  else
+    info_output("Transmission Mode:        Transparent\n");
 
   if(dev->io_drive)
     info_output("IO Drive:                 TXD and AUX push-pull output, RXD pull-up input\n");
@@ -521,32 +984,11 @@ e32_cmd_read_operating(struct E32 *dev)
   return -1;
 }
 
-int
-e32_cmd_read_version(struct E32 *dev)
+/* take the frequency and features from the version the e32 replied with */
+static int
+e32_parse_version(struct E32 *dev)
 {
-  ssize_t bytes;
-  int err;
-  const uint8_t cmd[3] = {0xC3, 0xC3, 0xC3};
-
-  if(dev->verbose)
-    debug_output("writing version command\n");
-
-  bytes = write(dev->uart_fd, cmd, 3);
-  if(bytes == -1)
-   return -1;
-
-  if(dev->verbose)
-    debug_output("reading version\n");
-
-  // set a .5 second timout
-  tty_set_read_with_timeout(dev->uart_fd, &dev->tty, 5);
-
-  err = e32_read_uart(dev, dev->version, sizeof(dev->version));
-  if(err)
-  {
-    return err;
-  }
-
+  dev->version_cached = 0;
   if(dev->version[0] != 0xC3)
   {
     err_output("mismatch 0x%02x != 0xc3\n", dev->version[0]);
@@ -589,11 +1031,43 @@ e32_cmd_read_version(struct E32 *dev)
   dev->ver = dev->version[2];
   dev->features = dev->version[3];
 
-  usleep(54000);
-
+  dev->version_cached = 1;
   return 0;
 }
 
+int
+e32_cmd_read_version(struct E32 *dev)
+{
+  ssize_t bytes;
+  int err;
+  const uint8_t cmd[3] = {0xC3, 0xC3, 0xC3};
+
+  if(dev->verbose)
+    debug_output("writing version command\n");
+
+  bytes = write(dev->uart_fd, cmd, 3);
+  if(bytes == -1)
+   return -1;
+
+  if(dev->verbose)
+    debug_output("reading version\n");
+
+  // set a .5 second timout
+  tty_set_read_with_timeout(dev->uart_fd, &dev->tty, 5);
+
+  err = e32_read_uart(dev, dev->version, sizeof(dev->version));
+  if(err)
+  {
+    return err;
+  }
+
+  err = e32_parse_version(dev);
+  if(err)
+    return err;
+
+  return e32_wait_ready(dev, "reading the version", 0, E32_CMD_TIMEOUT_MS);
+}
+
 void
 e32_print_version(struct E32 *dev)
 {
@@ -608,6 +1082,109 @@ e32_print_version(struct E32 *dev)
   info_output("Features:                 0x%02x\n", dev->features);
 }
 
+/*
+  Read the settings of another e32 driven along with this one and leave
+  it in normal mode. It has to parse packets the same way as this one.
+*/
+static int
+e32_module_setup(struct E32 *dev, struct E32 *module, const char *name)
+{
+  if(e32_set_mode(module, SLEEP) || e32_cmd_read_version(module) || e32_cmd_read_settings(module))
+  {
+    err_output("e32_module_setup: unable to read the version and settings of the %s e32\n", name);
+    return 1;
+  }
+
+  if(dev->verbose)
+  {
+    e32_print_version(module);
+    e32_print_settings(module);
+  }
+
+  if(module->transmission_mode != dev->transmission_mode)
+  {
+    err_output("e32_module_setup: the %s e32 needs the same transmission mode as the first\n", name);
+    return 2;
+  }
+
+  if(e32_set_mode(module, NORMAL))
+  {
+    err_output("e32_module_setup: unable to put the %s e32 in normal mode\n", name);
+    return 3;
+  }
+
+  tty_set_read_polling(module->uart_fd, &module->tty);
+  tcflush(module->uart_fd, TCIFLUSH);
+  return 0;
+}
+
+/*
+  The rx e32 stands in for the receiver of the tx e32, it has to listen
+  on a different channel or it would hear the tx e32.
+*/
+int
+e32_pair_setup(struct E32 *dev)
+{
+  struct E32 *rx;
+
+  rx = dev->rx;
+  if(rx == NULL)
+    return 0;
+
+  if(e32_module_setup(dev, rx, "rx"))
+    return 1;
+
+  if(rx->channel == dev->channel)
+  {
+    err_output("e32_pair_setup: the rx e32 has to be on a different channel than the tx e32, both are on %d\n", dev->channel);
+    return 2;
+  }
+
+  info_output("receiving on channel %d and transmitting on channel %d\n", rx->channel, dev->channel);
+  return 0;
+}
+
+/*
+  Each bonded e32 is on its own channel. The reorder timeout is a few
+  packets on the slowest link, without an air time model a packet is
+  taken to be on air for a second as for the ARQ.
+*/
+int
+e32_bond_setup(struct E32 *dev)
+{
+  uint64_t packet_us, slowest_us;
+
+  if(dev->bond == NULL)
+    return 0;
+
+  slowest_us = 0;
+  for(int i = 0; i < dev->bond->links; i++)
+  {
+    if(i > 0 && e32_module_setup(dev, dev->link[i], "bonded"))
+      return 1;
+
+    for(int j = 0; j < i; j++)
+    {
+      if(dev->link[i]->channel == dev->link[j]->channel)
+      {
+        err_output("e32_bond_setup: bonded e32 modules %d and %d are both on channel %d\n", j, i, dev->link[i]->channel);
+        return 2;
+      }
+    }
+
+    packet_us = airtime_us(&dev->link[i]->airtime, E32_MAX_PACKET_LENGTH);
+    if(packet_us == 0)
+      packet_us = E32_ARQ_DEFAULT_PACKET_US;
+    if(packet_us > slowest_us)
+      slowest_us = packet_us;
+
+    info_output("bonded e32 %d on channel %d\n", i, dev->link[i]->channel);
+  }
+
+  dev->bond->timeout_us = E32_BOND_REORDER_PACKETS * slowest_us;
+  return 0;
+}
+
 int
 e32_cmd_reset(struct E32 *dev)
 {
@@ -617,8 +1194,9 @@ e32_cmd_reset(struct E32 *dev)
   if(bytes != 3)
     return 1;
 
-  usleep(54000);
-  return 0;
+  dev->version_cached = 0;
+  dev->settings_cached = 0;
+  return e32_wait_ready(dev, "reset", E32_AUX_LOW_MS, E32_RESET_TIMEOUT_MS) != 0;
 }
 
 int
@@ -647,12 +1225,14 @@ e32_cmd_write_settings(struct E32 *dev, uint8_t *settings)
     info_output("%x", settings[i]);
   info_output("\n");
 
+  dev->settings_cached = 0;
   bytes = write(dev->uart_fd, settings, 6);
   if(bytes == -1)
    return -1;
 
-  /* allow time for settings to change */
-  usleep(500000);
+  /* the e32 saves the settings while AUX is low */
+  if(e32_wait_ready(dev, "writing settings", E32_AUX_LOW_MS, E32_WRITE_TIMEOUT_MS))
+    return 1;
 
   if(e32_cmd_read_settings(dev))
   {
@@ -668,6 +1248,112 @@ e32_cmd_write_settings(struct E32 *dev, uint8_t *settings)
   return err;
 }
 
+/*
+  Find how much data can be kept in the TX buffer of the e32. The settings
+  must have been read for the air data rate. We write a packet, wait for
+  AUX to go low then top the buffer up to the size being tested and time
+  how long until AUX goes high again. The time per byte for a single
+  packet is the pacing, larger sizes are safe as long as they take as
+  long per byte.
+*/
+int
+e32_burst_characterize(struct E32 *dev)
+{
+  uint8_t buf[E32_MODULE_TX_BUFFER];
+  uint64_t start, us_per_byte;
+  size_t size, rest;
+  int timeout_ms;
+
+  /* an unknown frame type so framed receivers drop it */
+  memset(buf, 0xFF, sizeof(buf));
+
+  dev->burst_chunk = E32_MAX_PACKET_LENGTH;
+  dev->burst_us_per_byte = 0;
+
+  for(size = E32_MAX_PACKET_LENGTH; size <= E32_MODULE_TX_BUFFER; size *= 2)
+  {
+    timeout_ms = E32_AUX_TIMEOUT_MS;
+    if(dev->air_data_rate)
+      timeout_ms += 4 * 8000 * size / dev->air_data_rate;
+
+    if(e32_wait_aux(dev, 1, timeout_ms))
+    {
+      err_output("e32_burst_characterize: AUX didn't go high\n");
+      return 1;
+    }
+
+    start = e32_now_us();
+    if(write(dev->uart_fd, buf, E32_MAX_PACKET_LENGTH) != E32_MAX_PACKET_LENGTH)
+    {
+      errno_output("e32_burst_characterize: writing to uart\n");
+      return 2;
+    }
+
+    if(e32_wait_aux(dev, 0, E32_AUX_TIMEOUT_MS))
+    {
+      err_output("e32_burst_characterize: AUX didn't go low\n");
+      return 3;
+    }
+
+    rest = size - E32_MAX_PACKET_LENGTH;
+    if(rest && write(dev->uart_fd, buf, rest) != rest)
+    {
+      errno_output("e32_burst_characterize: writing to uart\n");
+      return 2;
+    }
+
+    if(e32_wait_aux(dev, 1, timeout_ms))
+    {
+      err_output("e32_burst_characterize: AUX didn't go high after %d bytes\n", (int) size);
+      return 4;
+    }
+
+    us_per_byte = (e32_now_us() - start) / size;
+
+    if(dev->verbose)
+      debug_output("e32_burst_characterize: %d bytes took %llu us per byte\n", (int) size, (unsigned long long) us_per_byte);
+
+    if(dev->burst_us_per_byte == 0)
+    {
+      dev->burst_us_per_byte = us_per_byte;
+      continue;
+    }
+
+    /* the e32 finished early so some of the bytes were dropped */
+    if(us_per_byte * 100 < dev->burst_us_per_byte * E32_BURST_MIN_PERCENT)
+      break;
+
+    dev->burst_chunk = size;
+  }
+
+  return 0;
+}
+
+/* use a given chunk size with pacing from the air time of a packet */
+int
+e32_burst_pacing(struct E32 *dev, size_t chunk)
+{
+  if(airtime_us(&dev->airtime, E32_MAX_PACKET_LENGTH) == 0)
+    return 1;
+
+  if(chunk < E32_MAX_PACKET_LENGTH)
+    chunk = E32_MAX_PACKET_LENGTH;
+  if(chunk > E32_MODULE_TX_BUFFER)
+    chunk = E32_MODULE_TX_BUFFER;
+
+  dev->burst_chunk = chunk;
+  dev->burst_us_per_byte = airtime_us(&dev->airtime, E32_MAX_PACKET_LENGTH) / E32_MAX_PACKET_LENGTH;
+  return 0;
+}
+
+void
+e32_print_burst(struct E32 *dev)
+{
+  info_output("Burst Model:              0x%02x Version %d Features 0x%02x\n", dev->version[1], dev->ver, dev->features);
+  info_output("Burst Chunk:              %d bytes\n", (int) dev->burst_chunk);
+  info_output("Burst Pacing:             %llu us/byte\n", (unsigned long long) dev->burst_us_per_byte);
+}
+
 ssize_t
 e32_transmit(struct E32 *dev, uint8_t *buf, size_t buf_len)
 {
@@ -701,16 +1387,122 @@ e32_receive(struct E32 *dev, uint8_t *buf, size_t buf_len)
   return bytes != buf_len;
 }
 
+/*
+  Send a record to a session, its type then up to two pieces. A session
+  which can't keep up misses records, one which has gone is closed when
+  the loop sees it hang up.
+*/
 static int
-e32_write_output(struct E32 *dev, struct options *opts, uint8_t* buf, const size_t bytes)
+e32_session_send(struct E32 *dev, struct E32Session *session, uint8_t type,
+    const void *first, size_t first_len, const void *second, size_t second_len)
 {
-  socklen_t addrlen; // unix domain socket client address
+  struct msghdr msg;
+  struct iovec iov[3];
+
+  if(session->closed)
+    return 1;
+
+  memset(&msg, 0, sizeof(struct msghdr));
+  iov[0].iov_base = &type;
+  iov[0].iov_len = 1;
+  iov[1].iov_base = (void*) first;
+  iov[1].iov_len = first_len;
+  iov[2].iov_base = (void*) second;
+  iov[2].iov_len = second_len;
+  msg.msg_iov = iov;
+  msg.msg_iovlen = second != NULL ? 3 : 2;
+
+  if(sendmsg(session->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) == -1)
+  {
+    if(errno == EAGAIN || errno == EWOULDBLOCK)
+    {
+      if(dev->verbose)
+        debug_output("e32_session_send: %s isn't keeping up, dropping a record\n", session->name);
+      return 1;
+    }
+
+    errno_output("e32_session_send: unable to send to %s\n", session->name);
+    session->closed = 1;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* send what was received to every session, with the sender address first in fixed mode */
+static int
+e32_write_sessions(struct E32 *dev, uint8_t *buf, size_t bytes, const uint8_t *from)
+{
+  int failed = 0;
+
+  for(size_t i = 0; i < dev->nsessions; i++)
+  {
+    if(from != NULL)
+      failed += e32_session_send(dev, &dev->sessions[i], E32_SESSION_DATA, from, E32_FIXED_SOURCE_LENGTH, buf, bytes);
+    else
+      failed += e32_session_send(dev, &dev->sessions[i], E32_SESSION_DATA, buf, bytes, NULL, 0);
+  }
+
+  return failed;
+}
+
+/* a compressed IP packet received goes to the TUN interface and nowhere else */
+static int
+e32_write_tun(struct E32 *dev, struct options *opts, const uint8_t *buf, size_t bytes)
+{
+  ssize_t len;
+
+  len = iphc_decompress(&dev->iphc, buf, bytes, iphcbuf, sizeof(iphcbuf));
+  if(len == -1)
+  {
+    err_output("e32_write_tun: dropping %d bytes which aren't a compressed IP packet\n", bytes);
+    return 1;
+  }
+
+  if(dev->verbose)
+    debug_output("e32_write_tun: %d bytes were a %d byte IP packet\n", bytes, len);
+
+  if(write(opts->fd_tun, iphcbuf, len) != len)
+  {
+    errno_output("e32_write_tun: unable to write to %s\n", opts->tun_name);
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+  Write data to every output. When the address of the sender is known
+  it's in front of the data sent to socket clients.
+*/
+static int
+e32_write_output(struct E32 *dev, struct options *opts, uint8_t* buf, const size_t bytes, const uint8_t *from)
+{
+  struct RegistryMessage message;
   size_t outbytes;
-  int ret = 0;
+  struct msghdr msg;
+  struct iovec iov[2];
+  int ret = 0, failed;
 
   if(bytes == 0)
     return 0;
 
+  if(opts->fd_tun != -1 && iphc_dispatch(buf, bytes))
+    return e32_write_tun(dev, opts, buf, bytes);
+
+  memset(&msg, 0, sizeof(struct msghdr));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 0;
+  if(from != NULL)
+  {
+    iov[msg.msg_iovlen].iov_base = (void*) from;
+    iov[msg.msg_iovlen].iov_len = E32_FIXED_SOURCE_LENGTH;
+    msg.msg_iovlen++;
+  }
+  iov[msg.msg_iovlen].iov_base = buf;
+  iov[msg.msg_iovlen].iov_len = bytes;
+  msg.msg_iovlen++;
+
   if(opts->output_file != NULL)
   {
     outbytes = fwrite(buf, 1, bytes, opts->output_file);
@@ -721,488 +1513,3140 @@ e32_write_output(struct E32 *dev, struct options *opts, uint8_t* buf, const size
     }
   }
 
-  for(int i=0; i<list_size(dev->socket_list); i++)
+  if(registry_size(dev->clients) > 0)
   {
-    struct sockaddr_un *cl;
-    cl = list_get_index(dev->socket_list, i);
-    addrlen = sizeof(struct sockaddr_un);
-
     if(dev->verbose)
-      debug_output("e32_write_output: sending %d bytes to socket %s", bytes, cl->sun_path);
+      debug_output("e32_write_output: sending %d bytes to %d sockets\n", bytes, registry_size(dev->clients));
+    registry_message(&message, buf, bytes, from != NULL ? (from[0] << 8) | from[1] : REGISTRY_NO_SOURCE);
+    failed = registry_send(dev->clients, &dev->socket_batch->send, opts->fd_socket_unix_data, &msg, &message);
+    if(failed)
+      err_output("e32_write_output: unable to send to %d unix sockets, removed them from the list\n", failed);
+    ret += failed;
+  }
 
-    outbytes = sendto(opts->fd_socket_unix_data, buf, bytes, 0, (struct sockaddr*) cl, addrlen);
-    if(outbytes == -1)
+  if(dev->nsessions > 0)
+    ret += e32_write_sessions(dev, buf, bytes, from);
+
+  if(opts->udp_dests)
+  {
+    if(udp_send(dev->udp_batch, opts->fd_socket_udp, opts->socket_udp_dest, opts->udp_dests, iov, msg.msg_iovlen))
     {
-      errno_output("e32_write_output: unable to send back status to unix socket. removing from list.");
-      list_remove(dev->socket_list, cl);
+      errno_output("e32_write_output: unable to send to a udp destination\n");
       ret++;
     }
   }
 
   if(opts->output_standard)
   {
-    buf[bytes] = '\0';
-    info_output("%s", buf);
+    info_output("%.*s", (int) bytes, buf);
     fflush(stdout);
   }
 
   return ret;
 }
 
-static void
-e32_poll_input_enable(struct options *opts, struct pollfd pfd[])
+/* output a complete message decompressing it if needed */
+static int
+e32_write_message(struct E32 *dev, struct options *opts, uint8_t *buf, size_t len, int compressed, const uint8_t *from)
 {
-  if(opts->verbose)
-    debug_output("e32_poll_input_enable\n");
+  ssize_t bytes;
 
-  if(opts->input_standard)
-  {
-    pfd[PFD_STDIN].fd = fileno(stdin);
-    pfd[PFD_STDIN].events = POLLIN;
-  }
+  if(!compressed)
+    return e32_write_output(dev, opts, buf, len, from);
 
-  if(opts->input_file)
+  if(dev->codec == NULL)
   {
-    pfd[PFD_INPUT_FILE].fd = fileno(opts->input_file);
-    pfd[PFD_INPUT_FILE].events = POLLIN;
+    err_output("e32_write_message: dropping compressed message, compression isn't enabled\n");
+    return 1;
   }
 
-  if(opts->fd_socket_unix_data)
+  bytes = dev->codec->decompress(&dev->dictionary, buf, len, zbuf, E32_MAX_MESSAGE_LENGTH);
+  if(bytes == -1)
   {
-    pfd[PFD_SOCKET_UNIX_DATA].fd = opts->fd_socket_unix_data;
-    pfd[PFD_SOCKET_UNIX_DATA].events = POLLIN;
+    err_output("e32_write_message: unable to decompress %d bytes\n", len);
+    return 1;
   }
 
-  if(opts->fd_socket_unix_control)
-  {
-    pfd[PFD_SOCKET_UNIX_CONTROL].fd = opts->fd_socket_unix_control;
-    pfd[PFD_SOCKET_UNIX_CONTROL].events = POLLIN;
-  }
+  if(dev->verbose)
+    debug_output("e32_write_message: decompressed %d bytes to %d bytes\n", len, bytes);
+
+  return e32_write_output(dev, opts, zbuf, bytes, from);
 }
 
-static void
-e32_poll_input_disable(struct options *opts, struct pollfd pfd[])
+/* output each message packed into a records frame */
+static int
+e32_write_records(struct E32 *dev, struct options *opts, uint8_t *records, size_t len, const uint8_t *from)
 {
-  if(opts->verbose)
-    debug_output("e32_poll_input_disable\n");
+  uint8_t *message;
+  size_t message_len;
+  int compressed, ret, count;
 
-  if(opts->input_standard)
+  ret = 0;
+  count = 0;
+  while((ret = frame_record_next(&records, &len, &message, &message_len, &compressed)) == 1)
   {
-    pfd[PFD_STDIN].fd = -1;
-    pfd[PFD_STDIN].events = 0;
+    e32_write_message(dev, opts, message, message_len, compressed, from);
+    count++;
   }
 
-  if(opts->input_file)
-  {
-    pfd[PFD_INPUT_FILE].fd = -1;
-    pfd[PFD_INPUT_FILE].events = 0;
-  }
+  if(ret == -1)
+    err_output("e32_write_records: dropping %d bytes of a truncated record\n", len);
+  else if(dev->verbose)
+    debug_output("e32_write_records: %d messages\n", count);
 
-  if(opts->fd_socket_unix_data)
-  {
-    pfd[PFD_SOCKET_UNIX_DATA].fd = -1;
-    pfd[PFD_SOCKET_UNIX_DATA].events = 0;
+  return ret == -1;
+}
+
+/*
+  A symbol of a file broadcast with --fountain. A symbol of another
+  transfer starts over, once the file is rebuilt it's written out and
+  the rest of the symbols for it are ignored.
+*/
+static int
+e32_write_fountain(struct E32 *dev, struct options *opts, struct FrameHeader *hdr, uint8_t *symbol, size_t symbol_len, uint8_t *from)
+{
+  struct E32FountainRx *rx;
+  uint16_t source;
+
+  source = from != NULL ? (from[0] << 8) | from[1] : 0;
+  if(dev->fountain_rx == NULL && (dev->fountain_rx = calloc(1, sizeof(struct E32FountainRx))) == NULL)
+    return 1;
+
+  rx = dev->fountain_rx;
+  if(rx->source != source || rx->id != hdr->id || rx->len != hdr->length)
+  {
+    fountain_decoder_destroy(&rx->dec);
+    rx->source = source;
+    rx->id = hdr->id;
+    rx->len = hdr->length;
+    rx->symbols = 0;
+    if(fountain_decoder_init(&rx->dec, hdr->length, symbol_len))
+    {
+      err_output("e32_write_fountain: unable to receive a %d byte file in %d byte symbols\n", hdr->length, symbol_len);
+      return 1;
+    }
+
+    if(dev->verbose)
+      debug_output("e32_write_fountain: receiving %d bytes in %d symbols for transfer %d\n",
+          rx->len, rx->dec.symbols, rx->id);
   }
 
-  if(opts->fd_socket_unix_control)
+  if(rx->dec.symbols == 0 || rx->dec.complete)
+    return 0;
+
+  if(symbol_len != rx->dec.symbol_len)
   {
-    pfd[PFD_SOCKET_UNIX_CONTROL].fd = -1;
-    pfd[PFD_SOCKET_UNIX_CONTROL].events = 0;
+    err_output("e32_write_fountain: dropping a %d byte symbol of transfer %d\n", symbol_len, rx->id);
+    return 1;
   }
+
+  rx->symbols++;
+  if(!fountain_decode(&rx->dec, hdr->index, symbol))
+    return 0;
+
+  if(dev->verbose)
+    debug_output("e32_write_fountain: rebuilt %d bytes from %d symbols\n", rx->len, rx->symbols);
+
+  return e32_write_output(dev, opts, (uint8_t*) fountain_data(&rx->dec), rx->len, from);
 }
 
-static void
-e32_poll_init(struct E32 *dev, struct options *opts, struct pollfd pfd[])
+/* write a frame to the outputs, reassembling fragments into messages */
+static int
+e32_write_frame(struct E32 *dev, struct options *opts, uint8_t *buf, size_t bytes, uint8_t *from)
 {
-  tty_set_read_polling(dev->uart_fd, &dev->tty);
+  struct FrameHeader hdr;
+  uint8_t *payload, *message;
+  size_t payload_len, message_len;
+  int ret;
 
-  dev->isatty = isatty(fileno(stdin));
-  if(dev->isatty)
+  if(frame_decode(buf, bytes, &hdr, &payload, &payload_len))
   {
-    dev->isatty = 1;
-    info_output("waiting for input from the terminal\n");
+    err_output("e32_write_frame: dropping %d bytes with unknown header 0x%02x\n", bytes, buf[0]);
+    return 1;
   }
-  else {
-    opts->input_standard = 0;
+
+  if(hdr.type == FRAME_TYPE_DATA)
+    return e32_write_message(dev, opts, payload, payload_len, hdr.compressed, from);
+  else if(hdr.type == FRAME_TYPE_RECORDS)
+    return e32_write_records(dev, opts, payload, payload_len, from);
+  else if(hdr.type == FRAME_TYPE_FOUNTAIN)
+    return e32_write_fountain(dev, opts, &hdr, payload, payload_len, from);
+
+  hdr.source = from != NULL ? (from[0] << 8) | from[1] : 0;
+  ret = frame_reassemble(dev->reassembly, &hdr, payload, payload_len, e32_now_ms(), &message, &message_len);
+  if(ret == -1)
+  {
+    err_output("e32_write_frame: dropped fragment %d of message %d\n", hdr.index, hdr.id);
+    return 1;
+  }
+  else if(ret == 0)
+  {
+    if(dev->verbose)
+      debug_output("e32_write_frame: fragment %d of message %d\n", hdr.index, hdr.id);
+    return 0;
   }
-    // used for stdin or a pipe
-  pfd[PFD_STDIN].fd = -1;
-  pfd[PFD_STDIN].events = 0;
 
-  // used for the uart
-  pfd[PFD_UART].fd = dev->uart_fd;
-  pfd[PFD_UART].events = POLLIN;
+  if(dev->verbose)
+    debug_output("e32_write_frame: reassembled %d bytes for message %d\n", message_len, hdr.id);
 
-  // used for an input file
-  pfd[PFD_INPUT_FILE].fd = -1;
-  pfd[PFD_INPUT_FILE].events = 0;
+  ret = e32_write_message(dev, opts, message, message_len, hdr.compressed, from);
+  free(message);
+  return ret;
+}
 
-  // used for a unix domain socket data
-  pfd[PFD_SOCKET_UNIX_DATA].fd = -1;
-  pfd[PFD_SOCKET_UNIX_DATA].events = 0;
+/*
+  With --reliable every frame comes through the ARQ, which hands back
+  what it has in order once the frames before it have arrived.
+*/
+static int
+e32_write_reliable(struct E32 *dev, struct options *opts, uint8_t *buf, size_t bytes, uint8_t *from)
+{
+  uint8_t frame[ARQ_MAX_FRAME];
+  ssize_t len;
+  int err;
 
-  // poll the AUX pin for rising and falling edges
-  pfd[PFD_GPIO_AUX].fd = dev->fd_gpio_aux;
-  pfd[PFD_GPIO_AUX].events = POLLPRI;
+  if(arq_read(dev->arq, buf, bytes, e32_now_us()) == -1)
+  {
+    err_output("e32_write_reliable: dropping %d bytes with header 0x%02x\n", bytes, buf[0]);
+    return 1;
+  }
 
-  // used for a unix domain socket control
-  pfd[PFD_SOCKET_UNIX_CONTROL].fd = -1;
-  pfd[PFD_SOCKET_UNIX_CONTROL].events = 0;
+  /* acks go back to the e32 heard from last */
+  if(from != NULL)
+    memcpy(dev->arq_peer, from, E32_FIXED_SOURCE_LENGTH);
 
-  e32_poll_input_enable(opts, pfd);
+  err = 0;
+  while((len = arq_deliver(dev->arq, frame, sizeof(frame))) > 0)
+    err |= e32_write_frame(dev, opts, frame, len, from);
 
+  return err;
 }
 
+/*
+  Output what was received over the air. In fixed mode the address of
+  the sender is taken off the front. With framing the header is removed
+  and fragments are held until their message is complete.
+*/
 static int
-e32_poll_stdin(struct E32 *dev, int fd_stdin, int *loop_continue)
+e32_write_packet(struct E32 *dev, struct options *opts, uint8_t *buf, size_t bytes)
 {
-  ssize_t bytes;
+  uint8_t *from;
 
-  bytes = read(fd_stdin, &txbuf, E32_MAX_PACKET_LENGTH);
-  if(bytes == -1)
+  from = NULL;
+  if(dev->transmission_mode && bytes > 0)
   {
-    errno_output("error reading from stdin\n");
+    if(bytes < E32_FIXED_SOURCE_LENGTH)
+    {
+      err_output("e32_write_packet: dropping %d bytes without a sender address\n", bytes);
+      return 1;
+    }
+    from = buf;
+    buf += E32_FIXED_SOURCE_LENGTH;
+    bytes -= E32_FIXED_SOURCE_LENGTH;
+
+    if(dev->verbose)
+      debug_output("e32_write_packet: %d bytes from 0x%02x%02x\n", bytes, from[0], from[1]);
+  }
+
+  if(!opts->frame || bytes == 0)
+    return e32_write_output(dev, opts, buf, bytes, from);
+
+  if(dev->arq != NULL)
+    return e32_write_reliable(dev, opts, buf, bytes, from);
+
+  return e32_write_frame(dev, opts, buf, bytes, from);
+}
+
+/* write out the packets of a bonded stream which are next in order */
+static int
+e32_bond_deliver(struct E32 *dev, struct options *opts)
+{
+  uint8_t packet[BOND_FRAME_BYTES];
+  ssize_t len;
+  size_t skipped;
+  int ret;
+
+  ret = 0;
+  skipped = dev->bond->skipped;
+  while((len = bond_pop(dev->bond, packet, e32_now_us())) != -1)
+    ret |= e32_write_packet(dev, opts, packet, len);
+
+  if(dev->bond->skipped != skipped)
+    err_output("e32_bond_deliver: lost %d packets of the bonded stream\n", dev->bond->skipped - skipped);
+
+  return ret;
+}
+
+/*
+  A packet received on a bonded link waits until it's next in the
+  stream. In fixed mode the sender address is moved after the bond
+  header so it stays with the packet.
+*/
+static int
+e32_write_bonded(struct E32 *dev, struct options *opts, int link, uint8_t *buf, size_t bytes)
+{
+  uint8_t packet[BOND_HEADER_LENGTH+BOND_FRAME_BYTES];
+  size_t source_len;
+  int ret;
+
+  source_len = dev->transmission_mode ? E32_FIXED_SOURCE_LENGTH : 0;
+  if(bytes < source_len + BOND_HEADER_LENGTH || bytes > source_len + BOND_FRAME_BYTES)
+  {
+    err_output("e32_write_bonded: dropping %d bytes received on link %d\n", bytes, link);
     return 1;
   }
 
-  if(dev->verbose)
-    debug_output("e32_poll_stdin: got %d bytes as input writing to uart\n", bytes);
+  memcpy(packet, buf + source_len, BOND_HEADER_LENGTH);
+  memcpy(packet + BOND_HEADER_LENGTH, buf, source_len);
+  memcpy(packet + BOND_HEADER_LENGTH + source_len, buf + source_len + BOND_HEADER_LENGTH,
+      bytes - source_len - BOND_HEADER_LENGTH);
 
-  if(e32_transmit(dev, txbuf, bytes))
-    return 3;
+  ret = bond_receive(dev->bond, link, packet, bytes, e32_now_us());
+  if(ret == -1)
+    return 1;
+  if(ret == 1 && dev->verbose)
+    debug_output("e32_write_bonded: dropping a duplicate or late packet on link %d\n", link);
+  if(ret == 2 && dev->verbose)
+    debug_output("e32_write_bonded: link %d reported %d received and %d lost\n", link,
+        (int) dev->bond->link[link].far_received, (int) dev->bond->link[link].far_lost);
 
-  /* sent input through a pipe */
-  if(!dev->isatty && bytes < E32_MAX_PACKET_LENGTH)
+  return e32_bond_deliver(dev, opts);
+}
+
+static int
+e32_write_received(struct E32 *dev, struct options *opts, uint8_t *buf, size_t bytes)
+{
+  if(dev->bond != NULL)
+    return e32_write_bonded(dev, opts, 0, buf, bytes);
+
+  return e32_write_packet(dev, opts, buf, bytes);
+}
+
+/* the most data read from stdin or a file to fill a single packet */
+static size_t
+e32_packet_payload(struct E32 *dev, struct options *opts)
+{
+  if(opts->frame)
+    return e32_packet_length(dev) - FRAME_DATA_HEADER_LENGTH;
+  return e32_packet_length(dev);
+}
+
+/* the longest datagram from a socket, with its class and destination */
+static size_t
+e32_socket_max_len(struct E32 *dev, struct options *opts)
+{
+  size_t max_len;
+
+  max_len = opts->frame ? E32_MAX_MESSAGE_LENGTH : e32_packet_length(dev);
+  if(opts->priority_prefix)
+    max_len++;
+  if(dev->transmission_mode)
+    max_len += E32_FIXED_DEST_LENGTH;
+
+  return max_len;
+}
+
+/* frames needed in the queue to hold the largest IP packet from the TUN interface */
+static size_t
+e32_tun_frames(struct E32 *dev)
+{
+  return frame_count(OPTIONS_TUN_MTU + 1, e32_packet_length(dev));
+}
+
+/* frames needed in the queue to hold the largest message from a socket */
+static size_t
+e32_socket_frames(struct E32 *dev, struct options *opts)
+{
+  if(opts->frame)
+    return frame_count(E32_MAX_MESSAGE_LENGTH, e32_packet_length(dev));
+  return 1;
+}
+
+/*
+  In fixed mode write the destination and the address of this e32 to
+  the start of a packet. Without a destination the packet is broadcast
+  on the channel of this e32. Returns the length of the header.
+*/
+static size_t
+e32_packet_header(struct E32 *dev, const uint8_t *dest, uint8_t *packet)
+{
+  if(!dev->transmission_mode)
+    return 0;
+
+  if(dest != NULL)
   {
-    if(dev->verbose)
-      debug_output("getting out of loop\n");
-    *loop_continue = 0;
+    memcpy(packet, dest, E32_FIXED_DEST_LENGTH);
   }
+  else
+  {
+    packet[0] = E32_BROADCAST_ADDRESS >> 8;
+    packet[1] = E32_BROADCAST_ADDRESS & 0xFF;
+    packet[2] = dev->channel;
+  }
+  packet[3] = dev->addh;
+  packet[4] = dev->addl;
+
+  return E32_FIXED_HEADER_LENGTH;
+}
+
+/*
+  Push a frame onto the transmit queue with an estimate of when it will
+  be done. It's sent after what the e32 has and what's queued in its
+  class or a more urgent one, anything queued later in a more urgent
+  class delays it further.
+*/
+static int
+e32_queue_push(struct E32 *dev, int flow, uint8_t *buf, size_t len)
+{
+  struct QueueFrame *frame;
+  uint64_t now, start, ahead;
+
+  if(queue_push(dev->tx_queue, flow, buf, len, e32_frame_cost(dev, e32_air_length(dev, len))))
+    return -1;
+
+  now = e32_now_us();
+  start = now;
+  if(dev->tx_frames && dev->tx_done_us > start)
+    start = dev->tx_done_us;
+
+  ahead = queue_cost_ahead(dev->tx_queue, dev->tx_queue->flows[flow].class);
+  if(airtime_model_us(&dev->airtime, E32_MAX_PACKET_LENGTH) == 0)
+    ahead = 0;
+
+  frame = queue_tail(dev->tx_queue);
+  frame->queued_us = now;
+  frame->done_us = start + ahead * dev->airtime.scale / AIRTIME_SCALE_ONE;
 
   return 0;
 }
 
+/* queue a packet of records and close it */
+static int
+e32_coalesce_queue(struct E32 *dev, struct E32Coalesce *coalesce)
+{
+  int flow, err;
+
+  flow = queue_flow(dev->tx_queue, coalesce->source, coalesce->class, coalesce->channel, coalesce->client);
+  err = flow == -1 || e32_queue_push(dev, flow, coalesce->packet, coalesce->len);
+  if(err)
+    err_output("e32_coalesce_queue: transmit queue full, dropping %d messages\n", coalesce->records);
+  else if(dev->verbose)
+    debug_output("e32_coalesce_queue: %d messages in %d bytes\n", coalesce->records, coalesce->len);
+
+  coalesce->used = 0;
+  return err;
+}
+
+/* queue the packets of records which have waited until their deadline */
+static int
+e32_coalesce_flush(struct E32 *dev, uint64_t now_us)
+{
+  int err = 0;
+
+  for(int i=0; i<E32_COALESCE_PACKETS; i++)
+  {
+    if(dev->coalesce[i].used && dev->coalesce[i].deadline_us <= now_us)
+      err |= e32_coalesce_queue(dev, &dev->coalesce[i]);
+  }
+
+  return err;
+}
+
+/* the earliest deadline of the open packets, 0 if there are none */
+static uint64_t
+e32_coalesce_deadline(struct E32 *dev)
+{
+  uint64_t deadline = 0;
+
+  for(int i=0; i<E32_COALESCE_PACKETS; i++)
+  {
+    if(dev->coalesce[i].used && (deadline == 0 || dev->coalesce[i].deadline_us < deadline))
+      deadline = dev->coalesce[i].deadline_us;
+  }
+
+  return deadline;
+}
+
+/* the open packet of a client to a destination, NULL if there isn't one */
+static struct E32Coalesce*
+e32_coalesce_find(struct E32 *dev, enum QueueSource source, enum QueueClass class,
+    const char *client, const uint8_t *header, size_t header_len)
+{
+  struct E32Coalesce *coalesce;
+
+  for(int i=0; i<E32_COALESCE_PACKETS; i++)
+  {
+    coalesce = &dev->coalesce[i];
+    if(coalesce->used && coalesce->source == source && coalesce->class == class &&
+        coalesce->header_len == header_len && memcmp(coalesce->packet, header, header_len) == 0 &&
+        strncmp(coalesce->client, client, QUEUE_FLOW_NAME) == 0)
+      return coalesce;
+  }
+
+  return NULL;
+}
+
+/*
+  Pack a small message into the open packet of its client. When it
+  doesn't fit the open packet is queued and a new one started, when
+  there's no room for another record the packet is queued right away.
+  Only whether this message was queued is returned, a packet of earlier
+  messages which couldn't be queued is logged by e32_coalesce_queue.
+*/
 static int
-e32_poll_uart(struct E32 *dev, struct options *opts, int fd_uart, ssize_t *rx_buf_size)
+e32_coalesce(struct E32 *dev, enum QueueSource source, enum QueueClass class, const char *client,
+    const uint8_t *header, size_t header_len, const uint8_t *buf, size_t len, int compressed)
 {
+  struct E32Coalesce *coalesce;
+  struct FrameHeader hdr;
   ssize_t bytes;
+  int err;
 
-  bytes = read(fd_uart, rxbuf+(*rx_buf_size), RX_BUF_BYTES);
-  if(bytes == -1)
+  err = 0;
+  coalesce = e32_coalesce_find(dev, source, class, client, header, header_len);
+  if(coalesce != NULL)
   {
-    errno_output("e32_poll_uart error reading from uart, fd=%d, buf=%p, total=%p, mode=%d\n", fd_uart, rxbuf, rx_buf_size, dev->mode);
-    return 1;
+    bytes = frame_record_add(coalesce->packet, E32_MAX_PACKET_LENGTH, coalesce->len, buf, len, compressed);
+    if(bytes != -1)
+    {
+      coalesce->len = bytes;
+      coalesce->records++;
+      goto full;
+    }
+    e32_coalesce_queue(dev, coalesce);
   }
 
-  /* some Raspberry Pi Models will buffer > 1 byte at a time which is ideal
-   * the implication here is after the AUX pin transitions when reading bytes
-   * we will leave bytes in the buffer. If we detect this we'll set an additional
-   * delay where after the AUX pin transitions we will delay before reading the
-   * additional bytes.
-   */
-  if (bytes > 1)
+  /* open a packet, closing the oldest if they're all in use */
+  coalesce = &dev->coalesce[0];
+  for(int i=0; i<E32_COALESCE_PACKETS && coalesce->used; i++)
   {
-    opts->aux_transition_additional_delay = 1;
+    if(!dev->coalesce[i].used || dev->coalesce[i].deadline_us < coalesce->deadline_us)
+      coalesce = &dev->coalesce[i];
   }
+  if(coalesce->used)
+    e32_coalesce_queue(dev, coalesce);
+
+  memset(&hdr, 0, sizeof(struct FrameHeader));
+  hdr.type = FRAME_TYPE_RECORDS;
+  memcpy(coalesce->packet, header, header_len);
+  frame_encode(coalesce->packet+header_len, E32_MAX_PACKET_LENGTH-header_len, &hdr, buf, 0);
+
+  coalesce->used = 1;
+  coalesce->source = source;
+  coalesce->class = class;
+  coalesce->channel = header_len ? header[2] : dev->channel;
+  strncpy(coalesce->client, client, QUEUE_FLOW_NAME-1);
+  coalesce->client[QUEUE_FLOW_NAME-1] = '\0';
+  coalesce->header_len = header_len;
+  coalesce->len = header_len + FRAME_RECORDS_HEADER_LENGTH;
+  coalesce->records = 1;
+  coalesce->deadline_us = e32_now_us() + dev->coalesce_us;
+  coalesce->len = frame_record_add(coalesce->packet, E32_MAX_PACKET_LENGTH, coalesce->len, buf, len, compressed);
+
+full:
+  if(coalesce->len + FRAME_RECORD_HEADER_LENGTH + 1 > E32_MAX_PACKET_LENGTH)
+    err = e32_coalesce_queue(dev, coalesce);
+
+  return err ? -1 : 0;
+}
 
-  *rx_buf_size += bytes;
+/*
+  Push a message onto the transmit queue in the flow of the client
+  which sent it. Without framing a message must fit in a single packet.
+  With framing it gets a header and if it's too large for a single
+  packet it's split into fragments which are queued together. A more
+  urgent message can still be sent in between the fragments. In fixed
+  mode every packet is sent to dest, the address and channel, or
+  broadcast if it's NULL.
+*/
+static int
+e32_queue_message(struct E32 *dev, struct options *opts, enum QueueSource source,
+    enum QueueClass class, const char *client, const uint8_t *dest, uint8_t *buf, size_t len)
+{
+  uint8_t packet[E32_MAX_PACKET_LENGTH];
+  struct FrameHeader hdr;
+  size_t nframes, fragment_payload, offset, chunk, header_len;
+  ssize_t packet_len, bytes;
+  int flow, channel;
+  struct E32Coalesce *coalesce;
+
+  header_len = e32_packet_header(dev, dest, packet);
+  channel = header_len ? packet[2] : dev->channel;
+
+  flow = queue_flow(dev->tx_queue, source, class, channel, client);
+  if(flow == -1)
+    return -1;
+
+  if(!opts->frame)
+  {
+    if(len > e32_packet_length(dev))
+      return -1;
+    memcpy(packet+header_len, buf, len);
+    return e32_queue_push(dev, flow, packet, header_len+len);
+  }
+
+  memset(&hdr, 0, sizeof(struct FrameHeader));
+
+  /* only send it compressed when it's smaller */
+  if(dev->codec != NULL && len > 1)
+  {
+    bytes = dev->codec->compress(&dev->dictionary, buf, len, zbuf, len-1);
+    dev->compress_in += len;
+    if(bytes > 0)
+    {
+      buf = zbuf;
+      len = bytes;
+      hdr.compressed = 1;
+    }
+    dev->compress_out += len;
+
+    if(dev->verbose)
+      debug_output("e32_queue_message: compressed to %d bytes, %d%% of the original overall\n",
+          len, (int) (100 * dev->compress_out / dev->compress_in));
+  }
+
+  /*
+    Small messages are packed together, anything else from the client
+    goes after what it has waiting so messages stay in order.
+  */
+  if(dev->coalesce_us && len <= FRAME_RECORD_MAX_LENGTH &&
+      FRAME_RECORDS_HEADER_LENGTH + FRAME_RECORD_HEADER_LENGTH + len <= e32_packet_length(dev))
+    return e32_coalesce(dev, source, class, client, packet, header_len, buf, len, hdr.compressed);
+
+  if(dev->coalesce_us && (coalesce = e32_coalesce_find(dev, source, class, client, packet, header_len)) != NULL)
+    e32_coalesce_queue(dev, coalesce);
+
+  nframes = frame_count(len, e32_packet_length(dev));
+  if(nframes > FRAME_MAX_FRAGMENTS || nframes > queue_available(dev->tx_queue, source))
+    return -1;
+
+  if(nframes == 1)
+  {
+    hdr.type = FRAME_TYPE_DATA;
+    packet_len = frame_encode(packet+header_len, sizeof(packet)-header_len, &hdr, buf, len);
+    if(packet_len == -1)
+      return -1;
+    return e32_queue_push(dev, flow, packet, header_len+packet_len);
+  }
+
+  hdr.type = FRAME_TYPE_FRAGMENT;
+  hdr.id = dev->frame_id++;
+  fragment_payload = e32_packet_length(dev) - FRAME_FRAGMENT_HEADER_LENGTH;
+
+  for(offset = 0; offset < len; offset += chunk)
+  {
+    chunk = len - offset;
+    if(chunk > fragment_payload)
+      chunk = fragment_payload;
+
+    hdr.last = offset + chunk == len;
+    packet_len = frame_encode(packet+header_len, sizeof(packet)-header_len, &hdr, buf+offset, chunk);
+    if(packet_len == -1)
+      return -1;
+
+    if(e32_queue_push(dev, flow, packet, header_len+packet_len))
+      return -1;
+
+    hdr.index++;
+  }
 
   if(dev->verbose)
-    debug_output("e32_poll_uart: received %d bytes for a total of %ld bytes from uart\n", bytes, *rx_buf_size);
+    debug_output("e32_queue_message: split %d bytes into %d fragments for message %d in class %d done in %llu ms\n",
+        len, nframes, hdr.id, class, (unsigned long long) e32_until_ms(queue_tail(dev->tx_queue)->done_us));
+
+  return 0;
+}
+
+/*
+  Each data input is waited on only while it has room left in its quota
+  of the transmit queue. When a source fills its quota only that source
+  is throttled, the kernel holds onto its data until a frame is sent.
+  Requests on the control socket are queued until the radio is idle.
+*/
+static void
+e32_poll_input_enable(struct E32 *dev, struct options *opts, struct Loop *loop)
+{
+  struct Queue *queue;
+  queue = dev->tx_queue;
+
+  if(opts->input_standard)
+  {
+    loop_enable(loop, fileno(stdin),
+        queue_available(queue, QUEUE_SOURCE_STDIN) > 0);
+  }
+
+  if(opts->input_file)
+  {
+    loop_enable(loop, fileno(opts->input_file),
+        queue_available(queue, QUEUE_SOURCE_FILE) > 0);
+  }
+
+  if(opts->fd_socket_unix_data != -1)
+  {
+    loop_enable(loop, opts->fd_socket_unix_data,
+        queue_available(queue, QUEUE_SOURCE_SOCKET_UNIX_DATA) >= e32_socket_frames(dev, opts));
+  }
+
+  if(opts->udp_listen)
+  {
+    loop_enable(loop, opts->fd_socket_udp,
+        queue_available(queue, QUEUE_SOURCE_SOCKET_UDP) >= e32_socket_frames(dev, opts));
+  }
+
+  if(opts->fd_tun != -1)
+  {
+    loop_enable(loop, opts->fd_tun,
+        queue_available(queue, QUEUE_SOURCE_TUN) >= e32_tun_frames(dev));
+  }
+
+  if(opts->fd_socket_unix_control != -1)
+    loop_enable(loop, opts->fd_socket_unix_control, 1);
+}
+
+static void
+e32_poll_input_disable(struct options *opts, struct Loop *loop)
+{
+  if(opts->verbose)
+    debug_output("e32_poll_input_disable\n");
+
+  if(opts->input_standard)
+    loop_enable(loop, fileno(stdin), 0);
+
+  if(opts->input_file)
+    loop_enable(loop, fileno(opts->input_file), 0);
+
+  if(opts->fd_socket_unix_data != -1)
+    loop_enable(loop, opts->fd_socket_unix_data, 0);
+
+  if(opts->udp_listen)
+    loop_enable(loop, opts->fd_socket_udp, 0);
+
+  if(opts->fd_tun != -1)
+    loop_enable(loop, opts->fd_tun, 0);
+
+  if(opts->fd_socket_unix_control != -1)
+    loop_enable(loop, opts->fd_socket_unix_control, 0);
+}
+
+static void
+e32_poll_init(struct E32 *dev, struct options *opts)
+{
+  tty_set_read_polling(dev->uart_fd, &dev->tty);
+
+  if(dev->burst != NULL)
+    burst_init(dev->burst, E32_MAX_PACKET_LENGTH, dev->burst_chunk, dev->burst_us_per_byte);
+
+  /* the air time is known by now, the burst has to fit the longest packet */
+  if(opts->duty_cycle_ppm)
+  {
+    dev->duty = calloc(1, sizeof(struct Duty));
+    if(dev->duty != NULL)
+      duty_init(dev->duty, opts->duty_cycle_ppm, airtime_lora_us(&dev->airtime, E32_MAX_PACKET_LENGTH), e32_now_us());
+    else
+      err_output("e32_poll_init: unable to allocate the duty cycle budget\n");
+  }
+
+  dev->fd_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if(dev->fd_timer == -1)
+  {
+    errno_output("e32_poll_init: unable to create timer, not coalescing\n");
+    dev->coalesce_us = 0;
+  }
+
+  dev->isatty = isatty(fileno(stdin));
+  if(dev->isatty)
+  {
+    dev->isatty = 1;
+    info_output("waiting for input from the terminal\n");
+  }
+  else {
+    opts->input_standard = 0;
+  }
+}
+
+static int
+e32_poll_stdin(struct E32 *dev, struct options *opts, int fd_stdin, int *loop_continue)
+{
+  ssize_t bytes;
+  size_t payload;
+
+  payload = e32_packet_payload(dev, opts);
+  bytes = read(fd_stdin, &txbuf, payload);
+  if(bytes == -1)
+  {
+    errno_output("error reading from stdin\n");
+    return 1;
+  }
+
+  if(dev->verbose)
+    debug_output("e32_poll_stdin: got %d bytes as input queueing for transmit\n", bytes);
+
+  if(bytes > 0 && e32_queue_message(dev, opts, QUEUE_SOURCE_STDIN, E32_CLASS_STDIN, "stdin", NULL, txbuf, bytes))
+  {
+    err_output("e32_poll_stdin: transmit queue full\n");
+    return 3;
+  }
+
+  /* sent input through a pipe */
+  if(!dev->isatty && bytes < payload)
+  {
+    if(dev->verbose)
+      debug_output("getting out of loop\n");
+    *loop_continue = 0;
+  }
+
+  return 0;
+}
+
+/* how long the UART of an e32 has to be quiet for a packet to have ended */
+static uint64_t
+e32_rx_gap_us(struct E32 *dev)
+{
+  uint64_t gap;
+
+  gap = E32_RX_GAP_CHARS * 10 * 1000000ULL / (dev->uart_baud > 0 ? dev->uart_baud : 9600);
+  return gap > E32_RX_GAP_MIN_US ? gap : E32_RX_GAP_MIN_US;
+}
+
+/* read whatever the UART of an e32 has waiting, FIONREAD says how much */
+static int
+e32_rx_drain(struct E32 *dev, uint8_t *buf, ssize_t *rx_buf_size)
+{
+  ssize_t bytes;
+  int waiting;
+
+  if(ioctl(dev->uart_fd, FIONREAD, &waiting) == -1)
+    waiting = RX_BUF_BYTES;
+  if(waiting <= 0)
+    return 0;
+  if(waiting > RX_BUF_BYTES - *rx_buf_size)
+    waiting = RX_BUF_BYTES - *rx_buf_size;
+
+  bytes = read(dev->uart_fd, buf+(*rx_buf_size), waiting);
+  if(bytes == -1)
+  {
+    if(errno == EAGAIN)
+      return 0;
+    errno_output("e32_rx_drain: error reading from uart\n");
+    return -1;
+  }
+
+  *rx_buf_size += bytes;
+  if(dev->rx_gap_us)
+    dev->rx_gap_us = e32_now_us() + e32_rx_gap_us(dev);
+
+  return bytes;
+}
+
+/*
+  AUX went high at the end of a packet. When the UART may still be
+  delivering it wait for a gap before the packet is taken to have ended,
+  otherwise it has. Returns 1 while waiting for the gap.
+*/
+static int
+e32_rx_gap_start(struct E32 *dev, struct E32 *module, struct options *opts)
+{
+  if(!opts->aux_transition_additional_delay || dev->fd_timer == -1)
+    return 0;
+
+  module->rx_aux_us = e32_now_us();
+  module->rx_gap_us = module->rx_aux_us + e32_rx_gap_us(module);
+  return 1;
+}
+
+static int
+e32_poll_uart(struct E32 *dev, struct options *opts, int fd_uart, uint8_t *buf, ssize_t *rx_buf_size)
+{
+  ssize_t bytes;
+
+  bytes = read(fd_uart, buf+(*rx_buf_size), RX_BUF_BYTES);
+  if(bytes == -1)
+  {
+    errno_output("e32_poll_uart error reading from uart, fd=%d, buf=%p, total=%p, mode=%d\n", fd_uart, buf, rx_buf_size, dev->mode);
+    return 1;
+  }
+
+  /* some Raspberry Pi Models will buffer > 1 byte at a time which is ideal
+   * the implication here is after the AUX pin transitions when reading bytes
+   * we will leave bytes in the buffer. If we detect this we'll set an additional
+   * delay where after the AUX pin transitions we will delay before reading the
+   * additional bytes.
+   */
+  if (bytes > 1)
+  {
+    opts->aux_transition_additional_delay = 1;
+  }
+
+  *rx_buf_size += bytes;
+
+  /* still coming after AUX, the packet hasn't ended yet */
+  if(dev->rx_gap_us && bytes > 0)
+    dev->rx_gap_us = e32_now_us() + e32_rx_gap_us(dev);
+
+  if(dev->verbose)
+    debug_output("e32_poll_uart: received %d bytes for a total of %ld bytes from uart\n", bytes, *rx_buf_size);
+
+  return 0;
+}
+
+/*
+  Read the whole input file for --fountain. The transfer id changes each
+  run so receivers don't mix symbols of an older file into this one.
+*/
+static int
+e32_fountain_load(struct E32 *dev, struct options *opts)
+{
+  struct E32FountainTx *tx;
+  size_t symbol_len, max_len, len, bytes, repair;
+
+  symbol_len = e32_packet_length(dev) - FRAME_FOUNTAIN_HEADER_LENGTH;
+  max_len = FOUNTAIN_MAX_SYMBOLS * symbol_len;
+
+  tx = calloc(1, sizeof(struct E32FountainTx));
+  if(tx == NULL || (tx->file = malloc(max_len+1)) == NULL)
+  {
+    free(tx);
+    return 1;
+  }
+  dev->fountain_tx = tx;
+
+  len = 0;
+  while(len <= max_len && (bytes = fread(tx->file+len, 1, max_len+1-len, opts->input_file)) > 0)
+    len += bytes;
+
+  if(len > max_len || fountain_encoder_init(&tx->enc, tx->file, len, symbol_len))
+  {
+    err_output("e32_fountain_load: the file has to be 1 to %d bytes\n", max_len);
+    return 1;
+  }
+
+  repair = (tx->enc.symbols * opts->fountain + 99) / 100;
+  tx->total = tx->enc.symbols + repair;
+  if(tx->total > FOUNTAIN_MAX_ID + 1)
+    tx->total = FOUNTAIN_MAX_ID + 1;
+  tx->id = getpid() ^ time(NULL);
+
+  if(opts->verbose)
+    debug_output("e32_fountain_load: sending %d bytes as %d symbols of %d bytes, %d of them repair\n",
+        len, tx->total, symbol_len, tx->total - tx->enc.symbols);
+
+  return 0;
+}
+
+/* queue the next symbol of the file */
+static int
+e32_queue_fountain(struct E32 *dev)
+{
+  uint8_t packet[E32_MAX_PACKET_LENGTH], symbol[E32_MAX_PACKET_LENGTH];
+  struct E32FountainTx *tx;
+  struct FrameHeader hdr;
+  size_t header_len;
+  ssize_t packet_len;
+  int flow;
+
+  tx = dev->fountain_tx;
+  header_len = e32_packet_header(dev, NULL, packet);
+  flow = queue_flow(dev->tx_queue, QUEUE_SOURCE_FILE, E32_CLASS_FILE, dev->channel, "file");
+  if(flow == -1)
+    return -1;
+
+  memset(&hdr, 0, sizeof(struct FrameHeader));
+  hdr.type = FRAME_TYPE_FOUNTAIN;
+  hdr.id = tx->id;
+  hdr.length = tx->enc.len;
+  hdr.index = tx->next;
+
+  fountain_encode(&tx->enc, tx->next, symbol);
+  packet_len = frame_encode(packet+header_len, sizeof(packet)-header_len, &hdr, symbol, tx->enc.symbol_len);
+  if(packet_len == -1 || e32_queue_push(dev, flow, packet, header_len+packet_len))
+    return -1;
+
+  tx->next++;
+  return 0;
+}
+
+/*
+  With --fountain the file is read whole the first time it's readable,
+  then symbols are queued as the file's quota allows until the source
+  and repair symbols have all been queued.
+*/
+static int
+e32_poll_file_fountain(struct E32 *dev, struct options *opts, int *loop_continue)
+{
+  struct E32FountainTx *tx;
+
+  if(dev->fountain_tx == NULL && e32_fountain_load(dev, opts))
+  {
+    *loop_continue = 0;
+    return 1;
+  }
+
+  tx = dev->fountain_tx;
+  while(tx->next < tx->total && queue_available(dev->tx_queue, QUEUE_SOURCE_FILE) > 0)
+  {
+    if(e32_queue_fountain(dev))
+    {
+      err_output("e32_poll_file_fountain: unable to queue symbol %d\n", tx->next);
+      *loop_continue = 0;
+      return 1;
+    }
+  }
+
+  if(tx->next == tx->total)
+    *loop_continue = 0;
+
+  return 0;
+}
+
+static int
+e32_poll_file(struct E32 *dev, struct options *opts, int fd_file, int *loop_continue)
+{
+  ssize_t bytes;
+
+  if(opts->fountain != -1)
+    return e32_poll_file_fountain(dev, opts, loop_continue);
+
+  if(opts->verbose)
+    debug_output("reading from fd %d\n", fd_file);
+
+  bytes = fread(txbuf, 1, e32_packet_payload(dev, opts), opts->input_file);
+
+  if(opts->verbose)
+    debug_output("e32_poll_file: queueing %d bytes from file for transmit\n", bytes);
+
+  if(bytes > 0 && e32_queue_message(dev, opts, QUEUE_SOURCE_FILE, E32_CLASS_FILE, "file", NULL, txbuf, bytes))
+  {
+    err_output("e32_poll_file: transmit queue full\n");
+    return 1;
+  }
+
+  if(e32_write_output(dev, opts, txbuf, bytes, NULL))
+    err_output("error writing outputs\n");
+
+  /* all bytes read from file */
+  if(bytes < e32_packet_payload(dev, opts))
+  {
+    if(opts->verbose)
+      debug_output("getting out of loop\n");
+    *loop_continue = 0;
+  }
+
+  return 0;
+}
+
+/* the registered client at this address, NULL if it hasn't registered */
+static struct RegistryClient*
+e32_socket_client(struct E32 *dev, struct sockaddr_un *addr)
+{
+  return registry_find(dev->clients, addr);
+}
+
+static struct E32Notify*
+e32_notify_slot(struct E32Notifier *notify, uint32_t seq)
+{
+  return &notify->slots[seq % E32_NOTIFY_SLOTS];
+}
+
+/* whether the next message can be given a sequence number */
+static int
+e32_notify_room(struct E32 *dev)
+{
+  uint32_t seq;
+
+  seq = dev->notify->seq + 1 ? dev->notify->seq + 1 : 1;
+  return e32_notify_slot(dev->notify, seq)->state == E32_NOTIFY_FREE;
+}
+
+/*
+  Give the message just queued a sequence number, its last frame is at
+  the tail of the queue. Sequence numbers skip 0 which means there's
+  nothing to wait for.
+*/
+static uint32_t
+e32_notify_open(struct E32 *dev, struct sockaddr_un *client)
+{
+  struct E32Notify *slot;
+  uint32_t seq;
+
+  seq = ++dev->notify->seq;
+  if(seq == 0)
+    seq = ++dev->notify->seq;
+
+  slot = e32_notify_slot(dev->notify, seq);
+  slot->state = E32_NOTIFY_WAITING;
+  slot->seq = seq;
+  memcpy(&slot->addr, client, sizeof(struct sockaddr_un));
+  slot->queued_us = e32_now_us();
+  slot->written_us = 0;
+
+  queue_tail(dev->tx_queue)->seq = seq;
+  return seq;
+}
+
+static void
+e32_notify_send(struct E32 *dev, struct E32Notify *slot, uint8_t status, uint64_t now)
+{
+  uint8_t done[E32_NOTIFY_DONE_LENGTH];
+  uint64_t waited, took;
+
+  waited = slot->written_us > slot->queued_us ? slot->written_us - slot->queued_us : 0;
+  took = slot->written_us && now > slot->written_us ? now - slot->written_us : 0;
+  if(waited > UINT32_MAX)
+    waited = UINT32_MAX;
+  if(took > UINT32_MAX)
+    took = UINT32_MAX;
+
+  done[0] = E32_NOTIFY_DONE;
+  done[1] = status;
+  done[2] = slot->seq >> 24;
+  done[3] = slot->seq >> 16;
+  done[4] = slot->seq >> 8;
+  done[5] = slot->seq;
+  for(int i = 0; i < 4; i++)
+  {
+    done[6+i] = waited >> (24 - 8*i);
+    done[10+i] = took >> (24 - 8*i);
+  }
+
+  if(sendto(dev->notify->fd, done, E32_NOTIFY_DONE_LENGTH, MSG_DONTWAIT, (struct sockaddr*) &slot->addr, sizeof(struct sockaddr_un)) == -1)
+    errno_output("e32_notify_send: unable to tell %s %u is done\n", slot->addr.sun_path, slot->seq);
+
+  slot->state = E32_NOTIFY_FREE;
+}
+
+/*
+  The last frame of a message was written to the e32, it's done when AUX
+  next goes high. If the write failed the client is told right away.
+*/
+static void
+e32_notify_written(struct E32 *dev, uint32_t seq, int err)
+{
+  struct E32Notify *slot;
+
+  slot = e32_notify_slot(dev->notify, seq);
+  if(slot->state != E32_NOTIFY_WAITING || slot->seq != seq)
+    return;
+
+  slot->written_us = e32_now_us();
+  if(err || dev->notify->nwritten == E32_NOTIFY_SLOTS)
+  {
+    e32_notify_send(dev, slot, 1, slot->written_us);
+    return;
+  }
+
+  slot->state = E32_NOTIFY_WRITTEN;
+  dev->notify->written[dev->notify->nwritten++] = seq;
+}
+
+/* AUX went high, everything written to the e32 has been sent */
+static void
+e32_notify_done(struct E32 *dev, uint64_t now)
+{
+  struct E32Notify *slot;
+
+  for(size_t i = 0; i < dev->notify->nwritten; i++)
+  {
+    slot = e32_notify_slot(dev->notify, dev->notify->written[i]);
+    if(slot->state == E32_NOTIFY_WRITTEN)
+      e32_notify_send(dev, slot, 0, now);
+  }
+
+  if(dev->verbose && dev->notify->nwritten)
+    debug_output("e32_notify_done: told clients %d messages are done\n", dev->notify->nwritten);
+  dev->notify->nwritten = 0;
+}
+
+/* frames a session is charged for a message of len bytes */
+static size_t
+e32_session_frames(struct E32 *dev, struct options *opts, size_t len)
+{
+  if(!opts->frame)
+    return 1;
+  return frame_count(len, e32_packet_length(dev));
+}
+
+/*
+  Queue a message from a socket client. The class is from a priority
+  prefix if there is one, then in fixed mode the address and channel to
+  send to come next. A session pays for the message with its credits.
+  A datagram client to notify gets the sequence number of the message
+  in seq, 0 if nothing was queued. Returns the status sent back to the
+  client.
+*/
+static uint8_t
+e32_socket_queue(struct E32 *dev, struct options *opts, enum QueueSource source, enum QueueClass class,
+    const char *client, uint8_t *buf, size_t bytes, size_t *credits, struct sockaddr_un *notify, uint32_t *seq)
+{
+  uint8_t client_err; // return to socket clients
+  uint8_t *message, *dest;
+  size_t frames, refund;
+
+  client_err = 0;
+  frames = 0;
+  if(seq != NULL)
+    *seq = 0;
+  message = buf;
+  if(opts->priority_prefix)
+  {
+    if(buf[0] >= QUEUE_CLASSES)
+    {
+      err_output("e32_socket_queue: invalid class %d\n", buf[0]);
+      client_err++;
+    }
+    class = buf[0];
+    message++;
+    bytes--;
+  }
+
+  dest = NULL;
+  if(dev->transmission_mode && !client_err)
+  {
+    if(bytes < E32_FIXED_DEST_LENGTH)
+    {
+      err_output("e32_socket_queue: %d bytes is missing the address and channel\n", bytes);
+      client_err++;
+    }
+    else
+    {
+      dest = message;
+      message += E32_FIXED_DEST_LENGTH;
+      bytes -= E32_FIXED_DEST_LENGTH;
+    }
+  }
+
+  if(!client_err && bytes == 0)
+  {
+    err_output("e32_socket_queue: nothing to send from %s after the prefix and address\n", client);
+    client_err++;
+  }
+
+  if(credits != NULL && !client_err)
+  {
+    frames = e32_session_frames(dev, opts, bytes);
+    if(frames > *credits)
+    {
+      err_output("e32_socket_queue: %s needs %d frames and has credit for %d\n", client, frames, *credits);
+      client_err++;
+    }
+  }
+
+  if(notify != NULL && !client_err && !e32_notify_room(dev))
+  {
+    err_output("e32_socket_queue: %d messages are already waiting to be sent\n", E32_NOTIFY_SLOTS);
+    client_err++;
+  }
+
+  /* the frames a session was promised are released for its message to take */
+  if(credits != NULL && !client_err)
+    queue_release(dev->tx_queue, source, frames);
+
+  if(!client_err && e32_queue_message(dev, opts, source, class, client, dest, message, bytes))
+  {
+    err_output("e32_socket_queue: transmit queue full\n");
+    client_err++;
+
+    /* the session keeps the credits for whatever the message didn't take */
+    if(credits != NULL)
+    {
+      refund = queue_available(dev->tx_queue, source);
+      if(refund > frames)
+        refund = frames;
+      queue_reserve(dev->tx_queue, source, refund);
+      *credits -= frames - refund;
+    }
+  }
+  else if(!client_err)
+  {
+    if(credits != NULL)
+      *credits -= frames;
+    if(notify != NULL)
+      *seq = e32_notify_open(dev, notify);
+  }
+
+  if(opts->output_standard)
+  {
+    info_output("e32_socket_queue: queued:\n");
+    message[bytes] = '\0';
+    info_output("%s", message);
+    fflush(stdout);
+    info_output("\n");
+  }
+
+  return client_err;
+}
+
+/*
+  Queue a datagram from a client on the data socket, an empty one
+  registers the client. Returns the status sent back to the client.
+*/
+static uint8_t
+e32_socket_datagram(struct E32 *dev, struct options *opts, uint8_t *buf, size_t bytes, size_t max_len, struct sockaddr_un *client, uint32_t *seq)
+{
+  struct RegistryClient *registered;
+  enum QueueClass class;
+
+  *seq = 0;
+  if(bytes > max_len)
+  {
+    err_output("overflow: %d > %d", bytes, max_len);
+    return 1;
+  }
+
+  if(opts->verbose)
+  {
+    debug_output("e32_socket_datagram: received %d bytes from unix domain socket: %s\n", bytes, client->sun_path);
+  }
+
+  // sending 0 bytes will register and we'll add to the client list
+  registered = e32_socket_client(dev, client);
+  if(bytes == 0)
+  {
+    if(registered == NULL)
+    {
+      registered = registry_add(dev->clients, client);
+      if(registered == NULL)
+      {
+        err_output("e32_socket_datagram: unable to register %s\n", client->sun_path);
+        return 1;
+      }
+      registered->class = E32_CLASS_SOCKET_UNIX_DATA;
+
+      if(opts->verbose)
+        debug_output("e32_socket_datagram: registered client %d at %s\n", registry_size(dev->clients), client->sun_path);
+    }
+    return 0;
+  }
+
+  class = registered != NULL ? registered->class : E32_CLASS_SOCKET_UNIX_DATA;
+  return e32_socket_queue(dev, opts, QUEUE_SOURCE_SOCKET_UNIX_DATA, class, client->sun_path, buf, bytes, NULL,
+      dev->notify != NULL ? client : NULL, seq);
+}
+
+/*
+  Read the datagrams waiting on the data socket with one recvmmsg, as
+  many as the transmit queue has room for, and send back the status of
+  each with one sendmmsg. With --tx-notify the status comes with the
+  sequence number of the message.
+*/
+static int
+e32_poll_socket_unix_data(struct E32 *dev, struct options *opts, int fd_sockd, int *loop_continue)
+{
+  struct E32SocketBatch *batch;
+  struct msghdr *hdr;
+  size_t max_len, frames;
+  int count, received, sent, errors;
+  uint8_t *status;
+  uint32_t seq;
+
+  batch = dev->socket_batch;
+  max_len = e32_socket_max_len(dev, opts);
+
+  frames = e32_socket_frames(dev, opts);
+  count = queue_available(dev->tx_queue, QUEUE_SOURCE_SOCKET_UNIX_DATA) / (frames > 0 ? frames : 1);
+  if(count < 1)
+    count = 1;
+  if(count > E32_SOCKET_RECV_BATCH)
+    count = E32_SOCKET_RECV_BATCH;
+
+  for(int i = 0; i < count; i++)
+  {
+    batch->iov[i].iov_base = batch->bufs[i];
+    batch->iov[i].iov_len = max_len+1;
+
+    hdr = &batch->msgs[i].msg_hdr;
+    memset(hdr, 0, sizeof(struct msghdr));
+    hdr->msg_name = &batch->addrs[i];
+    hdr->msg_namelen = sizeof(struct sockaddr_un);
+    hdr->msg_iov = &batch->iov[i];
+    hdr->msg_iovlen = 1;
+  }
+
+  received = recvmmsg(fd_sockd, batch->msgs, count, MSG_DONTWAIT, NULL);
+  if(received == -1)
+  {
+    errno_output("error receiving from unix domain socket");
+    return 1;
+  }
+
+  errors = 0;
+  for(int i = 0; i < received; i++)
+  {
+    status = batch->status[i];
+    if(dev->notify != NULL)
+    {
+      status[0] = E32_NOTIFY_QUEUED;
+      status++;
+    }
+    status[0] = e32_socket_datagram(dev, opts, batch->bufs[i], batch->msgs[i].msg_len, max_len, &batch->addrs[i], &seq);
+    status[1] = seq >> 24;
+    status[2] = seq >> 16;
+    status[3] = seq >> 8;
+    status[4] = seq;
+    errors += status[0];
+  }
+
+  if(opts->verbose && received > 1)
+    debug_output("e32_poll_socket_unix_data: read %d datagrams at once\n", received);
+
+  // send back an acknowledge of 1 byte to each client
+  for(int i = 0; i < received; i++)
+  {
+    batch->iov[i].iov_base = batch->status[i];
+    batch->iov[i].iov_len = dev->notify != NULL ? E32_NOTIFY_QUEUED_LENGTH : 1;
+    batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_un);
+  }
+
+  for(int i = 0; i < received; i += sent)
+  {
+    sent = sendmmsg(fd_sockd, batch->msgs+i, received-i, 0);
+    if(sent == -1)
+    {
+      errno_output("e32_poll_socket_unix_data: unable to send back status to unix socket %s\n", batch->addrs[i].sun_path);
+      sent = 1;
+    }
+  }
+
+  return errors;
+}
+
+/*
+  Queue the datagrams waiting on the UDP port, as many as the transmit
+  queue has room for. The sender isn't answered, a datagram which can't
+  be sent is dropped like it would be anywhere else on the network.
+*/
+static int
+e32_poll_socket_udp(struct E32 *dev, struct options *opts)
+{
+  struct UdpBatch *batch;
+  char name[QUEUE_FLOW_NAME];
+  size_t max_len, frames;
+  int count, received, errors;
+
+  batch = dev->udp_batch;
+  max_len = e32_socket_max_len(dev, opts);
+
+  frames = e32_socket_frames(dev, opts);
+  count = queue_available(dev->tx_queue, QUEUE_SOURCE_SOCKET_UDP) / (frames > 0 ? frames : 1);
+  if(count < 1)
+    count = 1;
+
+  received = udp_recv(batch, opts->fd_socket_udp, count);
+  if(received == -1)
+  {
+    errno_output("e32_poll_socket_udp: error receiving from udp socket\n");
+    return 1;
+  }
+
+  if(opts->verbose && received > 1)
+    debug_output("e32_poll_socket_udp: read %d datagrams at once\n", received);
+
+  errors = 0;
+  for(int i = 0; i < received; i++)
+  {
+    snprintf(name, sizeof(name), "udp %s:%d", inet_ntoa(batch->addrs[i].sin_addr), ntohs(batch->addrs[i].sin_port));
+    if(batch->msgs[i].msg_len > max_len || (batch->msgs[i].msg_hdr.msg_flags & MSG_TRUNC))
+    {
+      err_output("e32_poll_socket_udp: dropping %d bytes from %s, at most %d can be sent\n",
+          batch->msgs[i].msg_len, name, max_len);
+      errors++;
+      continue;
+    }
+
+    if(batch->msgs[i].msg_len == 0)
+      continue;
+
+    errors += e32_socket_queue(dev, opts, QUEUE_SOURCE_SOCKET_UDP, E32_CLASS_SOCKET_UDP, name,
+        batch->bufs[i], batch->msgs[i].msg_len, NULL, NULL, NULL);
+  }
+
+  return errors;
+}
+
+/*
+  Compress and queue the IP packets waiting on the TUN interface while
+  there's room for a packet of the largest size.
+*/
+static int
+e32_poll_tun(struct E32 *dev, struct options *opts)
+{
+  ssize_t len, compressed;
+  int errors = 0;
+
+  while(queue_available(dev->tx_queue, QUEUE_SOURCE_TUN) >= e32_tun_frames(dev))
+  {
+    len = read(opts->fd_tun, tunbuf, sizeof(tunbuf));
+    if(len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if(len <= 0)
+    {
+      errno_output("e32_poll_tun: error reading from %s\n", opts->tun_name);
+      return errors + 1;
+    }
+
+    compressed = iphc_compress(&dev->iphc, tunbuf, len, iphcbuf, sizeof(iphcbuf));
+    if(compressed == -1)
+    {
+      err_output("e32_poll_tun: dropping a malformed %d byte packet\n", len);
+      errors++;
+      continue;
+    }
+
+    if(dev->verbose)
+      debug_output("e32_poll_tun: %d byte IP packet compressed to %d bytes\n", len, compressed);
+
+    if(e32_queue_message(dev, opts, QUEUE_SOURCE_TUN, E32_CLASS_TUN, opts->tun_name, NULL, iphcbuf, compressed))
+    {
+      err_output("e32_poll_tun: transmit queue full, dropping a packet\n");
+      errors++;
+    }
+  }
+
+  return errors;
+}
+
+/*
+  Accept a connection to the seqpacket data socket as a new session and
+  say hello. Its credits are granted after the next pass of the loop.
+*/
+static int
+e32_session_accept(struct E32 *dev, struct options *opts, struct Loop *loop, LoopHandler handler, void *data)
+{
+  struct E32Session *session;
+  uint8_t hello[8];
+  size_t single, fragment;
+  int fd;
+
+  fd = accept4(opts->fd_socket_unix_seqpacket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if(fd == -1)
+  {
+    errno_output("e32_session_accept: unable to accept a connection\n");
+    return 1;
+  }
+
+  if(dev->nsessions == E32_MAX_SESSIONS)
+  {
+    err_output("e32_session_accept: already at %d sessions, closing the connection\n", E32_MAX_SESSIONS);
+    close(fd);
+    return 1;
+  }
+
+  if(loop_add(loop, fd, EPOLLIN, handler, data, fd))
+  {
+    errno_output("e32_session_accept: unable to wait on the connection\n");
+    close(fd);
+    return 1;
+  }
+
+  session = &dev->sessions[dev->nsessions++];
+  memset(session, 0, sizeof(struct E32Session));
+  session->fd = fd;
+  session->id = ++dev->session_id;
+  snprintf(session->name, sizeof(session->name), "session %u", session->id);
+
+  single = opts->frame ? e32_packet_length(dev) - FRAME_DATA_HEADER_LENGTH : e32_packet_length(dev);
+  fragment = opts->frame ? e32_packet_length(dev) - FRAME_FRAGMENT_HEADER_LENGTH : e32_packet_length(dev);
+  hello[0] = session->id >> 24;
+  hello[1] = session->id >> 16;
+  hello[2] = session->id >> 8;
+  hello[3] = session->id;
+  hello[4] = single >> 8;
+  hello[5] = single;
+  hello[6] = fragment >> 8;
+  hello[7] = fragment;
+  e32_session_send(dev, session, E32_SESSION_HELLO, hello, sizeof(hello), NULL, 0);
+
+  if(opts->verbose)
+    debug_output("e32_session_accept: started %s\n", session->name);
+
+  return 0;
+}
+
+/* end a session, the last one takes its place */
+static void
+e32_session_close(struct E32 *dev, struct Loop *loop, size_t i)
+{
+  if(dev->verbose)
+    debug_output("e32_session_close: ending %s\n", dev->sessions[i].name);
+
+  queue_release(dev->tx_queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION, dev->sessions[i].credits);
+  loop_remove(loop, dev->sessions[i].fd);
+  close(dev->sessions[i].fd);
+  dev->sessions[i] = dev->sessions[--dev->nsessions];
+}
+
+/*
+  Read a message from a session. The connection closing ends the session
+  and whatever credit it had goes back to the others.
+*/
+static int
+e32_poll_session(struct E32 *dev, struct options *opts, struct Loop *loop, int fd)
+{
+  struct E32Session *session;
+  ssize_t bytes;
+  uint8_t status;
+  size_t i;
+
+  for(i = 0; i < dev->nsessions && dev->sessions[i].fd != fd; i++)
+    ;
+  if(i == dev->nsessions)
+    return 1;
+  session = &dev->sessions[i];
+
+  /* with MSG_TRUNC the length of the whole message comes back, not what fit */
+  bytes = recv(fd, txbuf, TX_BUF_BYTES-1, MSG_DONTWAIT | MSG_TRUNC);
+  if(bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return 0;
+
+  if(bytes <= 0 || session->closed)
+  {
+    e32_session_close(dev, loop, i);
+    return 0;
+  }
+
+  if(bytes > TX_BUF_BYTES-1)
+  {
+    err_output("e32_poll_session: dropping %d bytes from %s, at most %d can be sent\n",
+        bytes, session->name, TX_BUF_BYTES-1);
+    status = 1;
+    e32_session_send(dev, session, E32_SESSION_ERROR, &status, 1, NULL, 0);
+    return 1;
+  }
+
+  status = e32_socket_queue(dev, opts, QUEUE_SOURCE_SOCKET_UNIX_SESSION, E32_CLASS_SOCKET_UNIX_SESSION,
+      session->name, txbuf, bytes, &session->credits, NULL, NULL);
+  if(status)
+    e32_session_send(dev, session, E32_SESSION_ERROR, &status, 1, NULL, 0);
+
+  return status;
+}
+
+/*
+  Grant credits out of the quota for sessions which isn't queued or
+  promised already, they're reserved in the transmit queue so the other
+  inputs can't fill them first. Each session is topped up to a fair share of the
+  quota which is at most E32_SESSION_BACKLOG_MS on air, but always
+  enough for the largest message when the quota allows it.
+*/
+static void
+e32_session_grant(struct E32 *dev, struct options *opts)
+{
+  uint8_t credit[2];
+  size_t available, target, air_frames, grant;
+  uint64_t packet_us;
+
+  if(dev->nsessions == 0)
+    return;
+
+  available = queue_available(dev->tx_queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION);
+  if(available == 0)
+    return;
+
+  target = E32_TX_QUOTA_SOCKET_UNIX_SESSION / dev->nsessions;
+  packet_us = airtime_us(&dev->airtime, E32_MAX_PACKET_LENGTH);
+  if(packet_us > 0)
+  {
+    air_frames = E32_SESSION_BACKLOG_MS * 1000ULL / packet_us;
+    if(air_frames < e32_socket_frames(dev, opts))
+      air_frames = e32_socket_frames(dev, opts);
+    if(air_frames < target)
+      target = air_frames;
+  }
+
+  for(size_t i = 0; i < dev->nsessions && available > 0; i++)
+  {
+    if(dev->sessions[i].closed || dev->sessions[i].credits >= target)
+      continue;
+
+    grant = target - dev->sessions[i].credits;
+    if(grant > available)
+      grant = available;
+    if(grant > 0xFFFF)
+      grant = 0xFFFF;
+
+    credit[0] = grant >> 8;
+    credit[1] = grant & 0xFF;
+    if(e32_session_send(dev, &dev->sessions[i], E32_SESSION_CREDIT, credit, sizeof(credit), NULL, 0))
+      continue;
+
+    queue_reserve(dev->tx_queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION, grant);
+    dev->sessions[i].credits += grant;
+    available -= grant;
+  }
+}
+
+static int
+e32_control_pending(struct E32 *dev)
+{
+  return dev->control != NULL && dev->control->size > 0;
+}
+
+/* the client error for a request which failed */
+static uint8_t
+e32_control_error(const struct E32ControlRequest *request)
+{
+  if(request->len == 6)
+    return 5;
+  return request->cmd[0] == 's' ? 3 : 4;
+}
+
+/*
+  Whether a read of the settings or version can be answered from what
+  was read last, a write waiting to be done would change the settings.
+*/
+static int
+e32_control_cached(struct E32 *dev, uint8_t cmd)
+{
+  struct E32Control *control = dev->control;
+
+  if(cmd == 's' ? !dev->settings_cached : !dev->version_cached)
+    return 0;
+
+  for(size_t i = 0; control != NULL && i < control->size; i++)
+  {
+    if(control->requests[(control->head + i) % E32_CONTROL_REQUESTS].len == 6)
+      return 0;
+  }
+
+  return 1;
+}
+
+/*
+  Queue a request from the control socket, joining one the same waiting
+  to start. A write has to be done in order so nothing is joined past
+  one. Returns the client error, 0 when queued.
+*/
+static uint8_t
+e32_control_queue(struct E32 *dev, const uint8_t *cmd, size_t len, const struct sockaddr_un *client)
+{
+  struct E32Control *control;
+  struct E32ControlRequest *request;
+  size_t first;
+
+  control = dev->control;
+  if(control == NULL || dev->fd_timer == -1)
+    return 2;
+
+  /* the request at the head may have started already */
+  first = control->step == E32_CONTROL_NONE ? 0 : 1;
+  for(size_t i = control->size; i > first; i--)
+  {
+    request = &control->requests[(control->head + i - 1) % E32_CONTROL_REQUESTS];
+    if(request->len == len && memcmp(request->cmd, cmd, len) == 0 && request->nclients < E32_CONTROL_CLIENTS)
+    {
+      memcpy(&request->clients[request->nclients++], client, sizeof(struct sockaddr_un));
+      if(dev->verbose)
+        debug_output("e32_control_queue: joined a request with %d clients\n", request->nclients);
+      return 0;
+    }
+    if(request->len == 6)
+      break;
+  }
+
+  if(control->size == E32_CONTROL_REQUESTS)
+    return E32_CONTROL_BUSY;
+
+  request = &control->requests[(control->head + control->size) % E32_CONTROL_REQUESTS];
+  memcpy(request->cmd, cmd, len);
+  request->len = len;
+  request->nclients = 1;
+  memcpy(&request->clients[0], client, sizeof(struct sockaddr_un));
+  control->size++;
+  return 0;
+}
+
+/*
+  Wait for the e32 to be ready without blocking, as e32_wait_ready does.
+  AUX is looked at once the deadline passes and again when it goes high.
+*/
+static void
+e32_control_wait(struct E32 *dev, enum E32ControlStep step, int low_ms, int timeout_ms)
+{
+  struct E32Control *control = dev->control;
+
+  control->step = step;
+  control->start_us = e32_now_us();
+  control->timeout_us = control->start_us + timeout_ms * 1000ULL;
+  control->deadline_us = control->start_us + (low_ms ? low_ms * 1000ULL : E32_AUX_SETTLE_US);
+}
+
+/* send a command to the e32 and wait for the bytes of its reply */
+static int
+e32_control_command(struct E32 *dev, const uint8_t *cmd, size_t len, size_t expected)
+{
+  struct E32Control *control = dev->control;
+
+  if(write(dev->uart_fd, cmd, len) != len)
+  {
+    errno_output("e32_control_command: unable to write the command\n");
+    return 1;
+  }
+
+  control->step = E32_CONTROL_REPLY;
+  control->reply_len = 0;
+  control->reply_expected = expected;
+  control->deadline_us = e32_now_us() + E32_CMD_TIMEOUT_MS * 1000ULL;
+  return 0;
+}
+
+/* answer every client of the request at the head and drop it */
+static void
+e32_control_finish(struct E32 *dev, struct options *opts)
+{
+  struct E32Control *control;
+  struct E32ControlRequest *request;
+  const uint8_t *reply;
+  size_t len;
+
+  control = dev->control;
+  request = &control->requests[control->head];
+
+  if(control->err)
+  {
+    err_output("e32_control_finish: client error %d\n", control->err);
+    reply = &control->err;
+    len = 1;
+  }
+  else if(request->len == 6)
+  {
+    reply = request->cmd;
+    len = request->len;
+  }
+  else if(request->cmd[0] == 's')
+  {
+    reply = dev->settings;
+    len = sizeof(dev->settings);
+  }
+  else
+  {
+    reply = dev->version;
+    len = sizeof(dev->version);
+  }
+
+  for(size_t i = 0; i < request->nclients; i++)
+  {
+    if(sendto(control->fd, reply, len, 0, (struct sockaddr*) &request->clients[i], sizeof(struct sockaddr_un)) == -1)
+      errno_output("e32_control_finish: unable to send back to unix socket %s\n", request->clients[i].sun_path);
+  }
+
+  if(opts->verbose)
+  {
+    debug_output("e32_control_finish: %d bytes to %d clients in %llu us: ", len, request->nclients,
+        (unsigned long long) (e32_now_us() - control->begin_us));
+    for(size_t i = 0; i < len; i++)
+      debug_output("%02x", reply[i]);
+    debug_output("\n");
+  }
+
+  control->head = (control->head + 1) % E32_CONTROL_REQUESTS;
+  control->size--;
+  control->step = E32_CONTROL_NONE;
+  dev->state = IDLE;
+}
+
+/* start the request at the head once the e32 is idle */
+static int
+e32_control_start(struct E32 *dev, struct options *opts)
+{
+  struct E32Control *control = dev->control;
+
+  if(!e32_control_pending(dev) || control->step != E32_CONTROL_NONE || dev->state != IDLE)
+    return 0;
+
+  dev->state = CONTROL;
+  control->err = 0;
+  control->begin_us = e32_now_us();
+  if(e32_write_mode(dev, SLEEP) == -1)
+  {
+    err_output("e32_control_start: unable to go to sleep mode\n");
+    control->err = 2;
+  }
+
+  e32_control_wait(dev, E32_CONTROL_SLEEP, E32_AUX_LOW_MS, E32_MODE_TIMEOUT_MS);
+  return 0;
+}
+
+/* the step being waited on is done, go on to the next */
+static int
+e32_control_next(struct E32 *dev, struct options *opts)
+{
+  const uint8_t read_settings[3] = {0xC1, 0xC1, 0xC1};
+  const uint8_t read_version[3] = {0xC3, 0xC3, 0xC3};
+  struct E32Control *control;
+  struct E32ControlRequest *request;
+
+  control = dev->control;
+  request = &control->requests[control->head];
+
+  switch(control->step)
+  {
+    case E32_CONTROL_SLEEP:
+      if(control->err)
+        break;
+
+      if(request->len == 6)
+      {
+        dev->settings_cached = 0;
+        if(write(dev->uart_fd, request->cmd, request->len) != request->len)
+        {
+          errno_output("e32_control_next: unable to write settings\n");
+          control->err = 5;
+          break;
+        }
+
+        /* the e32 saves the settings while AUX is low */
+        e32_control_wait(dev, E32_CONTROL_SAVE, E32_AUX_LOW_MS, E32_WRITE_TIMEOUT_MS);
+        return 0;
+      }
+
+      if(request->cmd[0] == 's')
+        control->err = e32_control_command(dev, read_settings, sizeof(read_settings), sizeof(dev->settings)) ? 3 : 0;
+      else
+        control->err = e32_control_command(dev, read_version, sizeof(read_version), sizeof(dev->version)) ? 4 : 0;
+      if(control->err)
+        break;
+      return 0;
+
+    case E32_CONTROL_SAVE:
+      /* read back what was written as when writing settings */
+      if(e32_control_command(dev, read_settings, sizeof(read_settings), sizeof(dev->settings)))
+      {
+        control->err = 5;
+        break;
+      }
+      return 0;
+
+    case E32_CONTROL_REPLY:
+      if(control->reply_len < control->reply_expected)
+      {
+        err_output("e32_control_next: timed out with %d of %d bytes\n", control->reply_len, control->reply_expected);
+        control->err = e32_control_error(request);
+      }
+      else if(control->reply_expected == sizeof(dev->settings))
+      {
+        memcpy(dev->settings, control->reply, sizeof(dev->settings));
+        if(e32_parse_settings(dev))
+          control->err = e32_control_error(request);
+      }
+      else
+      {
+        memcpy(dev->version, control->reply, sizeof(dev->version));
+        if(e32_parse_version(dev))
+          control->err = e32_control_error(request);
+      }
+
+      e32_control_wait(dev, E32_CONTROL_DONE, 0, E32_CMD_TIMEOUT_MS);
+      return 0;
+
+    case E32_CONTROL_DONE:
+      break;
+
+    case E32_CONTROL_NORMAL:
+      e32_control_finish(dev, opts);
+      return 0;
+
+    default:
+      return 0;
+  }
+
+  /* done or failed, back to normal mode */
+  if(e32_write_mode(dev, NORMAL) == -1)
+  {
+    err_output("e32_control_next: unable to go to normal mode\n");
+    control->err = 8;
+  }
+
+  e32_control_wait(dev, E32_CONTROL_NORMAL, E32_AUX_LOW_MS, E32_MODE_TIMEOUT_MS);
+  return 0;
+}
+
+/* AUX going high ends a wait once the e32 has settled */
+static int
+e32_control_aux(struct E32 *dev, int aux)
+{
+  struct E32Control *control = dev->control;
+
+  if(aux == 1 && control->step != E32_CONTROL_REPLY && control->step != E32_CONTROL_NONE)
+    control->deadline_us = e32_now_us() + E32_AUX_SETTLE_US;
+
+  return 0;
+}
+
+/* the bytes of a reply from the e32 */
+static int
+e32_control_uart(struct E32 *dev, struct options *opts)
+{
+  struct E32Control *control;
+  uint8_t discard[RX_BUF_BYTES];
+  ssize_t bytes;
+
+  control = dev->control;
+  if(control->step != E32_CONTROL_REPLY)
+  {
+    bytes = read(dev->uart_fd, discard, sizeof(discard));
+    if(bytes > 0 && dev->verbose)
+      debug_output("e32_control_uart: discarding %d bytes\n", bytes);
+    return 0;
+  }
+
+  bytes = read(dev->uart_fd, control->reply + control->reply_len, control->reply_expected - control->reply_len);
+  if(bytes == -1)
+  {
+    if(errno == EAGAIN)
+      return 0;
+    errno_output("e32_control_uart: reading the reply\n");
+    return 1;
+  }
+
+  control->reply_len += bytes;
+  if(control->reply_len < control->reply_expected)
+    return 0;
+
+  return e32_control_next(dev, opts);
+}
+
+/* a deadline of the request running passed */
+static int
+e32_control_timer(struct E32 *dev, struct options *opts)
+{
+  struct E32Control *control;
+  uint64_t now;
+  int aux;
+
+  control = dev->control;
+  if(control == NULL || control->step == E32_CONTROL_NONE)
+    return 0;
+
+  now = e32_now_us();
+  if(control->deadline_us > now)
+    return 0;
+
+  if(control->step == E32_CONTROL_REPLY)
+    return e32_control_next(dev, opts);
+
+  lseek(dev->fd_gpio_aux, 0, SEEK_SET);
+  if(gpio_read(dev->fd_gpio_aux, &aux) != 2)
+    aux = 1;
+
+  if(aux == 0 && now < control->timeout_us)
+  {
+    control->deadline_us = control->timeout_us;
+    return 0;
+  }
+  else if(aux == 0)
+    err_output("e32_control_timer: aux still low in step %d\n", control->step);
+
+  dev->settle_us = now - control->start_us;
+  if(dev->settle_us > dev->settle_max_us)
+    dev->settle_max_us = dev->settle_us;
+
+  if(dev->verbose)
+    debug_output("e32_control_timer: ready %llu us into step %d, at most %llu us\n",
+        (unsigned long long) dev->settle_us, control->step, (unsigned long long) dev->settle_max_us);
+
+  return e32_control_next(dev, opts);
+}
+
+static int
+e32_poll_socket_unix_control(struct E32 *dev, struct options *opts, int fd_sockc)
+{
+  ssize_t bytes, ret_bytes;
+  uint8_t client_err; // return to socket clients
+  struct sockaddr_un client;
+  socklen_t addrlen; // unix domain socket client address
+  uint8_t *control;
+
+  client_err = 0;
+  /*
+     allocate memory on the heap since we have to send it
+     to other functions for a buffer
+  */
+  control = malloc(32);
+  addrlen = sizeof(struct sockaddr_un);
+
+  bytes = recvfrom(fd_sockc, control, 32, 0, (struct sockaddr*) &client, &addrlen);
+  if(bytes == -1)
+  {
+    errno_output("e32_poll_socket_unix_control: error receiving from unix domain socket");
+    client_err = 1;
+  }
+
+  debug_output("e32_poll_socket_unix_control: received %d bytes from unix domain socket: %s\n", bytes, client.sun_path);
+
+  /* set the class of a registered client, this doesn't need the e32 */
+  if(bytes == 2 && control[0] == 'p')
+  {
+    struct RegistryClient *registered;
+
+    registered = e32_socket_client(dev, &client);
+    if(registered == NULL || control[1] >= QUEUE_CLASSES)
+    {
+      err_output("e32_poll_socket_unix_control: unable to set class %d for %s\n", control[1], client.sun_path);
+      client_err = 9;
+    }
+    else
+      registered->class = control[1];
+
+    if(sendto(fd_sockc, &client_err, 1, 0, (struct sockaddr*) &client, addrlen) == -1)
+      errno_output("e32_poll_socket_unix_control: unable to send back status to unix socket");
+
+    free(control);
+    return client_err;
+  }
+
+  /*
+    the air time left in the duty cycle budget and the most there can be,
+    in microseconds as two big endian 32 bit numbers
+  */
+  if(bytes == 1 && control[0] == 'd')
+  {
+    uint64_t available, capacity;
+
+    if(dev->duty == NULL)
+    {
+      err_output("e32_poll_socket_unix_control: no duty cycle limit\n");
+      client_err = 10;
+      ret_bytes = 1;
+      control[0] = client_err;
+    }
+    else
+    {
+      available = duty_available_us(dev->duty, e32_now_us());
+      capacity = duty_capacity_us(dev->duty);
+      for(int i = 0; i < 4; i++)
+      {
+        control[i] = available >> (24 - 8*i);
+        control[4+i] = capacity >> (24 - 8*i);
+      }
+      ret_bytes = 8;
+    }
+
+    if(sendto(fd_sockc, control, ret_bytes, 0, (struct sockaddr*) &client, addrlen) == -1)
+      errno_output("e32_poll_socket_unix_control: unable to send back the duty cycle budget to unix socket");
+
+    free(control);
+    return client_err;
+  }
+
+  /*
+    set the filter of a registered client, the lowest and highest sender
+    address big endian, the number of leading bytes then their mask and
+    value. Just 'f' clears the filter.
+  */
+  if(bytes >= 1 && control[0] == 'f')
+  {
+    struct RegistryClient *registered;
+    size_t len;
+
+    registered = e32_socket_client(dev, &client);
+    len = bytes >= 6 ? control[5] : 0;
+    if(registered == NULL)
+      client_err = 11;
+    else if(bytes == 1)
+      registered->filter.active = 0;
+    else if(bytes != 6 + 2*len || registry_filter_compile(&registered->filter,
+          (control[1] << 8) | control[2], (control[3] << 8) | control[4], control+6, control+6+len, len))
+      client_err = 11;
+
+    if(client_err)
+      err_output("e32_poll_socket_unix_control: unable to set the filter for %s\n", client.sun_path);
+
+    if(sendto(fd_sockc, &client_err, 1, 0, (struct sockaddr*) &client, addrlen) == -1)
+      errno_output("e32_poll_socket_unix_control: unable to send back status to unix socket");
+
+    free(control);
+    return client_err;
+  }
+
+  if(bytes == 1 && (control[0] == 's' || control[0] == 'v') && e32_control_cached(dev, control[0]))
+  {
+    if(control[0] == 's')
+      bytes = sendto(fd_sockc, dev->settings, sizeof(dev->settings), 0, (struct sockaddr*) &client, addrlen);
+    else
+      bytes = sendto(fd_sockc, dev->version, sizeof(dev->version), 0, (struct sockaddr*) &client, addrlen);
+    if(bytes == -1)
+      errno_output("e32_poll_socket_unix_control: unable to send back to unix socket");
+    else if(opts->verbose)
+      debug_output("e32_poll_socket_unix_control: answered '%c' from the cache\n", control[0]);
+
+    free(control);
+    return 0;
+  }
+
+  /* read again rather than from the cache */
+  if(bytes == 1 && (control[0] == 'S' || control[0] == 'V'))
+    control[0] = control[0] == 'S' ? 's' : 'v';
+
+  if((bytes == 1 && (control[0] == 's' || control[0] == 'v')) ||
+      (bytes == 6 && (control[0] == 0xC0 || control[0] == 0xC2)))
+  {
+    client_err = e32_control_queue(dev, control, bytes, &client);
+    if(client_err)
+      err_output("e32_poll_socket_unix_control: unable to queue the request, client error %d\n", client_err);
+  }
+  else
+  {
+    err_output("received %d bytes\n", bytes);
+    for(int i=0;i<bytes;i++)
+      err_output("%02x ", control[i]);
+    err_output("\n");
+    client_err = 7;
+  }
+
+  /* a queued request is answered once it's done */
+  if(client_err && sendto(fd_sockc, &client_err, 1, 0, (struct sockaddr*) &client, addrlen) == -1)
+    errno_output("e32_poll_socket_unix_control: unable to send back status to unix socket");
+
+  free(control);
+  return client_err;
+}
+
+/* keep track of when the e32 should be done with what it's been given */
+static void
+e32_tx_track(struct E32 *dev, size_t len)
+{
+  uint64_t now, air_us;
+
+  now = e32_now_us();
+  if(dev->tx_frames == 0)
+  {
+    dev->tx_start_us = now;
+    dev->tx_done_us = now;
+    dev->tx_len = 0;
+  }
+
+  len = e32_air_length(dev, len);
+  air_us = airtime_us(&dev->airtime, len);
+  dev->tx_done_us += air_us;
+  dev->tx_len += len;
+  dev->tx_frames++;
+
+  if(dev->duty != NULL)
+    duty_charge(dev->duty, airtime_lora_us(&dev->airtime, len), now);
+}
+
+/*
+  With a duty cycle limit only what's left of the budget can be written,
+  room is cut to the longest packet whose time on air fits.
+*/
+static size_t
+e32_duty_room(struct E32 *dev, size_t room)
+{
+  uint64_t available;
+  size_t len;
+
+  if(dev->duty == NULL)
+    return room;
+
+  available = duty_available_us(dev->duty, e32_now_us());
+  len = room < E32_MAX_PACKET_LENGTH + E32_FIXED_DEST_LENGTH ? room : E32_MAX_PACKET_LENGTH + E32_FIXED_DEST_LENGTH;
+  while(len > 0 && airtime_lora_us(&dev->airtime, e32_air_length(dev, len)) > available)
+    len--;
+
+  return len;
+}
+
+/* when the budget allows a packet of len bytes, 0 if it does already or there's no limit */
+static uint64_t
+e32_duty_deadline(struct E32 *dev, size_t len)
+{
+  uint64_t now, ready;
+
+  if(dev->duty == NULL)
+    return 0;
+
+  now = e32_now_us();
+  ready = duty_ready_us(dev->duty, airtime_lora_us(&dev->airtime, e32_air_length(dev, len)), now);
+  return ready > now ? ready : 0;
+}
+
+/*
+  AUX went high so the e32 is done with everything it was given. When it
+  had a single frame how long it took calibrates the air time model.
+*/
+static void
+e32_tx_done(struct E32 *dev)
+{
+  uint64_t now;
+
+  now = e32_now_us();
+  if(dev->tx_frames == 1)
+    airtime_calibrate(&dev->airtime, dev->tx_len, now - dev->tx_start_us);
+
+  if(dev->verbose && dev->tx_frames)
+    debug_output("e32_tx_done: %d frames took %llu ms, air time scale %llu\n", dev->tx_frames,
+        (unsigned long long) (now - dev->tx_start_us) / 1000, (unsigned long long) dev->airtime.scale);
+
+  if(dev->notify != NULL)
+    e32_notify_done(dev, now);
+
+  dev->tx_frames = 0;
+  dev->tx_done_us = now;
+}
+
+/*
+  With --reliable what's written next comes from the ARQ. Frames which
+  were lost go first, then a poll which wasn't answered, new frames while
+  the window is open and last an ack when one is due. Nothing is written
+  if it doesn't fit in room. Returns the bytes written, -1 on an error.
+*/
+static ssize_t
+e32_arq_transmit_next(struct E32 *dev, struct options *opts, size_t room)
+{
+  uint8_t packet[E32_MAX_PACKET_LENGTH], dest[E32_FIXED_DEST_LENGTH];
+  struct QueueFrame *frame;
+  struct ArqSlot *slot;
+  size_t header_len, len;
+  uint8_t *data;
+  uint64_t now;
+  int dropped;
+
+  now = e32_now_us();
+  dropped = arq_timeout(dev->arq, now);
+  if(dropped)
+    err_output("e32_arq_transmit_next: no answer from the other e32, gave up on %d frames\n", dropped);
+
+  header_len = dev->transmission_mode ? E32_FIXED_HEADER_LENGTH : 0;
+  frame = queue_peek(dev->tx_queue);
+
+  if((slot = arq_lost(dev->arq)) != NULL)
+  {
+    if(slot->len > room)
+      return 0;
+    arq_write(dev->arq, slot, frame != NULL, now);
+    data = slot->data;
+    len = slot->len;
+  }
+  else if(frame != NULL && arq_window_open(dev->arq))
+  {
+    if(frame->len + ARQ_DATA_HEADER_LENGTH > room)
+      return 0;
+    slot = arq_push(dev->arq, frame->data, header_len, frame->data + header_len, frame->len - header_len);
+    queue_pop(dev->tx_queue);
+    if(slot == NULL)
+    {
+      err_output("e32_arq_transmit_next: frame too long, dropping it\n");
+      return -1;
+    }
+    arq_write(dev->arq, slot, queue_size(dev->tx_queue) > 0, now);
+    data = slot->data;
+    len = slot->len;
+  }
+  else if(dev->arq->poll_due || arq_ack_due(dev->arq, now))
+  {
+    if(header_len + ARQ_ACK_LENGTH > room)
+      return 0;
+    memcpy(dest, dev->arq_peer, E32_FIXED_SOURCE_LENGTH);
+    dest[2] = dev->channel;
+    header_len = e32_packet_header(dev, dest, packet);
+    len = header_len + arq_write_ack(dev->arq, packet + header_len, now);
+    data = packet;
+  }
+  else
+    return dropped ? -1 : 0;
+
+  if(opts->verbose)
+    debug_output("e32_arq_transmit_next: sending %d bytes, %d frames outstanding\n",
+        len, arq_outstanding(dev->arq));
+
+  if(e32_transmit(dev, data, len) != 0)
+  {
+    err_output("e32_arq_transmit_next: error in transmit\n");
+    return -1;
+  }
+
+  e32_tx_track(dev, len);
+  return dropped ? -1 : len;
+}
+
+/*
+  Write the frame at the head of the transmit queue to the UART if it
+  fits in room. Returns the bytes written, -1 on an error.
+*/
+static ssize_t
+e32_poll_transmit_next(struct E32 *dev, struct options *opts, size_t room)
+{
+  struct QueueFrame *frame;
+  size_t len;
+  int err;
+
+  room = e32_duty_room(dev, room);
+
+  if(dev->arq != NULL)
+    return e32_arq_transmit_next(dev, opts, room);
+
+  frame = queue_peek(dev->tx_queue);
+  if(frame == NULL || frame->len > room)
+    return 0;
+
+  if(opts->verbose)
+    debug_output("e32_poll_transmit_next: sending %d bytes, %d frames queued, done in %llu ms\n",
+        frame->len, queue_size(dev->tx_queue), (unsigned long long) e32_until_ms(frame->done_us));
+
+  err = e32_transmit(dev, frame->data, frame->len) != 0;
+  if(err)
+    err_output("e32_poll_transmit_next: error in transmit, dropping frame\n");
+  if(frame->seq && dev->notify != NULL)
+    e32_notify_written(dev, frame->seq, err);
+
+  len = frame->len;
+  e32_tx_track(dev, len);
+  queue_pop(dev->tx_queue);
+
+  return err ? -1 : (ssize_t) len;
+}
+
+/* the time on air of a packet over a link, at least its time over the UART if there's no model */
+static uint64_t
+e32_bond_air_us(struct E32 *link, size_t len)
+{
+  uint64_t air_us;
+
+  air_us = airtime_us(&link->airtime, len);
+  return air_us ? air_us : airtime_uart_us(&link->airtime, len);
+}
+
+/*
+  With bonding the frame at the head of the queue goes to the link which
+  would be done with it first, from when each link is free and its time
+  on air as measured. If that link is busy the frame waits for it rather
+  than going out late on a slower link and holding up the stream at the
+  other end. In fixed mode the frame goes to the channel of the link.
+  Reports of what arrived go out ahead of the queue.
+*/
+static int
+e32_bond_transmit(struct E32 *dev, struct options *opts)
+{
+  uint8_t packet[E32_MAX_PACKET_LENGTH+E32_FIXED_DEST_LENGTH];
+  uint64_t ready[BOND_MAX_LINKS], air[BOND_MAX_LINKS], now;
+  struct QueueFrame *frame;
+  struct E32 *link;
+  size_t header_len, len, report;
+  int pick, err;
+
+  header_len = dev->transmission_mode ? E32_FIXED_HEADER_LENGTH : 0;
+
+  /* a free link tells the other end what arrived over it first */
+  for(int i = 0; i < dev->bond->links; i++)
+  {
+    link = dev->link[i];
+    if(link->state != IDLE)
+      continue;
+
+    len = e32_packet_header(dev, NULL, packet);
+    if(len)
+      packet[2] = link->channel;
+    report = bond_report(dev->bond, i, packet + len);
+    if(report == 0)
+      continue;
+    len += report;
+
+    if(opts->verbose)
+      debug_output("e32_bond_transmit: reporting what arrived on link %d\n", i);
+
+    err = e32_transmit(link, packet, len) != 0;
+    e32_tx_track(link, len);
+    if(err)
+    {
+      err_output("e32_bond_transmit: error sending the report on link %d\n", i);
+      return 1;
+    }
+  }
+
+  while((frame = queue_peek(dev->tx_queue)) != NULL)
+  {
+    now = e32_now_us();
+    len = frame->len + BOND_HEADER_LENGTH;
+    for(int i = 0; i < dev->bond->links; i++)
+    {
+      link = dev->link[i];
+      air[i] = e32_bond_air_us(link, e32_air_length(link, len));
+
+      if(link->state == TX && link->tx_done_us > now)
+        ready[i] = link->tx_done_us;
+      else if(link->state == RX)
+        ready[i] = now + e32_bond_air_us(link, E32_MAX_PACKET_LENGTH);
+      else
+        ready[i] = now;
+    }
+
+    pick = bond_pick(dev->bond, ready, air);
+    link = dev->link[pick];
+    if(link->state != IDLE)
+      return 0;
+
+    memcpy(packet, frame->data, header_len);
+    if(header_len)
+      packet[2] = link->channel;
+    len = header_len + bond_header(dev->bond, pick, packet + header_len);
+    memcpy(packet + len, frame->data + header_len, frame->len - header_len);
+    len += frame->len - header_len;
+
+    if(opts->verbose)
+      debug_output("e32_bond_transmit: sending %d bytes on link %d, %d frames queued\n",
+          len, pick, queue_size(dev->tx_queue));
+
+    err = e32_transmit(link, packet, len) != 0;
+    e32_tx_track(link, len);
+    queue_pop(dev->tx_queue);
+    if(err)
+    {
+      err_output("e32_bond_transmit: error in transmit on link %d, dropping frame\n", pick);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+  In burst mode keep writing frames while the model of the TX buffer of
+  the e32 has room for them. The buffer is topped up when AUX goes low
+  and as the e32 drains it.
+*/
+static int
+e32_poll_transmit_burst(struct E32 *dev, struct options *opts)
+{
+  ssize_t written;
+  uint64_t now;
+
+  while(dev->state != RX)
+  {
+    now = e32_now_us();
+    written = e32_poll_transmit_next(dev, opts, burst_room(dev->burst, now));
+    if(written <= 0)
+      return written == -1;
+
+    burst_wrote(dev->burst, written, now);
+
+    if(opts->verbose)
+      debug_output("e32_poll_transmit_burst: %d bytes in flight\n", dev->burst->in_flight);
+  }
+
+  return 0;
+}
+
+/* in burst mode wake up when the e32 will have room for the next frame */
+static int
+e32_poll_timeout(struct E32 *dev)
+{
+  struct QueueFrame *frame;
+  int64_t wait;
+
+  if(dev->burst == NULL || dev->state == RX)
+    return -1;
+
+  frame = queue_peek(dev->tx_queue);
+  if(frame == NULL)
+    return -1;
+
+  wait = burst_wait_us(dev->burst, frame->len, e32_now_us());
+  if(wait <= 0)
+    return -1;
+
+  return (wait + 999) / 1000;
+}
+
+/*
+  When pacing, the frame after the one the e32 is transmitting is written
+  just before the e32 is expected to finish so it's ready in its buffer.
+  Only one frame is written ahead. Returns 0 if there's nothing to pace.
+*/
+static uint64_t
+e32_pace_deadline(struct E32 *dev, struct options *opts)
+{
+  struct QueueFrame *frame;
+  uint64_t lead;
+
+  if(!opts->pace || dev->state != TX || dev->tx_frames != 1)
+    return 0;
+
+  frame = queue_peek(dev->tx_queue);
+  if(frame == NULL)
+    return 0;
+
+  lead = airtime_uart_us(&dev->airtime, frame->len) + E32_PACE_MARGIN_US;
+  if(dev->tx_done_us <= lead)
+    return 1;
+
+  return dev->tx_done_us - lead;
+}
+
+/* arm the timer for the earliest deadline, disarm it if there are none */
+static int
+e32_timer_update(struct E32 *dev, struct options *opts)
+{
+  struct itimerspec its;
+  struct QueueFrame *frame;
+  struct E32 *module;
+  uint64_t deadline, coalesce, arq, held;
+
+  if(dev->fd_timer == -1)
+    return 0;
+
+  deadline = e32_pace_deadline(dev, opts);
+  coalesce = e32_coalesce_deadline(dev);
+  if(coalesce && (deadline == 0 || coalesce < deadline))
+    deadline = coalesce;
+
+  /* a gap in a bonded stream is given up on */
+  held = dev->bond != NULL ? bond_deadline(dev->bond) : 0;
+  if(held && (deadline == 0 || held < deadline))
+    deadline = held;
+
+  if(dev->control != NULL && dev->control->step != E32_CONTROL_NONE &&
+      (deadline == 0 || dev->control->deadline_us < deadline))
+    deadline = dev->control->deadline_us;
+
+  /* a packet received ends when the UART goes quiet */
+  for(int i = -1; i < BOND_MAX_LINKS; i++)
+  {
+    module = i == -1 ? dev->rx : i == 0 ? dev : dev->link[i];
+    if(module != NULL && module->rx_gap_us && (deadline == 0 || module->rx_gap_us < deadline))
+      deadline = module->rx_gap_us;
+  }
+
+  /*
+    The ARQ and frames held for the duty cycle can only go when the e32
+    is free, AUX going high wakes us otherwise. An ack held for the duty
+    cycle waits for the budget rather than its own deadline.
+  */
+  if(dev->state == IDLE)
+  {
+    arq = dev->arq != NULL ? arq_deadline(dev->arq) : 0;
+    if(arq)
+    {
+      held = e32_duty_deadline(dev, E32_FIXED_HEADER_LENGTH + ARQ_ACK_LENGTH);
+      if(held > arq)
+        arq = held;
+    }
+    if(arq && (deadline == 0 || arq < deadline))
+      deadline = arq;
+
+    frame = queue_peek(dev->tx_queue);
+    held = frame != NULL ? e32_duty_deadline(dev, frame->len + (dev->arq != NULL ? ARQ_DATA_HEADER_LENGTH : 0)) : 0;
+    if(held && (deadline == 0 || held < deadline))
+      deadline = held;
+  }
+
+  if(deadline == dev->timer_us)
+    return 0;
+
+  memset(&its, 0, sizeof(struct itimerspec));
+  its.it_value.tv_sec = deadline / 1000000;
+  its.it_value.tv_nsec = (deadline % 1000000) * 1000;
+
+  if(timerfd_settime(dev->fd_timer, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+  {
+    errno_output("e32_timer_update: unable to set timer\n");
+    return 1;
+  }
+
+  dev->timer_us = deadline;
+  return 0;
+}
+
+/*
+  Write the frame at the head of the transmit queue to the UART. Only
+  one frame is handed to the e32 at a time, the next one is sent when
+  AUX goes back high or when pacing just before the e32 is expected to
+  be done.
+*/
+static int
+e32_poll_transmit(struct E32 *dev, struct options *opts)
+{
+  /* nothing more is written until a control request is done */
+  if(e32_control_pending(dev))
+    return e32_control_start(dev, opts);
+
+  if(dev->bond != NULL)
+    return e32_bond_transmit(dev, opts);
+
+  if(dev->burst != NULL)
+    return e32_poll_transmit_burst(dev, opts);
+
+  if(dev->state != IDLE)
+    return 0;
+
+  return e32_poll_transmit_next(dev, opts, SIZE_MAX) == -1;
+}
+
+static int
+e32_poll_timer(struct E32 *dev, struct options *opts)
+{
+  uint64_t expirations, deadline;
+
+  if(read(dev->fd_timer, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+  {
+    errno_output("e32_poll_timer: reading timer\n");
+    return 1;
+  }
+
+  dev->timer_us = 0;
+
+  if(e32_coalesce_flush(dev, e32_now_us()))
+    return 1;
+
+  if(dev->bond != NULL && e32_bond_deliver(dev, opts))
+    return 1;
+
+  deadline = e32_pace_deadline(dev, opts);
+  if(deadline && deadline <= e32_now_us() && !e32_control_pending(dev))
+  {
+    if(opts->verbose)
+      debug_output("e32_poll_timer: writing the next frame ahead of AUX\n");
+    return e32_poll_transmit_next(dev, opts, SIZE_MAX) == -1;
+  }
+
+  return 0;
+}
+
+static int
+e32_poll_gpio_aux(struct E32 *dev, struct options *opts, ssize_t *rx_buf_size)
+{
+  /* AUX pin transitioned from high->low or low->high */
+  ssize_t bytes;
+  int aux;
+
+  lseek(dev->fd_gpio_aux, 0, SEEK_SET);
+  gpio_read(dev->fd_gpio_aux, &aux);
+
+  if(dev->state == CONTROL)
+    return e32_control_aux(dev, aux);
+
+  if(dev->burst != NULL)
+    burst_aux(dev->burst, aux, e32_now_us());
+
+  if(aux == 1 && dev->state == TX)
+    e32_tx_done(dev);
+
+  if(aux == 0 && dev->state == RX && dev->rx_gap_us)
+  {
+    /* the next packet started before the gap, the one before has ended */
+    dev->rx_gap_us = 0;
+    e32_rx_drain(dev, rxbuf, rx_buf_size);
+    if(e32_write_received(dev, opts, rxbuf, *rx_buf_size))
+      err_output("e32_poll_gpio_aux: error writing outputs of a packet cut short\n");
+    *rx_buf_size = 0;
+  }
+  else if(aux == 0 && dev->state == IDLE)
+  {
+    if(dev->verbose)
+      debug_output("e32_poll_gpio_aux: transition from IDLE to RX state\n");
+
+    dev->state = RX;
+    *rx_buf_size = 0;
+  }
+  else if(aux == 1 && dev->state == RX && !dev->rx_gap_us)
+  {
+    if(dev->verbose)
+      debug_output("e32_poll_gpio_aux: transition from RX to IDLE state\n");
+
+    bytes = e32_rx_drain(dev, rxbuf, rx_buf_size);
+    if(bytes == -1)
+      return -1;
+
+    if(dev->verbose)
+      debug_output("e32_poll_gpio_aux: received %d bytes for a total of %d bytes from uart\n", bytes, *rx_buf_size);
+
+    if(e32_rx_gap_start(dev, dev, opts))
+      return 0;
+
+    if(e32_write_received(dev, opts, rxbuf, *rx_buf_size))
+      err_output("e32_poll_gpio_aux: error writing outputs after RX to IDLE transition\n");
+
+    dev->state = IDLE;
+    return e32_poll_transmit(dev, opts);
+  }
+  else if(aux == 0 && dev->state == TX)
+  {
+    if(dev->verbose)
+      debug_output("e32_poll_gpio_aux: transition from IDLE to TX state\n");
+    return e32_poll_transmit(dev, opts);
+  }
+  else if(aux == 1 && dev->state == TX)
+  {
+    if(dev->verbose)
+      debug_output("e32_poll_gpio_aux: transition from TX to IDLE state\n");
+    dev->state = IDLE;
+    return e32_poll_transmit(dev, opts);
+  }
+
+  return 0;
+}
+
+/*
+  AUX of the e32 which only receives when two are paired. It goes between
+  IDLE and RX and what it received is handled as if the tx e32 received
+  it, the tx e32 keeps transmitting on its own channel meanwhile.
+*/
+static int
+e32_poll_pair_aux(struct E32 *dev, struct options *opts, ssize_t *rx_buf_size)
+{
+  struct E32 *rx;
+  ssize_t bytes;
+  int aux;
+
+  rx = dev->rx;
+  lseek(rx->fd_gpio_aux, 0, SEEK_SET);
+  gpio_read(rx->fd_gpio_aux, &aux);
+
+  if(aux == 0 && rx->state == RX && rx->rx_gap_us)
+  {
+    rx->rx_gap_us = 0;
+    e32_rx_drain(rx, rxbuf_pair, rx_buf_size);
+    if(e32_write_received(dev, opts, rxbuf_pair, *rx_buf_size))
+      err_output("e32_poll_pair_aux: error writing outputs of a packet cut short\n");
+    *rx_buf_size = 0;
+  }
+  else if(aux == 0 && rx->state == IDLE)
+  {
+    if(dev->verbose)
+      debug_output("e32_poll_pair_aux: rx e32 transition from IDLE to RX state\n");
+
+    rx->state = RX;
+    *rx_buf_size = 0;
+  }
+  else if(aux == 1 && rx->state == RX && !rx->rx_gap_us)
+  {
+    if(dev->verbose)
+      debug_output("e32_poll_pair_aux: rx e32 transition from RX to IDLE state\n");
+
+    bytes = e32_rx_drain(rx, rxbuf_pair, rx_buf_size);
+    if(bytes == -1)
+      return 1;
+
+    if(e32_rx_gap_start(dev, rx, opts))
+      return 0;
+    rx->state = IDLE;
+
+    if(dev->verbose)
+      debug_output("e32_poll_pair_aux: received %d bytes for a total of %d bytes from the rx uart\n", bytes, *rx_buf_size);
+
+    if(e32_write_received(dev, opts, rxbuf_pair, *rx_buf_size))
+    {
+      err_output("e32_poll_pair_aux: error writing outputs after RX to IDLE transition\n");
+      return 1;
+    }
+  }
 
   return 0;
 }
 
+/*
+  AUX of a bonded e32 after the first. It transmits what it's given and
+  what it receives joins the bonded stream, the next frame is given to
+  it by the transmit in the poll loop.
+*/
 static int
-e32_poll_file(struct E32 *dev, struct options *opts, int fd_file, int *loop_continue)
+e32_poll_link_aux(struct E32 *dev, struct options *opts, int i, ssize_t *rx_buf_size)
 {
-  ssize_t bytes;
+  struct E32 *link;
+  int aux;
 
-  if(opts->verbose)
-    debug_output("reading from fd %d\n", fd_file);
+  link = dev->link[i];
+  lseek(link->fd_gpio_aux, 0, SEEK_SET);
+  gpio_read(link->fd_gpio_aux, &aux);
 
-  bytes = fread(txbuf, 1, E32_MAX_PACKET_LENGTH, opts->input_file);
+  if(aux == 1 && link->state == TX)
+  {
+    if(dev->verbose)
+      debug_output("e32_poll_link_aux: link %d transition from TX to IDLE state\n", i);
 
-  if(opts->verbose)
-    debug_output("e32_poll_file: writing %d bytes from file to uart\n", bytes);
+    e32_tx_done(link);
+    link->state = IDLE;
+  }
+  else if(aux == 0 && link->state == IDLE)
+  {
+    if(dev->verbose)
+      debug_output("e32_poll_link_aux: link %d transition from IDLE to RX state\n", i);
 
-  if(e32_transmit(dev, txbuf, bytes))
+    link->state = RX;
+    *rx_buf_size = 0;
+  }
+  else if(aux == 0 && link->state == RX && link->rx_gap_us)
   {
-    err_output("error in transmit\n");
-    return 1;
+    link->rx_gap_us = 0;
+    e32_rx_drain(link, rxbuf_link[i], rx_buf_size);
+    if(e32_write_bonded(dev, opts, i, rxbuf_link[i], *rx_buf_size))
+      err_output("e32_poll_link_aux: error writing outputs of a packet cut short\n");
+    *rx_buf_size = 0;
   }
+  else if(aux == 1 && link->state == RX && !link->rx_gap_us)
+  {
+    if(dev->verbose)
+      debug_output("e32_poll_link_aux: link %d transition from RX to IDLE state\n", i);
 
-  if(e32_write_output(dev, opts, txbuf, bytes))
-    err_output("error writing outputs\n");
+    if(e32_rx_drain(link, rxbuf_link[i], rx_buf_size) == -1)
+      return 1;
 
-  /* all bytes read from file */
-  if(bytes < E32_MAX_PACKET_LENGTH)
-  {
-    if(opts->verbose)
-      debug_output("getting out of loop\n");
-    *loop_continue = 0;
+    if(e32_rx_gap_start(dev, link, opts))
+      return 0;
+    link->state = IDLE;
+
+    if(e32_write_bonded(dev, opts, i, rxbuf_link[i], *rx_buf_size))
+    {
+      err_output("e32_poll_link_aux: error writing outputs after RX to IDLE transition\n");
+      return 1;
+    }
   }
 
   return 0;
 }
 
+/* callbacks of the event loop, the id of a uart or AUX pin is the bonded link */
 static int
-e32_poll_socket_unix_data(struct E32 *dev, struct options *opts, int fd_sockd, int *loop_continue)
+e32_on_gpio_aux(void *data, int id, uint32_t events)
 {
-  ssize_t bytes;
-  uint8_t client_err; // return to socket clients
-  struct sockaddr_un client;
-  socklen_t addrlen; // unix domain socket client address
+  struct E32Poll *poll = data;
+  return e32_poll_gpio_aux(poll->dev, poll->opts, &poll->rx_buf_size);
+}
 
-  client_err = 0;
-  addrlen = sizeof(struct sockaddr_un);
+/*
+  Whether the packet an e32 is receiving ended with its UART quiet for
+  the gap. Anything which came meanwhile is read and the gap starts over.
+*/
+static int
+e32_rx_gap_ended(struct E32 *module, uint8_t *buf, ssize_t *rx_buf_size)
+{
+  if(module == NULL || module->rx_gap_us == 0 || module->rx_gap_us > e32_now_us())
+    return 0;
 
-  bytes = recvfrom(fd_sockd, txbuf, E32_MAX_PACKET_LENGTH+1, 0, (struct sockaddr*) &client, &addrlen);
-  if(bytes == -1)
-  {
-    errno_output("error receiving from unix domain socket");
-    return 1;
-  }
-  else if(bytes > E32_MAX_PACKET_LENGTH)
-  {
-    err_output("overflow: %d > %d", bytes, E32_MAX_PACKET_LENGTH);
-    client_err++;
-  }
+  if(e32_rx_drain(module, buf, rx_buf_size) > 0)
+    return 0;
 
-  if(opts->verbose)
-  {
-    debug_output("e32_poll_socket_unix_data: received %d bytes from unix domain socket: %s\n", bytes, client.sun_path);
-  }
+  if(module->verbose)
+    debug_output("e32_rx_gap_ended: %d bytes ended %llu us after AUX\n", *rx_buf_size, (unsigned long long) (e32_now_us() - module->rx_aux_us));
 
-  // sending 0 bytes will register and we'll add to the client list
-  if(bytes == 0 && list_index_of(dev->socket_list, &client) == -1)
-  {
-    struct sockaddr_un *new_client;
-    new_client = malloc(sizeof(struct sockaddr_un));
-    memcpy(new_client, &client, sizeof(struct sockaddr_un));
-    list_add_first(dev->socket_list, new_client);
+  module->rx_gap_us = 0;
+  return 1;
+}
 
-    if(opts->verbose)
-      debug_output("e32_poll_socket_unix_data: registered client %d at %s\n", list_size(dev->socket_list), client.sun_path);
-  }
+/* deliver the packets whose gap has passed */
+static int
+e32_poll_rx_gaps(struct E32Poll *poll)
+{
+  struct E32 *dev;
+  int err;
 
-  // send back an acknowledge of 1 byte to the client
-  if(bytes == 0)
+  dev = poll->dev;
+  err = 0;
+
+  if(e32_rx_gap_ended(dev, rxbuf, &poll->rx_buf_size))
   {
-    bytes = sendto(fd_sockd, &client_err, 1, 0, (struct sockaddr*) &client, addrlen);
-    if(bytes == -1)
+    if(e32_write_received(dev, poll->opts, rxbuf, poll->rx_buf_size))
     {
-      errno_output("e32_poll_socket_unix_data: unable to send back status to unix socket");
-      return 1;
+      err_output("e32_poll_rx_gaps: error writing outputs after RX to IDLE transition\n");
+      err++;
     }
-    return 0;
-  }
 
-  if(!client_err && e32_transmit(dev, txbuf, bytes))
-  {
-    err_output("e32_poll_socket_unix_data: error in transmit\n");
-    client_err++;
+    dev->state = IDLE;
+    err += e32_poll_transmit(dev, poll->opts);
   }
 
-  if(opts->output_standard)
+  if(e32_rx_gap_ended(dev->rx, rxbuf_pair, &poll->rx_pair_size))
   {
-    info_output("e32_poll_socket_unix_data: transmitted:\n");
-    txbuf[bytes] = '\0';
-    info_output("%s", txbuf);
-    fflush(stdout);
-    info_output("\n");
+    dev->rx->state = IDLE;
+    err += e32_write_received(dev, poll->opts, rxbuf_pair, poll->rx_pair_size) != 0;
   }
 
-  bytes = sendto(fd_sockd, &client_err, 1, 0, (struct sockaddr*) &client, addrlen);
-  if(bytes == -1)
+  for(int i = 1; i < BOND_MAX_LINKS; i++)
   {
-    errno_output("e32_poll_socket_unix_data: unable to send back status to unix socket %s\n", client.sun_path);
+    if(e32_rx_gap_ended(dev->link[i], rxbuf_link[i], &poll->rx_link_size[i]))
+    {
+      dev->link[i]->state = IDLE;
+      err += e32_write_bonded(dev, poll->opts, i, rxbuf_link[i], poll->rx_link_size[i]) != 0;
+    }
   }
 
-  return client_err;
+  return err;
 }
 
 static int
-e32_poll_socket_unix_control(struct E32 *dev, struct options *opts, int fd_sockc)
+e32_on_timer(void *data, int id, uint32_t events)
 {
-  ssize_t bytes, ret_bytes;
-  uint8_t client_err; // return to socket clients
-  struct sockaddr_un client;
-  socklen_t addrlen; // unix domain socket client address
-  uint8_t *control;
+  struct E32Poll *poll = data;
+  int err;
 
-  client_err = 0;
-  /*
-     allocate memory on the heap since we have to send it
-     to other functions for a buffer
-  */
-  control = malloc(32);
-  addrlen = sizeof(struct sockaddr_un);
+  err = e32_poll_timer(poll->dev, poll->opts);
+  err += e32_poll_rx_gaps(poll);
+  err += e32_control_timer(poll->dev, poll->opts);
+  return err;
+}
 
-  bytes = recvfrom(fd_sockc, control, 32, 0, (struct sockaddr*) &client, &addrlen);
-  if(bytes == -1)
-  {
-    errno_output("e32_poll_socket_unix_control: error receiving from unix domain socket");
-    client_err = 1;
-  }
+static int
+e32_on_uart(void *data, int id, uint32_t events)
+{
+  struct E32Poll *poll = data;
 
-  debug_output("e32_poll_socket_unix_control: received %d bytes from unix domain socket: %s\n", bytes, client.sun_path);
+  if(id == 0 && poll->dev->state == CONTROL)
+    return e32_control_uart(poll->dev, poll->opts);
 
-  if(e32_set_mode(dev, SLEEP))
-  {
-    err_output("e32_poll_socket_unix_control: unable to go to sleep mode\n");
-    client_err = 2;
-  }
+  if(id == 0)
+    return e32_poll_uart(poll->dev, poll->opts, poll->dev->uart_fd, rxbuf, &poll->rx_buf_size);
 
-  if(bytes == 1 && control[0] == 's')
-  {
-    if(e32_cmd_read_settings(dev))
-      client_err = 3;
-    memcpy(control, dev->settings, sizeof(dev->settings));
-    ret_bytes = sizeof(dev->settings);
-  }
-  else if(bytes == 1 && control[0] == 'v')
-  {
-    if(e32_cmd_read_version(dev))
-      client_err = 4;
-    memcpy(control, dev->version, sizeof(dev->version));
-    ret_bytes = sizeof(dev->version);
-  }
-  else if(bytes == 6 && (control[0] == 0xC0 || control[0] == 0xC2))
-  {
-    if(e32_cmd_write_settings(dev, control))
-      client_err = 5;
-    ret_bytes = bytes;
-  }
-  else
-  {
-    err_output("received %d bytes\n", bytes);
-    for(int i=0;i<bytes;i++)
-      err_output("%02x ", control[i]);
-    err_output("\n");
-    client_err = 7;
-  }
+  return e32_poll_uart(poll->dev->link[id], poll->opts, poll->dev->link[id]->uart_fd, rxbuf_link[id], &poll->rx_link_size[id]);
+}
 
-  if(!client_err)
-  {
-    //dev->state = CONTROL;
-    if(opts->verbose)
-    {
-      for(int i=0;i<bytes;i++)
-        debug_output("%02x", control[i]);
-      debug_output("\n");
-    }
+static int
+e32_on_pair_aux(void *data, int id, uint32_t events)
+{
+  struct E32Poll *poll = data;
+  return e32_poll_pair_aux(poll->dev, poll->opts, &poll->rx_pair_size);
+}
 
-    // TODO should we write standard output and verbose?
-    if(opts->output_standard)
-    {
-      txbuf[bytes] = '\0';
-      info_output("%s", txbuf);
-      fflush(stdout);
-    }
-  }
+static int
+e32_on_pair_uart(void *data, int id, uint32_t events)
+{
+  struct E32Poll *poll = data;
+  return e32_poll_uart(poll->dev->rx, poll->opts, poll->dev->rx->uart_fd, rxbuf_pair, &poll->rx_pair_size);
+}
 
-  if(e32_set_mode(dev, NORMAL))
-  {
-    err_output("e32_poll_socket_unix_control: unable to go to normal mode\n");
-    client_err = 8;
-  }
+static int
+e32_on_link_aux(void *data, int id, uint32_t events)
+{
+  struct E32Poll *poll = data;
+  return e32_poll_link_aux(poll->dev, poll->opts, id, &poll->rx_link_size[id]);
+}
 
-  if(client_err)
-  {
-    err_output("e32_poll_socket_unix_control: client error %d\n", client_err);
-    ret_bytes = 1;
-    control[0] = client_err;
-  }
+static int
+e32_on_stdin(void *data, int id, uint32_t events)
+{
+  struct E32Poll *poll = data;
+  return e32_poll_stdin(poll->dev, poll->opts, fileno(stdin), &poll->input);
+}
 
-  bytes = sendto(fd_sockc, control, ret_bytes, 0, (struct sockaddr*) &client, addrlen);
-  if(bytes == -1)
-    errno_output("e32_poll_socket_unix_control: unable to send back status to unix socket");
-  else if(opts->verbose && opts->output_standard)
-  {
-    debug_output("writing back %d bytes to unix domain socket: %s\n", ret_bytes, client.sun_path);
-    for(int i=0;i<ret_bytes;i++)
-      debug_output("%02x", control[i]);
-    debug_output("\n");
-  }
+static int
+e32_on_file(void *data, int id, uint32_t events)
+{
+  struct E32Poll *poll = data;
+  return e32_poll_file(poll->dev, poll->opts, fileno(poll->opts->input_file), &poll->input);
+}
 
-  /*
-    functions to read the settings and version will set the tty
-    to have a timeout. After this function returns we need to
-    set it back to a polling read. If the tcflush call isn't there
-    the poll loop will detect the uart can be read and when we
-    read it then it will have an invalid address. Once this happens
-    we get into an infinite loop of the UART being ready but
-    have an error when reading it.
-  */
-  tty_set_read_polling(dev->uart_fd, &dev->tty);
-  tcflush(dev->uart_fd, TCIFLUSH);
+static int
+e32_on_socket_unix_data(void *data, int id, uint32_t events)
+{
+  struct E32Poll *poll = data;
+  return e32_poll_socket_unix_data(poll->dev, poll->opts, poll->opts->fd_socket_unix_data, &poll->input);
+}
 
-  free(control);
-  return client_err;
+static int
+e32_on_tun(void *data, int id, uint32_t events)
+{
+  struct E32Poll *poll = data;
+  return e32_poll_tun(poll->dev, poll->opts);
 }
 
 static int
-e32_poll_gpio_aux(struct E32 *dev, struct options *opts, struct pollfd pfd[], ssize_t *rx_buf_size)
+e32_on_socket_udp(void *data, int id, uint32_t events)
 {
-  /* AUX pin transitioned from high->low or low->high */
-  ssize_t bytes;
-  int aux;
+  struct E32Poll *poll = data;
+  return e32_poll_socket_udp(poll->dev, poll->opts);
+}
 
-  lseek(dev->fd_gpio_aux, 0, SEEK_SET);
-  gpio_read(dev->fd_gpio_aux, &aux);
+static int
+e32_on_socket_unix_control(void *data, int id, uint32_t events)
+{
+  struct E32Poll *poll = data;
+  return e32_poll_socket_unix_control(poll->dev, poll->opts, poll->opts->fd_socket_unix_control);
+}
 
-  if(aux == 0 && dev->state == IDLE)
-  {
-    if(dev->verbose)
-      debug_output("e32_poll_gpio_aux: transition from IDLE to RX state\n");
+static int
+e32_on_session_accept(void *data, int id, uint32_t events);
 
-    dev->state = RX;
-    *rx_buf_size = 0;
-    e32_poll_input_disable(opts, pfd);
-  }
-  else if(aux == 1 && dev->state == RX)
-  {
-    if(dev->verbose)
-      debug_output("e32_poll_gpio_aux: transition from RX to IDLE state\n");
+static int
+e32_on_session(void *data, int fd, uint32_t events)
+{
+  struct E32Poll *poll = data;
+  return e32_poll_session(poll->dev, poll->opts, &poll->loop, fd);
+}
 
-    if(opts->aux_transition_additional_delay)
-    {
-      if(dev->verbose)
-        debug_output("e32_poll_gpio_aux: additional sleep for uart buffered data\n");
-      usleep(54000);
-    }
+static int
+e32_on_session_accept(void *data, int id, uint32_t events)
+{
+  struct E32Poll *poll = data;
+  return e32_session_accept(poll->dev, poll->opts, &poll->loop, e32_on_session, poll);
+}
 
-    bytes = read(pfd[PFD_UART].fd, rxbuf+(*rx_buf_size), RX_BUF_BYTES);
-    if(bytes == -1)
-    {
-      errno_output("e32_poll_gpio_aux: error reading from uart\n");
-      return -1;
-    }
+/* stop the loop, whoever called e32_poll cleans up outside of a signal handler */
+static int
+e32_on_signal(void *data, int signo, uint32_t events)
+{
+  struct E32Poll *poll = data;
 
-    *rx_buf_size += bytes;
+  if(poll->opts->daemon)
+    info_output("daemon stopping pid=%d sig=%d", getpid(), signo);
 
-    if(dev->verbose)
-      debug_output("e32_poll_gpio_aux: received %d bytes for a total of %d bytes from uart\n", bytes, *rx_buf_size);
+  poll->stop = 1;
+  return 0;
+}
 
-    if(e32_write_output(dev, opts, rxbuf, *rx_buf_size))
-      err_output("e32_poll_gpio_aux: error writing outputs after RX to IDLE transition\n");
+/*
+  Register everything the loop waits on. The callbacks of what's ready
+  run in this order, AUX before the uart so a new packet starts before
+  its bytes are read.
+*/
+static int
+e32_poll_register(struct E32Poll *poll)
+{
+  struct E32 *dev;
+  struct options *opts;
+  struct Loop *loop;
+  int err;
 
-    dev->state = IDLE;
-    e32_poll_input_enable(opts, pfd);
+  dev = poll->dev;
+  opts = poll->opts;
+  loop = &poll->loop;
+
+  if(loop_init(loop))
+  {
+    errno_output("e32_poll_register: unable to create the event loop\n");
+    return 1;
   }
-  else if(aux == 0 && dev->state == TX)
+
+  err = loop_add(loop, dev->fd_gpio_aux, EPOLLPRI, e32_on_gpio_aux, poll, 0);
+  if(dev->fd_timer != -1)
+    err |= loop_add(loop, dev->fd_timer, EPOLLIN, e32_on_timer, poll, 0);
+  err |= loop_add(loop, dev->uart_fd, EPOLLIN, e32_on_uart, poll, 0);
+
+  if(dev->rx != NULL)
   {
-    if(dev->verbose)
-      debug_output("e32_poll_gpio_aux: transition from IDLE to TX state\n");
-    e32_poll_input_disable(opts, pfd);
+    err |= loop_add(loop, dev->rx->fd_gpio_aux, EPOLLPRI, e32_on_pair_aux, poll, 0);
+    err |= loop_add(loop, dev->rx->uart_fd, EPOLLIN, e32_on_pair_uart, poll, 0);
   }
-  else if(aux == 1 && dev->state == TX)
+
+  for(int i = 1; i < BOND_MAX_LINKS; i++)
   {
-    if(dev->verbose)
-      debug_output("e32_poll_gpio_aux: transition from TX to IDLE state\n");
-    dev->state = IDLE;
-    e32_poll_input_enable(opts, pfd);
+    if(dev->link[i] == NULL)
+      continue;
+    err |= loop_add(loop, dev->link[i]->fd_gpio_aux, EPOLLPRI, e32_on_link_aux, poll, i);
+    err |= loop_add(loop, dev->link[i]->uart_fd, EPOLLIN, e32_on_uart, poll, i);
+  }
+
+  if(opts->input_standard)
+    err |= loop_add(loop, fileno(stdin), EPOLLIN, e32_on_stdin, poll, 0);
+  if(opts->input_file)
+    err |= loop_add(loop, fileno(opts->input_file), EPOLLIN, e32_on_file, poll, 0);
+  if(opts->fd_socket_unix_data != -1)
+    err |= loop_add(loop, opts->fd_socket_unix_data, EPOLLIN, e32_on_socket_unix_data, poll, 0);
+  if(opts->fd_socket_unix_control != -1)
+    err |= loop_add(loop, opts->fd_socket_unix_control, EPOLLIN, e32_on_socket_unix_control, poll, 0);
+  if(opts->fd_socket_unix_seqpacket != -1)
+    err |= loop_add(loop, opts->fd_socket_unix_seqpacket, EPOLLIN, e32_on_session_accept, poll, 0);
+  if(opts->udp_listen)
+    err |= loop_add(loop, opts->fd_socket_udp, EPOLLIN, e32_on_socket_udp, poll, 0);
+  if(opts->fd_tun != -1)
+    err |= loop_add(loop, opts->fd_tun, EPOLLIN, e32_on_tun, poll, 0);
+
+  if(poll->fd_signal != -1)
+    err |= loop_signal_fd(loop, poll->fd_signal);
+  err |= loop_signal(loop, SIGINT, e32_on_signal, poll);
+  err |= loop_signal(loop, SIGTERM, e32_on_signal, poll);
+
+  if(err)
+  {
+    errno_output("e32_poll_register: unable to register with the event loop\n");
+    loop_destroy(loop);
+    return 1;
   }
 
   return 0;
@@ -1232,85 +4676,84 @@ State Machine
  we go into the TX state. In both the TX and RX state we don't go back into IDLE unless AUX
  transitions back to high.
 
+Event Loop
+ Everything is waited on with epoll through loop.c. Each input, uart, AUX pin and the timer is
+ registered once with a callback and the inputs are enabled and disabled as their quota of the
+ queue allows. SIGINT and SIGTERM come through a signalfd and stop the loop so cleanup happens
+ outside of a signal handler. main blocks them and makes the signalfd before it touches the e32,
+ so a signal while starting up is held until the loop takes it.
+
+Paired e32 modules
+ With a second e32 given by --rx-tty it does all the receiving on its own channel and the first
+ one only transmits. The second one has its own AUX pin and UART in the poll and its own
+ IDLE -> RX -> IDLE states, so a transmit never waits for a receive to finish.
+
+Bonded e32 modules
+ With --bond each extra e32 is polled the same way with its own states. A frame is taken off the
+ queue for whichever e32 would finish it first, and received packets are put back in order
+ before they're written out.
+
+Transmit Queue
+ Inputs don't write to the UART directly. They push frames onto the transmit queue and keep
+ being read while in the TX or RX state until their quota of the queue is used. A frame is
+ taken off the queue when we're IDLE and when AUX transitions back high, so the e32 has the
+ next frame as soon as it's finished with the last one.
 
 */
 size_t
-e32_poll(struct E32 *dev, struct options *opts)
+e32_poll(struct E32 *dev, struct options *opts, int fd_signal)
 {
-  ssize_t rx_buf_size;
-  int ret, loop;
+  struct E32Poll poll;
+  int ret, timeout;
   size_t errors;
 
-  /* used in our poll loop */
-  struct pollfd pfd[6];
+  e32_poll_init(dev, opts);
+
+  memset(&poll, 0, sizeof(struct E32Poll));
+  poll.dev = dev;
+  poll.opts = opts;
+  poll.input = 1;
+  poll.fd_signal = fd_signal;
 
-  e32_poll_init(dev, opts, pfd);
+  if(e32_poll_register(&poll))
+    return 1;
 
   errors = 0;
-  loop = 1;
-  rx_buf_size = 0;
-  enum E32_state prev_state;
 
-  while(loop)
+  /* once an input is exhausted keep going until the queue is drained */
+  while(!poll.stop && (poll.input || queue_size(dev->tx_queue) > 0 || e32_coalesce_deadline(dev) ||
+      (dev->arq != NULL && arq_outstanding(dev->arq) > 0) || e32_control_pending(dev)))
   {
-    ret = poll(pfd, 6, -1);
-    if(ret == 0)
-    {
-      err_output("poll timed out\n");
-      return -1;
-    }
-    else if (ret < 0)
-    {
-      errno_output("poll");
-      return ret;
-    }
-
-    prev_state = dev->state;
-
-    if(pfd[PFD_GPIO_AUX].revents & POLLPRI)
-    {
-      errors += e32_poll_gpio_aux(dev, opts, pfd, &rx_buf_size);
-    }
-
-    if(pfd[PFD_UART].revents & POLLIN)
-    {
-      errors+= e32_poll_uart(dev, opts, pfd[PFD_UART].fd, &rx_buf_size);
-    }
-
-    if(pfd[PFD_STDIN].revents & POLLIN)
-    {
-      errors += e32_poll_stdin(dev, pfd[PFD_STDIN].fd, &loop);
-    }
-
-    if(pfd[PFD_INPUT_FILE].revents & POLLIN)
-    {
-      errors += e32_poll_file(dev, opts, pfd[PFD_INPUT_FILE].fd, &loop);
-    }
-
-    if(pfd[PFD_SOCKET_UNIX_DATA].revents & POLLIN)
+    if(poll.input)
+      e32_poll_input_enable(dev, opts, &poll.loop);
+    else
     {
-      errors += e32_poll_socket_unix_data(dev, opts, pfd[PFD_SOCKET_UNIX_DATA].fd, &loop);
+      e32_poll_input_disable(opts, &poll.loop);
+      errors += e32_coalesce_flush(dev, UINT64_MAX);
     }
 
-    if( pfd[PFD_SOCKET_UNIX_CONTROL].revents & POLLIN)
+    timeout = e32_poll_timeout(dev);
+    ret = loop_run(&poll.loop, timeout);
+    if(ret < 0)
     {
-      errors += e32_poll_socket_unix_control(dev, opts, pfd[PFD_SOCKET_UNIX_CONTROL].fd);
+      errno_output("e32_poll: waiting for events\n");
+      errors++;
+      break;
     }
+    errors += ret;
 
     /*
-      Take a situation where we are transferring a file.
-      This file will be ready for reading much faster than can
-      transmit it's bytes. So we'll first read bytes into the buffer
-      and transmit them. Before the AUX pin can go low we can do this
-      many times. Hence we need to disable inputs until the AUX pin
-      goes back high and then they will be enabled. This logic to
-      disable reading more input before the AUX pin can react.
+      Take a situation where we are transferring a file. The file
+      will be ready for reading much faster than we can transmit its
+      bytes. Reading only fills the queue up to the quota for the file,
+      if we're idle kick off the first frame and the rest are sent as
+      AUX transitions back high.
     */
-    if(prev_state == IDLE && dev->state == TX)
-    {
-      e32_poll_input_disable(opts, pfd);
-    }
+    errors += e32_poll_transmit(dev, opts);
+    errors += e32_timer_update(dev, opts);
+    e32_session_grant(dev, opts);
   }
 
+  loop_destroy(&poll.loop);
   return errors;
 }
@@ -1,14 +1,30 @@
 #ifndef E32_DEF
 #define E32_DEF
 
+#include "config.h"
 #include <assert.h>
 #include <poll.h>
+#include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <termios.h>
 #include "options.h"
 #include "gpio.h"
 #include "uart.h"
-#include "list.h"
+#include "airtime.h"
+#include "arq.h"
+#include "bond.h"
+#include "burst.h"
+#include "compress.h"
+#include "duty.h"
+#include "fountain.h"
+#include "loop.h"
+#include "frame.h"
+#include "iphc.h"
+#include "queue.h"
+#include "registry.h"
+#include "udp.h"
 
 /*
  The e32 has a TX buffer of 512 bytes but how the implemented it's usage
@@ -25,9 +41,116 @@
 */
 #define E32_MAX_PACKET_LENGTH 58
 
-#define TX_BUF_BYTES 512
+/*
+ Some UARTs hand over what the e32 received in chunks, so the end of it
+ can still be on its way after AUX goes high. Once a UART has been seen
+ doing that a packet ends when nothing more has arrived for a gap of
+ E32_RX_GAP_CHARS characters at the UART baud rate, and at least
+ E32_RX_GAP_MIN_US for the kernel to pass on what the UART has.
+
+ A UART is taken to do that once a read returns more than 1 byte, which
+ sets aux_transition_additional_delay. Until then, or without a timer,
+ a packet ends as soon as AUX goes high.
+*/
+#define E32_RX_GAP_CHARS 8
+#define E32_RX_GAP_MIN_US 4000
+
+/*
+ AUX is low while the e32 changes mode, carries out a command or saves
+ its settings, and goes high when it's done. It may not have gone low
+ yet when we look, so it's given E32_AUX_LOW_MS to. The e32 wants
+ E32_AUX_SETTLE_US more after AUX goes high. The timeouts are only in
+ case AUX never does.
+*/
+#define E32_AUX_LOW_MS 3
+#define E32_AUX_SETTLE_US 2000
+#define E32_MODE_TIMEOUT_MS 100
+#define E32_CMD_TIMEOUT_MS 100
+#define E32_WRITE_TIMEOUT_MS 1000
+#define E32_RESET_TIMEOUT_MS 1000
+
+/*
+ With framing enabled messages up to this length are accepted and split
+ into fragments which are reassembled by the receiving e32.
+*/
+#define E32_MAX_MESSAGE_LENGTH 16384
+
+/*
+ In fixed transmission mode every packet written to the e32 starts with
+ the address and channel it's for, which the e32 takes off. The address
+ of the sender follows so the receiver knows who it's from. Data from
+ stdin or a file is broadcast on the channel of the e32.
+*/
+#define E32_FIXED_DEST_LENGTH 3
+#define E32_FIXED_SOURCE_LENGTH 2
+#define E32_FIXED_HEADER_LENGTH (E32_FIXED_DEST_LENGTH+E32_FIXED_SOURCE_LENGTH)
+#define E32_BROADCAST_ADDRESS 0xFFFF
+
+/* a message with a class and destination prefix and room for a terminator */
+#define TX_BUF_BYTES (E32_MAX_MESSAGE_LENGTH+E32_FIXED_DEST_LENGTH+2)
 #define RX_BUF_BYTES 512
 
+/*
+ In burst mode more than a packet is kept in the TX buffer of the e32
+ while it's transmitting. How much can be written safely is found by
+ writing increasing amounts and timing how long AUX stays low. If the
+ e32 dropped data it finishes early. That puts test data on the air so
+ it's only done when asked for, otherwise the chunk given is used or
+ E32_BURST_CHUNK, a packet and the next one, which the TX buffer of
+ every e32 holds.
+*/
+#define E32_MODULE_TX_BUFFER 512
+#define E32_BURST_CHUNK (2*E32_MAX_PACKET_LENGTH)
+#define E32_BURST_MIN_PERCENT 80
+#define E32_AUX_TIMEOUT_MS 1000
+
+/*
+ When pacing, the next frame is written this long plus its UART time
+ before the e32 is expected to finish the frame it has, so it's in the
+ buffer the moment the e32 frees up.
+*/
+#define E32_PACE_MARGIN_US 2000
+
+/*
+ With --reliable the ARQ timeouts start from the time on air of a full
+ packet. The turnaround covers the e32 switching from RX to TX and the
+ reads after AUX goes high, without an air time model a packet is
+ taken to be on air for a second.
+*/
+#define E32_ARQ_TURNAROUND_US 200000
+#define E32_ARQ_DEFAULT_PACKET_US 1000000
+
+/*
+ With bonding a gap in the stream is waited on for this many packets
+ on the slowest link before it's taken as lost.
+*/
+#define E32_BOND_REORDER_PACKETS 4
+
+/*
+ Frames waiting for the radio are held in a ring and one is written
+ to the UART each time AUX goes high. Each input has its own quota
+ of the ring, when it's used up only that input stops being polled
+ so a busy client doesn't block the others.
+*/
+#define E32_TX_QUEUE_FRAMES 1024
+#define E32_TX_QUOTA_STDIN 8
+#define E32_TX_QUOTA_FILE 8
+#define E32_TX_QUOTA_SOCKET_UNIX_DATA 896
+#define E32_TX_QUOTA_SOCKET_UNIX_SESSION 896
+#define E32_TX_QUOTA_SOCKET_UDP 896
+#define E32_TX_QUOTA_TUN 128
+
+/*
+ The class each input is sent in unless a socket client asked for
+ another, a file is a bulk transfer which anything else preempts.
+*/
+#define E32_CLASS_STDIN QUEUE_CLASS_NORMAL
+#define E32_CLASS_FILE QUEUE_CLASS_BULK
+#define E32_CLASS_SOCKET_UNIX_DATA QUEUE_CLASS_NORMAL
+#define E32_CLASS_SOCKET_UDP QUEUE_CLASS_NORMAL
+#define E32_CLASS_TUN QUEUE_CLASS_NORMAL
+#define E32_CLASS_SOCKET_UNIX_SESSION QUEUE_CLASS_NORMAL
+
 enum E32_mode
 {
   NORMAL,
@@ -40,7 +163,198 @@ enum E32_state
 {
   IDLE,
   RX,
-  TX
+  TX,
+  CONTROL
+};
+
+/*
+ With coalescing, small messages from a client are packed into a packet
+ as records. The packet is queued when it's full or when the first
+ message in it has waited the deadline. A packet is open for each of
+ the most recent clients, the oldest is queued to make room for a new
+ one.
+*/
+#define E32_COALESCE_PACKETS 16
+
+struct E32Coalesce
+{
+  int used;
+  enum QueueSource source;
+  enum QueueClass class;
+  int channel;
+  char client[QUEUE_FLOW_NAME];
+  uint8_t packet[E32_MAX_PACKET_LENGTH];
+  size_t header_len;
+  size_t len;
+  int records;
+  uint64_t deadline_us;
+};
+
+/*
+ With --fountain the input file is read whole and broadcast as erasure
+ coded symbols, the source symbols then the given percent more repair
+ symbols. A receiver keeps one transfer at a time.
+*/
+struct E32FountainTx
+{
+  uint8_t id;
+  uint8_t *file;
+  struct FountainEncoder enc;
+  size_t next;
+  size_t total;
+};
+
+struct E32FountainRx
+{
+  uint16_t source;
+  uint8_t id;
+  size_t len;
+  size_t symbols;
+  struct FountainDecoder dec;
+};
+
+/*
+ With --tx-notify each message from the data socket gets a sequence
+ number. The reply to the datagram is E32_NOTIFY_QUEUED, the status and
+ the sequence number, so a client can keep sending without waiting for
+ it. The last frame of the message carries the sequence number through
+ the transmit queue and once AUX goes high after it was written the
+ client is sent E32_NOTIFY_DONE, the sequence number, the microseconds
+ it waited to be written to the e32 and the microseconds the e32 took
+ to send it, all big endian.
+
+ Messages waiting are kept in a table by sequence number which is
+ larger than the quota of the data socket, a message is refused if its
+ place is still taken.
+*/
+#define E32_NOTIFY_SLOTS 1024
+#define E32_NOTIFY_QUEUED 'Q'
+#define E32_NOTIFY_DONE 'T'
+#define E32_NOTIFY_QUEUED_LENGTH 6
+#define E32_NOTIFY_DONE_LENGTH 14
+
+enum E32NotifyState
+{
+  E32_NOTIFY_FREE,
+  E32_NOTIFY_WAITING,
+  E32_NOTIFY_WRITTEN
+};
+
+struct E32Notify
+{
+  enum E32NotifyState state;
+  uint32_t seq;
+  struct sockaddr_un addr;
+  uint64_t queued_us;
+  uint64_t written_us;
+};
+
+struct E32Notifier
+{
+  int fd;
+  uint32_t seq;
+  struct E32Notify slots[E32_NOTIFY_SLOTS];
+  uint32_t written[E32_NOTIFY_SLOTS];
+  size_t nwritten;
+};
+
+/*
+ Datagrams on the data socket are read and answered in batches with
+ recvmmsg and sendmmsg, up to E32_SOCKET_RECV_BATCH datagrams as the
+ transmit queue has room for. What's received over the air goes out to
+ the registered clients with registry_send.
+*/
+#define E32_SOCKET_RECV_BATCH 16
+
+struct E32SocketBatch
+{
+  struct mmsghdr msgs[E32_SOCKET_RECV_BATCH];
+  struct RegistryBatch send;
+  struct iovec iov[E32_SOCKET_RECV_BATCH];
+  struct sockaddr_un addrs[E32_SOCKET_RECV_BATCH];
+  uint8_t status[E32_SOCKET_RECV_BATCH][E32_NOTIFY_QUEUED_LENGTH];
+  uint8_t bufs[E32_SOCKET_RECV_BATCH][TX_BUF_BYTES];
+};
+
+/*
+ Each connection to the seqpacket data socket is a session. A session is
+ granted credits, frames of the transmit queue it may fill, and a
+ message needing more frames than it has left is refused. Credits are
+ reserved in the transmit queue out of the quota for sessions, each
+ session up to a fair share of it and about E32_SESSION_BACKLOG_MS on
+ air, so a producer can keep the radio busy without a long backlog.
+
+ Every record the daemon sends starts with its type. The hello has the
+ session id and the data a frame holds, a message up to the first
+ takes 1 frame and a longer one takes its length over the second
+ rounded up. A credit has the frames granted, data what was received
+ as on the datagram socket and an error the status of a refused
+ message.
+*/
+#define E32_MAX_SESSIONS 32
+#define E32_SESSION_BACKLOG_MS 5000
+#define E32_SESSION_HELLO 'S'
+#define E32_SESSION_CREDIT 'C'
+#define E32_SESSION_DATA 'D'
+#define E32_SESSION_ERROR 'E'
+
+struct E32Session
+{
+  int fd;
+  uint32_t id;
+  int closed;
+  size_t credits;
+  char name[QUEUE_FLOW_NAME];
+};
+
+/*
+ Requests on the control socket which need the e32 in sleep mode,
+ reading its settings or version and writing settings, are queued and
+ carried out a step at a time from the event loop once the e32 is idle,
+ so receiving, the sockets and timers carry on in between. Each step
+ waits for AUX or a reply from the e32 with a deadline on the timer. A
+ request the same as one waiting, with no write between them, is
+ answered along with it. The settings and version are read once and
+ kept until they're written or the e32 is reset, a request for them is
+ answered from what was kept unless it asks for them to be read again.
+*/
+#define E32_CONTROL_REQUESTS 8
+#define E32_CONTROL_CLIENTS 8
+#define E32_CONTROL_BUSY 12
+
+enum E32ControlStep
+{
+  E32_CONTROL_NONE,
+  E32_CONTROL_SLEEP,
+  E32_CONTROL_REPLY,
+  E32_CONTROL_SAVE,
+  E32_CONTROL_DONE,
+  E32_CONTROL_NORMAL
+};
+
+struct E32ControlRequest
+{
+  uint8_t cmd[6];
+  size_t len;
+  size_t nclients;
+  struct sockaddr_un clients[E32_CONTROL_CLIENTS];
+};
+
+struct E32Control
+{
+  int fd;
+  struct E32ControlRequest requests[E32_CONTROL_REQUESTS];
+  size_t head;
+  size_t size;
+  enum E32ControlStep step;
+  uint8_t err;
+  uint8_t reply[6];
+  size_t reply_len;
+  size_t reply_expected;
+  uint64_t begin_us;
+  uint64_t start_us;
+  uint64_t timeout_us;
+  uint64_t deadline_us;
 };
 
 struct E32
@@ -57,6 +371,8 @@ struct E32
   int mode;
   uint8_t version[4];
   uint8_t settings[6];
+  int version_cached;
+  int settings_cached;
   int frequency_mhz;
   int frequency_min_mhz;
   int frequency_max_mhz;
@@ -75,7 +391,63 @@ struct E32
   int wireless_wakeup_time;
   int fec;
   int tx_power_attn_dbm;
-  struct List *socket_list;
+  struct Registry *clients;
+  struct Queue *tx_queue;
+  uint8_t frame_id;
+  struct FrameReassembly *reassembly;
+  size_t burst_chunk;
+  uint64_t burst_us_per_byte;
+  struct Burst *burst;
+  struct Airtime airtime;
+  int fd_timer;
+  uint64_t tx_start_us;
+  uint64_t tx_done_us;
+  size_t tx_len;
+  int tx_frames;
+  uint64_t timer_us;
+  uint64_t rx_aux_us;
+  uint64_t rx_gap_us;
+  uint64_t settle_us;
+  uint64_t settle_max_us;
+  const struct Codec *codec;
+  struct Dictionary dictionary;
+  size_t compress_in;
+  size_t compress_out;
+  uint64_t coalesce_us;
+  struct E32Coalesce coalesce[E32_COALESCE_PACKETS];
+  struct Arq *arq;
+  uint8_t arq_peer[E32_FIXED_SOURCE_LENGTH];
+  struct E32FountainTx *fountain_tx;
+  struct E32FountainRx *fountain_rx;
+  struct Duty *duty;
+  struct E32SocketBatch *socket_batch;
+  struct E32 *rx;
+  struct Bond *bond;
+  struct E32 *link[BOND_MAX_LINKS];
+  struct E32Session *sessions;
+  size_t nsessions;
+  uint32_t session_id;
+  struct E32Notifier *notify;
+  struct UdpBatch *udp_batch;
+  struct IphcContext iphc;
+  struct E32Control *control;
+};
+
+/*
+ What the callbacks of the event loop in e32_poll need. Each e32 driven
+ along with this one has its own count of bytes read while receiving.
+*/
+struct E32Poll
+{
+  struct E32 *dev;
+  struct options *opts;
+  struct Loop loop;
+  int input;
+  int stop;
+  int fd_signal;
+  ssize_t rx_buf_size;
+  ssize_t rx_pair_size;
+  ssize_t rx_link_size[BOND_MAX_LINKS];
 };
 
 int
@@ -108,9 +480,24 @@ e32_print_version(struct E32 *dev);
 int
 e32_cmd_reset(struct E32 *dev);
 
+int
+e32_pair_setup(struct E32 *dev);
+
+int
+e32_bond_setup(struct E32 *dev);
+
 int
 e32_cmd_write_settings(struct E32 *dev, uint8_t *settings);
 
+int
+e32_burst_characterize(struct E32 *dev);
+
+int
+e32_burst_pacing(struct E32 *dev, size_t chunk);
+
+void
+e32_print_burst(struct E32 *dev);
+
 ssize_t
 e32_transmit(struct E32 *dev, uint8_t *buf, size_t buf_len);
 
@@ -118,6 +505,6 @@ int
 e32_receive(struct E32 *dev, uint8_t *buf, size_t buf_len);
 
 size_t
-e32_poll(struct E32 *dev, struct options *opts);
+e32_poll(struct E32 *dev, struct options *opts, int fd_signal);
 
 #endif
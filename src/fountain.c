@@ -0,0 +1,259 @@
+#include "fountain.h"
+
+/* GF(256) with the polynomial x^8+x^4+x^3+x^2+1 */
+#define FOUNTAIN_GF_POLY 0x11D
+
+static uint8_t gf_mul[256][256];
+static uint8_t gf_inv[256];
+static int gf_ready;
+
+static void
+fountain_gf_init()
+{
+  uint8_t exp[255];
+  int log[256];
+  unsigned int x;
+
+  if(gf_ready)
+    return;
+
+  x = 1;
+  for(int i = 0; i < 255; i++)
+  {
+    exp[i] = x;
+    log[x] = i;
+    x <<= 1;
+    if(x & 0x100)
+      x ^= FOUNTAIN_GF_POLY;
+  }
+
+  for(int a = 1; a < 256; a++)
+  {
+    for(int b = 1; b < 256; b++)
+      gf_mul[a][b] = exp[(log[a] + log[b]) % 255];
+    gf_inv[a] = exp[(255 - log[a]) % 255];
+  }
+
+  gf_ready = 1;
+}
+
+/*
+  dst += c * src, all of the coding comes down to this. A row of the
+  multiplication table keeps it to a lookup and an xor for each byte.
+*/
+static void
+fountain_mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+  const uint8_t *row;
+
+  if(c == 0)
+    return;
+
+  if(c == 1)
+  {
+    for(size_t i = 0; i < len; i++)
+      dst[i] ^= src[i];
+    return;
+  }
+
+  row = gf_mul[c];
+  for(size_t i = 0; i < len; i++)
+    dst[i] ^= row[src[i]];
+}
+
+/* dst *= c */
+static void
+fountain_mul(uint8_t *dst, uint8_t c, size_t len)
+{
+  const uint8_t *row;
+
+  row = gf_mul[c];
+  for(size_t i = 0; i < len; i++)
+    dst[i] = row[dst[i]];
+}
+
+/*
+  A source symbol has a single coefficient of 1, a repair symbol has
+  coefficients from a xorshift generator seeded with its id.
+*/
+static void
+fountain_coefficients(uint16_t id, size_t symbols, uint8_t *coefficients)
+{
+  uint32_t state;
+
+  memset(coefficients, 0, symbols);
+  if(id < symbols)
+  {
+    coefficients[id] = 1;
+    return;
+  }
+
+  state = 0x9E3779B9 ^ ((uint32_t) id * 0x85EBCA6B);
+  if(state == 0)
+    state = 1;
+
+  for(size_t i = 0; i < symbols; i++)
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    coefficients[i] = state >> 24;
+  }
+}
+
+/* the number of source symbols a file is split into */
+size_t
+fountain_symbols(size_t len, size_t symbol_len)
+{
+  if(symbol_len == 0)
+    return 0;
+  return (len + symbol_len - 1) / symbol_len;
+}
+
+/* returns -1 if the file is empty or needs too many symbols */
+int
+fountain_encoder_init(struct FountainEncoder *enc, const uint8_t *data, size_t len, size_t symbol_len)
+{
+  fountain_gf_init();
+
+  enc->data = data;
+  enc->len = len;
+  enc->symbol_len = symbol_len;
+  enc->symbols = fountain_symbols(len, symbol_len);
+
+  if(enc->symbols == 0 || enc->symbols > FOUNTAIN_MAX_SYMBOLS)
+    return -1;
+  return 0;
+}
+
+/* write symbol id, symbol_len bytes */
+void
+fountain_encode(struct FountainEncoder *enc, uint16_t id, uint8_t *symbol)
+{
+  uint8_t coefficients[FOUNTAIN_MAX_SYMBOLS];
+  size_t offset, len;
+
+  fountain_coefficients(id, enc->symbols, coefficients);
+  memset(symbol, 0, enc->symbol_len);
+
+  for(size_t i = 0; i < enc->symbols; i++)
+  {
+    offset = i * enc->symbol_len;
+    len = enc->len - offset < enc->symbol_len ? enc->len - offset : enc->symbol_len;
+    fountain_mul_add(symbol, enc->data + offset, coefficients[i], len);
+  }
+}
+
+int
+fountain_decoder_init(struct FountainDecoder *dec, size_t len, size_t symbol_len)
+{
+  fountain_gf_init();
+
+  memset(dec, 0, sizeof(struct FountainDecoder));
+  dec->len = len;
+  dec->symbol_len = symbol_len;
+  dec->symbols = fountain_symbols(len, symbol_len);
+
+  if(dec->symbols == 0 || dec->symbols > FOUNTAIN_MAX_SYMBOLS)
+    return -1;
+
+  dec->coefficients = calloc(dec->symbols, dec->symbols);
+  dec->rows = calloc(dec->symbols, symbol_len);
+  dec->pivots = calloc(dec->symbols, 1);
+  dec->vector = calloc(dec->symbols, 1);
+  dec->symbol = calloc(symbol_len, 1);
+
+  if(dec->coefficients == NULL || dec->rows == NULL || dec->pivots == NULL ||
+      dec->vector == NULL || dec->symbol == NULL)
+  {
+    fountain_decoder_destroy(dec);
+    return -1;
+  }
+
+  return 0;
+}
+
+void
+fountain_decoder_destroy(struct FountainDecoder *dec)
+{
+  free(dec->coefficients);
+  free(dec->rows);
+  free(dec->pivots);
+  free(dec->vector);
+  free(dec->symbol);
+  memset(dec, 0, sizeof(struct FountainDecoder));
+}
+
+/* once every row has a pivot, eliminate from the last row up */
+static void
+fountain_back_substitute(struct FountainDecoder *dec)
+{
+  size_t k, b;
+
+  k = dec->symbols;
+  b = dec->symbol_len;
+  for(size_t p = k; p-- > 0; )
+  {
+    for(size_t q = p+1; q < k; q++)
+      fountain_mul_add(dec->rows + p*b, dec->rows + q*b, dec->coefficients[p*k + q], b);
+  }
+}
+
+/*
+  Add a symbol of symbol_len bytes. Row p is kept with its first non
+  zero coefficient, 1, at column p so a new symbol is reduced by the
+  rows in order until it has a coefficient at a column without a row.
+  Returns 1 once the file is decoded, 0 if more symbols are needed.
+*/
+int
+fountain_decode(struct FountainDecoder *dec, uint16_t id, const uint8_t *symbol)
+{
+  uint8_t *row;
+  size_t k, b;
+  uint8_t c;
+
+  if(dec->complete)
+    return 1;
+
+  k = dec->symbols;
+  b = dec->symbol_len;
+  fountain_coefficients(id, k, dec->vector);
+  memcpy(dec->symbol, symbol, b);
+
+  for(size_t p = 0; p < k; p++)
+  {
+    c = dec->vector[p];
+    if(c == 0)
+      continue;
+
+    row = dec->coefficients + p*k;
+    if(dec->pivots[p])
+    {
+      fountain_mul_add(dec->vector + p, row + p, c, k - p);
+      fountain_mul_add(dec->symbol, dec->rows + p*b, c, b);
+      continue;
+    }
+
+    fountain_mul(dec->vector + p, gf_inv[c], k - p);
+    fountain_mul(dec->symbol, gf_inv[c], b);
+    memcpy(row, dec->vector, k);
+    memcpy(dec->rows + p*b, dec->symbol, b);
+    dec->pivots[p] = 1;
+    dec->rank++;
+    break;
+  }
+
+  if(dec->rank < k)
+    return 0;
+
+  fountain_back_substitute(dec);
+  dec->complete = 1;
+  return 1;
+}
+
+/* the decoded file, len bytes, NULL until it's complete */
+const uint8_t*
+fountain_data(struct FountainDecoder *dec)
+{
+  return dec->complete ? dec->rows : NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef FOUNTAIN_H
+#define FOUNTAIN_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ Rateless erasure coding so a file can be broadcast to any number of
+ receivers without acknowledgements. The file is split into K source
+ symbols of the same length, the last one padded with zeros. Symbol id
+ i below K is source symbol i, every id from K up is a repair symbol
+ which is a random linear combination of all K source symbols over
+ GF(256). The coefficients come from a generator seeded with the id so
+ only the id is sent with a symbol.
+
+ A receiver rebuilds the file from any K symbols which are linearly
+ independent, for random coefficients over GF(256) that's K symbols
+ most of the time and rarely more than K+2. Which symbols were lost
+ doesn't matter so one stream of repair symbols covers the losses of
+ every receiver at once.
+
+ Decoding is Gaussian elimination as the symbols arrive, the memory
+ needed grows with K squared which is what limits the number of
+ symbols.
+*/
+#define FOUNTAIN_MAX_SYMBOLS 1024
+#define FOUNTAIN_MAX_ID 0xFFFF
+
+struct FountainEncoder
+{
+  const uint8_t *data;
+  size_t len;
+  size_t symbol_len;
+  size_t symbols;
+};
+
+struct FountainDecoder
+{
+  size_t len;
+  size_t symbol_len;
+  size_t symbols;
+  size_t rank;
+  int complete;
+  uint8_t *coefficients;
+  uint8_t *rows;
+  uint8_t *pivots;
+  uint8_t *vector;
+  uint8_t *symbol;
+};
+
+size_t
+fountain_symbols(size_t len, size_t symbol_len);
+
+int
+fountain_encoder_init(struct FountainEncoder *enc, const uint8_t *data, size_t len, size_t symbol_len);
+
+void
+fountain_encode(struct FountainEncoder *enc, uint16_t id, uint8_t *symbol);
+
+int
+fountain_decoder_init(struct FountainDecoder *dec, size_t len, size_t symbol_len);
+
+void
+fountain_decoder_destroy(struct FountainDecoder *dec);
+
+int
+fountain_decode(struct FountainDecoder *dec, uint16_t id, const uint8_t *symbol);
+
+const uint8_t*
+fountain_data(struct FountainDecoder *dec);
+
+#endif
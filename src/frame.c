@@ -0,0 +1,369 @@
+#include "frame.h"
+
+ssize_t
+frame_encode(uint8_t *frame, size_t frame_len, const struct FrameHeader *hdr, const uint8_t *payload, size_t payload_len)
+{
+  size_t header_len;
+
+  if(hdr->type == FRAME_TYPE_DATA)
+  {
+    header_len = FRAME_DATA_HEADER_LENGTH;
+    if(header_len + payload_len > frame_len)
+      return -1;
+
+    frame[0] = FRAME_TYPE_DATA << FRAME_TYPE_SHIFT;
+  }
+  else if(hdr->type == FRAME_TYPE_FRAGMENT)
+  {
+    header_len = FRAME_FRAGMENT_HEADER_LENGTH;
+    if(header_len + payload_len > frame_len)
+      return -1;
+
+    if(hdr->index < 0 || hdr->index >= FRAME_MAX_FRAGMENTS)
+      return -1;
+
+    frame[0] = FRAME_TYPE_FRAGMENT << FRAME_TYPE_SHIFT;
+    frame[0] |= (hdr->index >> 8) & FRAME_INDEX_HIGH_MASK;
+    if(hdr->last)
+      frame[0] |= FRAME_FLAG_LAST;
+    frame[1] = hdr->id;
+    frame[2] = hdr->index & 0xff;
+  }
+  else if(hdr->type == FRAME_TYPE_RECORDS)
+  {
+    header_len = FRAME_RECORDS_HEADER_LENGTH;
+    if(header_len + payload_len > frame_len)
+      return -1;
+
+    frame[0] = FRAME_TYPE_RECORDS << FRAME_TYPE_SHIFT;
+  }
+  else if(hdr->type == FRAME_TYPE_FOUNTAIN)
+  {
+    header_len = FRAME_FOUNTAIN_HEADER_LENGTH;
+    if(header_len + payload_len > frame_len)
+      return -1;
+
+    if(hdr->length > FRAME_FOUNTAIN_MAX_LENGTH || hdr->index < 0 || hdr->index > 0xFFFF)
+      return -1;
+
+    frame[0] = FRAME_TYPE_FOUNTAIN << FRAME_TYPE_SHIFT;
+    frame[1] = hdr->id;
+    frame[2] = hdr->length >> 16;
+    frame[3] = hdr->length >> 8;
+    frame[4] = hdr->length;
+    frame[5] = hdr->index >> 8;
+    frame[6] = hdr->index;
+  }
+  else
+  {
+    return -1;
+  }
+
+  if(hdr->compressed)
+    frame[0] |= FRAME_FLAG_COMPRESSED;
+
+  memcpy(frame+header_len, payload, payload_len);
+  return header_len + payload_len;
+}
+
+int
+frame_decode(uint8_t *frame, size_t frame_len, struct FrameHeader *hdr, uint8_t **payload, size_t *payload_len)
+{
+  size_t header_len;
+
+  if(frame_len < 1)
+    return -1;
+
+  memset(hdr, 0, sizeof(struct FrameHeader));
+  hdr->type = frame[0] >> FRAME_TYPE_SHIFT;
+  hdr->compressed = (frame[0] & FRAME_FLAG_COMPRESSED) != 0;
+
+  switch(hdr->type)
+  {
+    case FRAME_TYPE_DATA:
+      header_len = FRAME_DATA_HEADER_LENGTH;
+      break;
+    case FRAME_TYPE_FRAGMENT:
+      header_len = FRAME_FRAGMENT_HEADER_LENGTH;
+      if(frame_len < header_len)
+        return -1;
+      hdr->last = (frame[0] & FRAME_FLAG_LAST) != 0;
+      hdr->id = frame[1];
+      hdr->index = (frame[0] & FRAME_INDEX_HIGH_MASK) << 8;
+      hdr->index |= frame[2];
+      break;
+    case FRAME_TYPE_RECORDS:
+      header_len = FRAME_RECORDS_HEADER_LENGTH;
+      break;
+    case FRAME_TYPE_FOUNTAIN:
+      header_len = FRAME_FOUNTAIN_HEADER_LENGTH;
+      if(frame_len < header_len)
+        return -1;
+      hdr->id = frame[1];
+      hdr->length = (frame[2] << 16) | (frame[3] << 8) | frame[4];
+      hdr->index = (frame[5] << 8) | frame[6];
+      break;
+    default:
+      return -1;
+  }
+
+  *payload = frame+header_len;
+  *payload_len = frame_len-header_len;
+  return 0;
+}
+
+size_t
+frame_count(size_t message_len, size_t packet_len)
+{
+  size_t fragment_payload;
+
+  if(message_len + FRAME_DATA_HEADER_LENGTH <= packet_len)
+    return 1;
+
+  fragment_payload = packet_len - FRAME_FRAGMENT_HEADER_LENGTH;
+  return (message_len + fragment_payload - 1) / fragment_payload;
+}
+
+/*
+  Append a message to a records frame which has used bytes so far.
+  Returns the new length of the frame or -1 if it doesn't fit.
+*/
+ssize_t
+frame_record_add(uint8_t *frame, size_t frame_len, size_t used, const uint8_t *message, size_t message_len, int compressed)
+{
+  if(message_len == 0 || message_len > FRAME_RECORD_MAX_LENGTH)
+    return -1;
+  if(used + FRAME_RECORD_HEADER_LENGTH + message_len > frame_len)
+    return -1;
+
+  frame[used] = message_len;
+  if(compressed)
+    frame[used] |= FRAME_RECORD_COMPRESSED;
+  memcpy(frame+used+FRAME_RECORD_HEADER_LENGTH, message, message_len);
+
+  return used + FRAME_RECORD_HEADER_LENGTH + message_len;
+}
+
+/*
+  Take the next message off the payload of a records frame. Returns 1
+  for a message, 0 when there are no more and -1 if it's truncated.
+*/
+int
+frame_record_next(uint8_t **records, size_t *records_len, uint8_t **message, size_t *message_len, int *compressed)
+{
+  size_t len;
+
+  if(*records_len == 0)
+    return 0;
+
+  len = (*records)[0] & FRAME_RECORD_MAX_LENGTH;
+  if(len == 0 || FRAME_RECORD_HEADER_LENGTH + len > *records_len)
+    return -1;
+
+  *compressed = ((*records)[0] & FRAME_RECORD_COMPRESSED) != 0;
+  *message = *records + FRAME_RECORD_HEADER_LENGTH;
+  *message_len = len;
+
+  *records += FRAME_RECORD_HEADER_LENGTH + len;
+  *records_len -= FRAME_RECORD_HEADER_LENGTH + len;
+  return 1;
+}
+
+void
+frame_reassembly_init(struct FrameReassembly *reassembly, size_t fragment_payload, size_t max_message, size_t max_bytes, uint64_t timeout_ms)
+{
+  memset(reassembly, 0, sizeof(struct FrameReassembly));
+  reassembly->fragment_payload = fragment_payload;
+  reassembly->max_message = max_message;
+  reassembly->max_bytes = max_bytes;
+  reassembly->timeout_ms = timeout_ms;
+}
+
+static void
+frame_slot_free(struct FrameReassembly *reassembly, struct FrameSlot *slot)
+{
+  reassembly->bytes -= slot->allocated;
+  free(slot->buf);
+  memset(slot, 0, sizeof(struct FrameSlot));
+}
+
+void
+frame_reassembly_destroy(struct FrameReassembly *reassembly)
+{
+  for(int i=0; i<FRAME_REASSEMBLY_SLOTS; i++)
+  {
+    if(reassembly->slots[i].used)
+      frame_slot_free(reassembly, &reassembly->slots[i]);
+  }
+}
+
+void
+frame_reassembly_expire(struct FrameReassembly *reassembly, uint64_t now_ms)
+{
+  struct FrameSlot *slot;
+
+  for(int i=0; i<FRAME_REASSEMBLY_SLOTS; i++)
+  {
+    slot = &reassembly->slots[i];
+    if(slot->used && now_ms - slot->updated_ms >= reassembly->timeout_ms)
+    {
+      frame_slot_free(reassembly, slot);
+      reassembly->dropped++;
+    }
+  }
+}
+
+/* the least recently updated slot other than the one given */
+static struct FrameSlot*
+frame_slot_oldest(struct FrameReassembly *reassembly, struct FrameSlot *exclude)
+{
+  struct FrameSlot *oldest, *slot;
+  oldest = NULL;
+
+  for(int i=0; i<FRAME_REASSEMBLY_SLOTS; i++)
+  {
+    slot = &reassembly->slots[i];
+    if(!slot->used || slot == exclude)
+      continue;
+    if(oldest == NULL || slot->updated_ms < oldest->updated_ms)
+      oldest = slot;
+  }
+  return oldest;
+}
+
+static struct FrameSlot*
+frame_slot_get(struct FrameReassembly *reassembly, uint16_t source, uint8_t id)
+{
+  struct FrameSlot *slot, *empty;
+  empty = NULL;
+
+  for(int i=0; i<FRAME_REASSEMBLY_SLOTS; i++)
+  {
+    slot = &reassembly->slots[i];
+    if(slot->used && slot->source == source && slot->id == id)
+      return slot;
+    if(!slot->used && empty == NULL)
+      empty = slot;
+  }
+
+  if(empty == NULL)
+  {
+    empty = frame_slot_oldest(reassembly, NULL);
+    frame_slot_free(reassembly, empty);
+    reassembly->dropped++;
+  }
+
+  empty->used = 1;
+  empty->source = source;
+  empty->id = id;
+  return empty;
+}
+
+/* grow the buffer of a slot to hold size bytes staying under the memory cap */
+static int
+frame_slot_reserve(struct FrameReassembly *reassembly, struct FrameSlot *slot, size_t size)
+{
+  struct FrameSlot *oldest;
+  uint8_t *buf;
+
+  if(size <= slot->allocated)
+    return 0;
+
+  while(reassembly->bytes - slot->allocated + size > reassembly->max_bytes)
+  {
+    oldest = frame_slot_oldest(reassembly, slot);
+    if(oldest == NULL)
+      return -1;
+    frame_slot_free(reassembly, oldest);
+    reassembly->dropped++;
+  }
+
+  buf = realloc(slot->buf, size);
+  if(buf == NULL)
+    return -1;
+
+  reassembly->bytes += size - slot->allocated;
+  slot->buf = buf;
+  slot->allocated = size;
+  return 0;
+}
+
+/*
+ Add a fragment to the message it belongs to. Returns 1 when the message
+ is complete in which case the caller owns message and must free it. The
+ message buffer has one byte spare past its length so it can be
+ terminated. Returns 0 when more fragments are needed and -1 if the
+ fragment was dropped.
+*/
+int
+frame_reassemble(struct FrameReassembly *reassembly, const struct FrameHeader *hdr, const uint8_t *payload, size_t payload_len, uint64_t now_ms, uint8_t **message, size_t *message_len)
+{
+  struct FrameSlot *slot;
+  size_t offset, end;
+
+  frame_reassembly_expire(reassembly, now_ms);
+
+  if(hdr->type != FRAME_TYPE_FRAGMENT || hdr->index >= FRAME_MAX_FRAGMENTS)
+    return -1;
+
+  /* only the last fragment may be short */
+  if(payload_len > reassembly->fragment_payload)
+    return -1;
+  if(!hdr->last && payload_len != reassembly->fragment_payload)
+    return -1;
+
+  offset = hdr->index * reassembly->fragment_payload;
+  end = offset + payload_len;
+  if(end > reassembly->max_message)
+    return -1;
+
+  slot = frame_slot_get(reassembly, hdr->source, hdr->id);
+  slot->updated_ms = now_ms;
+
+  if(slot->bitmap[hdr->index/8] & (1 << (hdr->index%8)))
+    return 0;
+
+  if(slot->total && (hdr->index >= slot->total || (hdr->last && hdr->index != slot->total-1)))
+  {
+    /* fragment doesn't agree with the last fragment we have, start over */
+    frame_slot_free(reassembly, slot);
+    reassembly->dropped++;
+    return -1;
+  }
+
+  if(frame_slot_reserve(reassembly, slot, end+1))
+  {
+    frame_slot_free(reassembly, slot);
+    reassembly->dropped++;
+    return -1;
+  }
+
+  memcpy(slot->buf+offset, payload, payload_len);
+  slot->bitmap[hdr->index/8] |= 1 << (hdr->index%8);
+  slot->received++;
+
+  if(hdr->last)
+  {
+    slot->total = hdr->index+1;
+    slot->len = end;
+  }
+
+  if(slot->total && slot->received > slot->total)
+  {
+    /* fragments past the last one, likely a reused message id */
+    frame_slot_free(reassembly, slot);
+    reassembly->dropped++;
+    return -1;
+  }
+
+  if(slot->total == 0 || slot->received < slot->total)
+    return 0;
+
+  *message = slot->buf;
+  *message_len = slot->len;
+
+  /* the caller owns the buffer now */
+  reassembly->bytes -= slot->allocated;
+  memset(slot, 0, sizeof(struct FrameSlot));
+  return 1;
+}
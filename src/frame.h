@@ -0,0 +1,153 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+/*
+ When framing is enabled every packet sent over the air starts with a
+ one byte header. The top three bits are the type of packet and the
+ remaining bits depend on the type.
+
+ Data - the payload is a complete message
+
+   7   6   5   4   3   2   1   0
+ +---+---+---+---+---+---+---+---+
+ | type = 0  | z |   reserved    |  payload ...
+ +---+---+---+---+---+---+---+---+
+
+ Fragment - the payload is part of a larger message. Every fragment
+ except the last carries a full packet of payload so the offset of a
+ fragment is its index times the fragment payload. The index is 10 bits.
+
+   7   6   5   4   3   2   1   0
+ +---+---+---+---+---+---+---+---+
+ | type = 1  | z |lst| r | idx hi|  message id, index low, payload ...
+ +---+---+---+---+---+---+---+---+
+
+ The z flag is set when the message was compressed.
+
+ Records - the payload is several small messages each with a one byte
+ record header, the top bit is set when the message was compressed
+ and the remaining bits are its length.
+
+   7   6   5   4   3   2   1   0
+ +---+---+---+---+---+---+---+---+
+ | type = 2  |     reserved      |  z|len, message, z|len, message ...
+ +---+---+---+---+---+---+---+---+
+
+ ARQ data and ARQ ack - a frame sent reliably and an acknowledgement,
+ see arq.h
+
+ Fountain - a symbol of a file broadcast with erasure coding, see
+ fountain.h. The id tells transfers apart, the length is of the whole
+ file and the index is the symbol id. Both are big endian.
+
+   7   6   5   4   3   2   1   0
+ +---+---+---+---+---+---+---+---+
+ | type = 5  |     reserved      |  id, length x3, index x2, symbol ...
+ +---+---+---+---+---+---+---+---+
+*/
+#define FRAME_TYPE_DATA 0
+#define FRAME_TYPE_FRAGMENT 1
+#define FRAME_TYPE_RECORDS 2
+#define FRAME_TYPE_ARQ_DATA 3
+#define FRAME_TYPE_ARQ_ACK 4
+#define FRAME_TYPE_FOUNTAIN 5
+
+#define FRAME_TYPE_SHIFT 5
+#define FRAME_FLAG_COMPRESSED 0x10
+#define FRAME_FLAG_LAST 0x08
+#define FRAME_INDEX_HIGH_MASK 0x03
+
+#define FRAME_DATA_HEADER_LENGTH 1
+#define FRAME_FRAGMENT_HEADER_LENGTH 3
+#define FRAME_RECORDS_HEADER_LENGTH 1
+#define FRAME_RECORD_HEADER_LENGTH 1
+#define FRAME_FOUNTAIN_HEADER_LENGTH 7
+#define FRAME_FOUNTAIN_MAX_LENGTH 0xFFFFFF
+#define FRAME_RECORD_COMPRESSED 0x80
+#define FRAME_RECORD_MAX_LENGTH 0x7F
+#define FRAME_MAX_FRAGMENTS 1024
+
+#define FRAME_REASSEMBLY_SLOTS 8
+#define FRAME_REASSEMBLY_TIMEOUT_MS 10000
+#define FRAME_REASSEMBLY_MAX_BYTES 65536
+
+/*
+ The source isn't part of the header, it's set by the receiver when it
+ knows who sent the frame so message ids from different senders don't
+ collide while reassembling.
+*/
+struct FrameHeader
+{
+  int type;
+  uint8_t id;
+  int index;
+  int last;
+  int compressed;
+  uint32_t length;
+  uint16_t source;
+};
+
+struct FrameSlot
+{
+  int used;
+  uint16_t source;
+  uint8_t id;
+  int received;
+  int total;
+  size_t len;
+  size_t allocated;
+  uint8_t *buf;
+  uint64_t updated_ms;
+  uint8_t bitmap[FRAME_MAX_FRAGMENTS/8];
+};
+
+/*
+ Messages being reassembled from fragments. The memory used by all
+ messages is capped, when a new fragment would exceed the cap the
+ least recently updated message is dropped. A message which hasn't
+ received a fragment within the timeout is also dropped.
+*/
+struct FrameReassembly
+{
+  size_t fragment_payload;
+  size_t max_message;
+  size_t max_bytes;
+  size_t bytes;
+  uint64_t timeout_ms;
+  size_t dropped;
+  struct FrameSlot slots[FRAME_REASSEMBLY_SLOTS];
+};
+
+ssize_t
+frame_encode(uint8_t *frame, size_t frame_len, const struct FrameHeader *hdr, const uint8_t *payload, size_t payload_len);
+
+int
+frame_decode(uint8_t *frame, size_t frame_len, struct FrameHeader *hdr, uint8_t **payload, size_t *payload_len);
+
+size_t
+frame_count(size_t message_len, size_t packet_len);
+
+ssize_t
+frame_record_add(uint8_t *frame, size_t frame_len, size_t used, const uint8_t *message, size_t message_len, int compressed);
+
+int
+frame_record_next(uint8_t **records, size_t *records_len, uint8_t **message, size_t *message_len, int *compressed);
+
+void
+frame_reassembly_init(struct FrameReassembly *reassembly, size_t fragment_payload, size_t max_message, size_t max_bytes, uint64_t timeout_ms);
+
+void
+frame_reassembly_destroy(struct FrameReassembly *reassembly);
+
+void
+frame_reassembly_expire(struct FrameReassembly *reassembly, uint64_t now_ms);
+
+int
+frame_reassemble(struct FrameReassembly *reassembly, const struct FrameHeader *hdr, const uint8_t *payload, size_t payload_len, uint64_t now_ms, uint8_t **message, size_t *message_len);
+
+#endif
@@ -0,0 +1,557 @@
+#include "iphc.h"
+
+#define IPHC_PROTO_UDP 17
+
+static const uint8_t iphc_link_local[8] = { 0xFE, 0x80, 0, 0, 0, 0, 0, 0 };
+static const uint8_t iphc_short_iid[6] = { 0, 0, 0, 0xFF, 0xFE, 0 };
+static const uint8_t iphc_multicast[14] = { 0xFF, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t iphc_hop_limits[4] = { 0, 1, 64, 255 };
+static const uint8_t iphc_zero[16];
+
+static uint16_t
+iphc_get16(const uint8_t *buf)
+{
+  return (buf[0] << 8) | buf[1];
+}
+
+static uint32_t
+iphc_get32(const uint8_t *buf)
+{
+  return ((uint32_t) buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+static void
+iphc_put16(uint8_t *buf, uint16_t value)
+{
+  buf[0] = value >> 8;
+  buf[1] = value & 0xFF;
+}
+
+static void
+iphc_put32(uint8_t *buf, uint32_t value)
+{
+  iphc_put16(buf, value >> 16);
+  iphc_put16(buf+2, value & 0xFFFF);
+}
+
+/* the ones complement sum of buf added to sum, not folded */
+static uint32_t
+iphc_sum(uint32_t sum, const uint8_t *buf, size_t len)
+{
+  for(size_t i = 0; i + 1 < len; i += 2)
+    sum += iphc_get16(buf+i);
+  if(len & 1)
+    sum += buf[len-1] << 8;
+  return sum;
+}
+
+static uint16_t
+iphc_checksum(uint32_t sum)
+{
+  while(sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  return ~sum & 0xFFFF;
+}
+
+/* the checksum of a UDP header and payload with the pseudo header sum already in sum */
+static void
+iphc_udp_checksum(uint8_t *udp, size_t len, uint32_t sum)
+{
+  uint16_t checksum;
+
+  sum += IPHC_PROTO_UDP + len;
+  checksum = iphc_checksum(iphc_sum(sum, udp, len));
+  iphc_put16(udp+6, checksum ? checksum : 0xFFFF);
+}
+
+void
+iphc_context(struct IphcContext *ctx, uint32_t net, int prefix_len)
+{
+  if(prefix_len <= 0)
+    ctx->mask = 0;
+  else if(prefix_len >= 32)
+    ctx->mask = 0xFFFFFFFF;
+  else
+    ctx->mask = 0xFFFFFFFF << (32 - prefix_len);
+  ctx->net = net & ctx->mask;
+}
+
+/* whether a message is a compressed IP packet */
+int
+iphc_dispatch(const uint8_t *buf, size_t len)
+{
+  return len > 0 && buf[0] >= IPHC_DISPATCH_IPV4 && buf[0] <= IPHC_DISPATCH_RAW;
+}
+
+static int
+iphc_ipv4_mode(const struct IphcContext *ctx, uint32_t addr)
+{
+  if(addr == 0xFFFFFFFF)
+    return IPHC_ADDR_ELIDED;
+
+  if((addr & ctx->mask) == ctx->net)
+  {
+    if((addr & ~ctx->mask) <= 0xFF)
+      return IPHC_ADDR_LOW8;
+    if((addr & ~ctx->mask) <= 0xFFFF)
+      return IPHC_ADDR_LOW16;
+  }
+
+  return IPHC_ADDR_INLINE;
+}
+
+static size_t
+iphc_ipv4_addr(uint8_t *out, uint32_t addr, int mode)
+{
+  switch(mode)
+  {
+  case IPHC_ADDR_INLINE:
+    iphc_put32(out, addr);
+    return 4;
+  case IPHC_ADDR_LOW8:
+    out[0] = addr & 0xFF;
+    return 1;
+  case IPHC_ADDR_LOW16:
+    iphc_put16(out, addr & 0xFFFF);
+    return 2;
+  }
+  return 0;
+}
+
+static int
+iphc_ipv6_mode(const uint8_t *addr)
+{
+  if(memcmp(addr, iphc_link_local, sizeof(iphc_link_local)) == 0)
+  {
+    if(memcmp(addr+8, iphc_short_iid, sizeof(iphc_short_iid)) == 0)
+      return IPHC_ADDR_LOW16;
+    return IPHC_ADDR_LOW8;
+  }
+
+  if(memcmp(addr, iphc_multicast, sizeof(iphc_multicast)) == 0 && addr[14] == 0)
+    return IPHC_ADDR_ELIDED;
+
+  return IPHC_ADDR_INLINE;
+}
+
+static size_t
+iphc_ipv6_addr(uint8_t *out, const uint8_t *addr, int mode)
+{
+  switch(mode)
+  {
+  case IPHC_ADDR_INLINE:
+    memcpy(out, addr, 16);
+    return 16;
+  case IPHC_ADDR_LOW8:
+    memcpy(out, addr+8, 8);
+    return 8;
+  case IPHC_ADDR_LOW16:
+    memcpy(out, addr+14, 2);
+    return 2;
+  }
+  out[0] = addr[15];
+  return 1;
+}
+
+/* the ports of a UDP header, returns the bytes written and the mode in enc1 */
+static size_t
+iphc_ports(uint8_t *out, const uint8_t *udp, uint8_t *enc1)
+{
+  uint16_t src, dst;
+
+  src = iphc_get16(udp);
+  dst = iphc_get16(udp+2);
+
+  if((src & 0xFFF0) == 0xF0B0 && (dst & 0xFFF0) == 0xF0B0)
+  {
+    *enc1 |= IPHC_PORTS_NIBBLES << IPHC_PORTS_SHIFT;
+    out[0] = ((src & 0x0F) << 4) | (dst & 0x0F);
+    return 1;
+  }
+
+  if((dst & 0xFF00) == 0xF000)
+  {
+    *enc1 |= IPHC_PORTS_DST8 << IPHC_PORTS_SHIFT;
+    iphc_put16(out, src);
+    out[2] = dst & 0xFF;
+    return 3;
+  }
+
+  if((src & 0xFF00) == 0xF000)
+  {
+    *enc1 |= IPHC_PORTS_SRC8 << IPHC_PORTS_SHIFT;
+    out[0] = src & 0xFF;
+    iphc_put16(out+1, dst);
+    return 3;
+  }
+
+  memcpy(out, udp, 4);
+  return 4;
+}
+
+static ssize_t
+iphc_compress_ipv4(const struct IphcContext *ctx, const uint8_t *packet, size_t len, uint8_t *out)
+{
+  uint16_t id, frag;
+  uint32_t src, dst;
+  int src_mode, dst_mode, udp;
+  size_t pos, header_len;
+
+  len = iphc_get16(packet+2);
+  id = iphc_get16(packet+4);
+  frag = iphc_get16(packet+6);
+  src = iphc_get32(packet+12);
+  dst = iphc_get32(packet+16);
+  src_mode = iphc_ipv4_mode(ctx, src);
+  dst_mode = iphc_ipv4_mode(ctx, dst);
+  udp = packet[9] == IPHC_PROTO_UDP && (frag & 0x3FFF) == 0 &&
+      len >= IPHC_IPV4_HEADER_LENGTH + IPHC_UDP_HEADER_LENGTH &&
+      iphc_get16(packet+IPHC_IPV4_HEADER_LENGTH+4) == len - IPHC_IPV4_HEADER_LENGTH;
+
+  out[0] = IPHC_DISPATCH_IPV4;
+  out[1] = (src_mode << IPHC_SRC_SHIFT) | (dst_mode << IPHC_DST_SHIFT);
+  out[2] = 0;
+  pos = 3;
+
+  if(packet[1] == 0)
+    out[1] |= IPHC_IPV4_TOS_ZERO;
+  else
+    out[pos++] = packet[1];
+
+  /* the id only matters to put fragments back together */
+  if((frag & 0xBFFF) == 0 && (id == 0 || (frag & 0x4000)))
+  {
+    out[1] |= IPHC_IPV4_NOT_FRAGMENT;
+    if(frag & 0x4000)
+      out[2] |= IPHC_IPV4_DF;
+  }
+  else
+  {
+    memcpy(out+pos, packet+4, 4);
+    pos += 4;
+  }
+
+  if(packet[8] == 64)
+    out[1] |= IPHC_IPV4_TTL_64;
+  else
+    out[pos++] = packet[8];
+
+  if(udp)
+    out[1] |= IPHC_UDP;
+  else
+    out[pos++] = packet[9];
+
+  pos += iphc_ipv4_addr(out+pos, src, src_mode);
+  pos += iphc_ipv4_addr(out+pos, dst, dst_mode);
+
+  header_len = IPHC_IPV4_HEADER_LENGTH;
+  if(udp)
+  {
+    pos += iphc_ports(out+pos, packet+header_len, &out[2]);
+    header_len += IPHC_UDP_HEADER_LENGTH;
+  }
+
+  memcpy(out+pos, packet+header_len, len-header_len);
+  return pos + len - header_len;
+}
+
+static ssize_t
+iphc_compress_ipv6(const uint8_t *packet, size_t len, uint8_t *out)
+{
+  int src_mode, dst_mode, hop, udp;
+  size_t pos, header_len;
+
+  len = IPHC_IPV6_HEADER_LENGTH + iphc_get16(packet+4);
+  src_mode = iphc_ipv6_mode(packet+8);
+  dst_mode = iphc_ipv6_mode(packet+24);
+  udp = packet[6] == IPHC_PROTO_UDP && len >= IPHC_IPV6_HEADER_LENGTH + IPHC_UDP_HEADER_LENGTH &&
+      iphc_get16(packet+IPHC_IPV6_HEADER_LENGTH+4) == len - IPHC_IPV6_HEADER_LENGTH;
+
+  for(hop = 3; hop > 0 && iphc_hop_limits[hop] != packet[7]; hop--)
+    ;
+
+  out[0] = IPHC_DISPATCH_IPV6;
+  out[1] = (src_mode << IPHC_SRC_SHIFT) | (dst_mode << IPHC_DST_SHIFT) | (hop << IPHC_IPV6_HOP_SHIFT);
+  out[2] = 0;
+  pos = 3;
+
+  if((packet[0] & 0x0F) == 0 && packet[1] == 0 && packet[2] == 0 && packet[3] == 0)
+    out[1] |= IPHC_IPV6_TF_ZERO;
+  else
+  {
+    memcpy(out+pos, packet, 4);
+    pos += 4;
+  }
+
+  if(udp)
+    out[1] |= IPHC_UDP;
+  else
+    out[pos++] = packet[6];
+
+  if(hop == 0)
+    out[pos++] = packet[7];
+
+  pos += iphc_ipv6_addr(out+pos, packet+8, src_mode);
+  pos += iphc_ipv6_addr(out+pos, packet+24, dst_mode);
+
+  header_len = IPHC_IPV6_HEADER_LENGTH;
+  if(udp)
+  {
+    pos += iphc_ports(out+pos, packet+header_len, &out[2]);
+    header_len += IPHC_UDP_HEADER_LENGTH;
+  }
+
+  memcpy(out+pos, packet+header_len, len-header_len);
+  return pos + len - header_len;
+}
+
+/*
+  Compress an IP packet read from a TUN interface. A compressed packet is
+  never more than a byte longer than the packet, out needs room for it.
+  Returns the length, -1 if the packet is cut short or out is too small.
+*/
+ssize_t
+iphc_compress(const struct IphcContext *ctx, const uint8_t *packet, size_t len, uint8_t *out, size_t out_len)
+{
+  if(len == 0 || out_len < len + 1)
+    return -1;
+
+  if((packet[0] >> 4) == 4 && (packet[0] & 0x0F) == 5 && len >= IPHC_IPV4_HEADER_LENGTH)
+  {
+    if(iphc_get16(packet+2) < IPHC_IPV4_HEADER_LENGTH || iphc_get16(packet+2) > len)
+      return -1;
+    return iphc_compress_ipv4(ctx, packet, len, out);
+  }
+
+  if((packet[0] >> 4) == 6 && len >= IPHC_IPV6_HEADER_LENGTH)
+  {
+    if(IPHC_IPV6_HEADER_LENGTH + iphc_get16(packet+4) > len)
+      return -1;
+    return iphc_compress_ipv6(packet, len, out);
+  }
+
+  out[0] = IPHC_DISPATCH_RAW;
+  memcpy(out+1, packet, len);
+  return len + 1;
+}
+
+/* fields are read from a compressed packet only while there are enough bytes left */
+struct IphcReader
+{
+  const uint8_t *buf;
+  size_t len;
+  size_t pos;
+  int short_read;
+};
+
+static const uint8_t*
+iphc_read(struct IphcReader *reader, size_t n)
+{
+  const uint8_t *field;
+
+  if(reader->pos + n > reader->len)
+  {
+    reader->short_read = 1;
+    return iphc_zero;
+  }
+
+  field = reader->buf + reader->pos;
+  reader->pos += n;
+  return field;
+}
+
+static uint32_t
+iphc_read_ipv4_addr(const struct IphcContext *ctx, struct IphcReader *reader, int mode)
+{
+  switch(mode)
+  {
+  case IPHC_ADDR_INLINE:
+    return iphc_get32(iphc_read(reader, 4));
+  case IPHC_ADDR_LOW8:
+    return ctx->net | *iphc_read(reader, 1);
+  case IPHC_ADDR_LOW16:
+    return ctx->net | iphc_get16(iphc_read(reader, 2));
+  }
+  return 0xFFFFFFFF;
+}
+
+static void
+iphc_read_ipv6_addr(struct IphcReader *reader, int mode, uint8_t *addr)
+{
+  memset(addr, 0, 16);
+  switch(mode)
+  {
+  case IPHC_ADDR_INLINE:
+    memcpy(addr, iphc_read(reader, 16), 16);
+    break;
+  case IPHC_ADDR_LOW8:
+    memcpy(addr, iphc_link_local, 8);
+    memcpy(addr+8, iphc_read(reader, 8), 8);
+    break;
+  case IPHC_ADDR_LOW16:
+    memcpy(addr, iphc_link_local, 8);
+    memcpy(addr+8, iphc_short_iid, 6);
+    memcpy(addr+14, iphc_read(reader, 2), 2);
+    break;
+  default:
+    memcpy(addr, iphc_multicast, 14);
+    addr[15] = *iphc_read(reader, 1);
+  }
+}
+
+static void
+iphc_read_ports(struct IphcReader *reader, int mode, uint8_t *udp)
+{
+  const uint8_t *field;
+
+  switch(mode)
+  {
+  case IPHC_PORTS_NIBBLES:
+    field = iphc_read(reader, 1);
+    iphc_put16(udp, 0xF0B0 | (field[0] >> 4));
+    iphc_put16(udp+2, 0xF0B0 | (field[0] & 0x0F));
+    break;
+  case IPHC_PORTS_DST8:
+    field = iphc_read(reader, 3);
+    memcpy(udp, field, 2);
+    iphc_put16(udp+2, 0xF000 | field[2]);
+    break;
+  case IPHC_PORTS_SRC8:
+    field = iphc_read(reader, 3);
+    iphc_put16(udp, 0xF000 | field[0]);
+    memcpy(udp+2, field+1, 2);
+    break;
+  default:
+    memcpy(udp, iphc_read(reader, 4), 4);
+  }
+  iphc_put16(udp+6, 0);
+}
+
+static ssize_t
+iphc_decompress_ipv4(const struct IphcContext *ctx, struct IphcReader *reader, uint8_t *packet, size_t packet_len)
+{
+  uint8_t enc0, enc1;
+  size_t header_len, rest, len;
+
+  enc0 = reader->buf[1];
+  enc1 = reader->buf[2];
+
+  memset(packet, 0, IPHC_IPV4_HEADER_LENGTH + IPHC_UDP_HEADER_LENGTH);
+  packet[0] = 0x45;
+  packet[1] = enc0 & IPHC_IPV4_TOS_ZERO ? 0 : *iphc_read(reader, 1);
+  if(enc0 & IPHC_IPV4_NOT_FRAGMENT)
+    packet[6] = enc1 & IPHC_IPV4_DF ? 0x40 : 0;
+  else
+    memcpy(packet+4, iphc_read(reader, 4), 4);
+  packet[8] = enc0 & IPHC_IPV4_TTL_64 ? 64 : *iphc_read(reader, 1);
+  packet[9] = enc0 & IPHC_UDP ? IPHC_PROTO_UDP : *iphc_read(reader, 1);
+  iphc_put32(packet+12, iphc_read_ipv4_addr(ctx, reader, (enc0 >> IPHC_SRC_SHIFT) & IPHC_ADDR_MASK));
+  iphc_put32(packet+16, iphc_read_ipv4_addr(ctx, reader, (enc0 >> IPHC_DST_SHIFT) & IPHC_ADDR_MASK));
+
+  header_len = IPHC_IPV4_HEADER_LENGTH;
+  if(enc0 & IPHC_UDP)
+  {
+    iphc_read_ports(reader, (enc1 >> IPHC_PORTS_SHIFT) & 0x03, packet+header_len);
+    header_len += IPHC_UDP_HEADER_LENGTH;
+  }
+
+  if(reader->short_read)
+    return -1;
+
+  rest = reader->len - reader->pos;
+  len = header_len + rest;
+  if(len > packet_len || len > IPHC_MAX_PACKET)
+    return -1;
+  memcpy(packet+header_len, reader->buf+reader->pos, rest);
+
+  iphc_put16(packet+2, len);
+  if(enc0 & IPHC_UDP)
+  {
+    iphc_put16(packet+IPHC_IPV4_HEADER_LENGTH+4, len - IPHC_IPV4_HEADER_LENGTH);
+    iphc_udp_checksum(packet+IPHC_IPV4_HEADER_LENGTH, len - IPHC_IPV4_HEADER_LENGTH, iphc_sum(0, packet+12, 8));
+  }
+  iphc_put16(packet+10, iphc_checksum(iphc_sum(0, packet, IPHC_IPV4_HEADER_LENGTH)));
+
+  return len;
+}
+
+static ssize_t
+iphc_decompress_ipv6(struct IphcReader *reader, uint8_t *packet, size_t packet_len)
+{
+  uint8_t enc0, enc1;
+  size_t header_len, rest, len;
+  int hop;
+
+  enc0 = reader->buf[1];
+  enc1 = reader->buf[2];
+
+  memset(packet, 0, IPHC_IPV6_HEADER_LENGTH + IPHC_UDP_HEADER_LENGTH);
+  if(enc0 & IPHC_IPV6_TF_ZERO)
+    packet[0] = 0x60;
+  else
+    memcpy(packet, iphc_read(reader, 4), 4);
+  packet[6] = enc0 & IPHC_UDP ? IPHC_PROTO_UDP : *iphc_read(reader, 1);
+  hop = (enc0 >> IPHC_IPV6_HOP_SHIFT) & 0x03;
+  packet[7] = hop ? iphc_hop_limits[hop] : *iphc_read(reader, 1);
+  iphc_read_ipv6_addr(reader, (enc0 >> IPHC_SRC_SHIFT) & IPHC_ADDR_MASK, packet+8);
+  iphc_read_ipv6_addr(reader, (enc0 >> IPHC_DST_SHIFT) & IPHC_ADDR_MASK, packet+24);
+
+  header_len = IPHC_IPV6_HEADER_LENGTH;
+  if(enc0 & IPHC_UDP)
+  {
+    iphc_read_ports(reader, (enc1 >> IPHC_PORTS_SHIFT) & 0x03, packet+header_len);
+    header_len += IPHC_UDP_HEADER_LENGTH;
+  }
+
+  if(reader->short_read)
+    return -1;
+
+  rest = reader->len - reader->pos;
+  len = header_len + rest;
+  if(len > packet_len || len - IPHC_IPV6_HEADER_LENGTH > 0xFFFF)
+    return -1;
+  memcpy(packet+header_len, reader->buf+reader->pos, rest);
+
+  iphc_put16(packet+4, len - IPHC_IPV6_HEADER_LENGTH);
+  if(enc0 & IPHC_UDP)
+  {
+    iphc_put16(packet+IPHC_IPV6_HEADER_LENGTH+4, len - IPHC_IPV6_HEADER_LENGTH);
+    iphc_udp_checksum(packet+IPHC_IPV6_HEADER_LENGTH, len - IPHC_IPV6_HEADER_LENGTH, iphc_sum(0, packet+8, 32));
+  }
+
+  return len;
+}
+
+/*
+  Put an IP packet back together from what iphc_compress made of it.
+  Returns its length, -1 if buf isn't a compressed packet, is cut short
+  or the packet doesn't fit in packet_len.
+*/
+ssize_t
+iphc_decompress(const struct IphcContext *ctx, const uint8_t *buf, size_t len, uint8_t *packet, size_t packet_len)
+{
+  struct IphcReader reader;
+
+  if(!iphc_dispatch(buf, len))
+    return -1;
+
+  if(buf[0] == IPHC_DISPATCH_RAW)
+  {
+    if(len - 1 > packet_len)
+      return -1;
+    memcpy(packet, buf+1, len-1);
+    return len - 1;
+  }
+
+  if(len < 3 || packet_len < IPHC_IPV6_HEADER_LENGTH + IPHC_UDP_HEADER_LENGTH)
+    return -1;
+
+  reader.buf = buf;
+  reader.len = len;
+  reader.pos = 3;
+  reader.short_read = 0;
+
+  if(buf[0] == IPHC_DISPATCH_IPV4)
+    return iphc_decompress_ipv4(ctx, &reader, packet, packet_len);
+  return iphc_decompress_ipv6(&reader, packet, packet_len);
+}
@@ -0,0 +1,114 @@
+#ifndef IPHC_H
+#define IPHC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+/*
+ IP header compression for sending IP packets from a TUN interface over
+ the air, in the spirit of 6LoWPAN IPHC. Compressing is stateless, both
+ ends only share an IPv4 network as context, so a lost packet never
+ breaks the ones after it. A compressed packet starts with a dispatch
+ byte which never appears in text, so a receiver can tell IP apart from
+ other data.
+
+ IPv4 - the dispatch, two encoding bytes then the inline fields in the
+ order TOS, id and fragment, TTL, protocol, source, destination, UDP
+ ports and the rest of the packet. The length and checksum are
+ recomputed by the receiver, for UDP as well.
+
+   7   6   5   4   3   2   1   0
+ +---+---+---+---+---+---+---+---+
+ |  src  |  dst  |ttl|tos|nof|udp|
+ +---+---+---+---+---+---+---+---+
+ |df | ports |     reserved      |
+ +---+---+---+---+---+---+---+---+
+
+   src, dst  0 all 4 bytes inline, 1 in the context network with the
+             low byte inline, 2 with the low two bytes inline, 3 the
+             broadcast address 255.255.255.255
+   ttl       the TTL is 64, else it's inline
+   tos       the TOS is 0, else it's inline
+   nof       not a fragment, the id is 0 and only df is kept, else the
+             id and fragment field are inline
+   udp       the protocol is UDP and its header is compressed, else the
+             protocol is inline and the rest of the packet is as it was
+   ports     0 both ports inline, 1 the destination is 0xF0xx and only
+             its low byte is inline, 2 the same for the source, 3 both
+             are 0xF0Bx and their low nibbles are in one byte
+
+ IPv6 - the same with the hop limit instead of the TTL and link local
+ addresses compressed.
+
+   7   6   5   4   3   2   1   0
+ +---+---+---+---+---+---+---+---+
+ |  src  |  dst  |  hop  |tf |udp|
+ +---+---+---+---+---+---+---+---+
+ | r | ports |     reserved      |
+ +---+---+---+---+---+---+---+---+
+
+   src, dst  0 all 16 bytes inline, 1 fe80::/64 with the interface id
+             inline, 2 fe80::ff:fe00:XXXX with the last two bytes
+             inline, 3 the multicast address ff02::XX with its last
+             byte inline
+   hop       0 the hop limit is inline, 1, 64 or 255
+   tf        the traffic class and flow label are 0, else the first 4
+             bytes of the header are inline
+
+ Anything else, IPv4 with options or not IP at all, is sent as it is
+ after IPHC_DISPATCH_RAW.
+*/
+#define IPHC_DISPATCH_IPV4 0xF8
+#define IPHC_DISPATCH_IPV6 0xF9
+#define IPHC_DISPATCH_RAW 0xFA
+
+#define IPHC_SRC_SHIFT 6
+#define IPHC_DST_SHIFT 4
+#define IPHC_ADDR_INLINE 0
+#define IPHC_ADDR_LOW8 1
+#define IPHC_ADDR_LOW16 2
+#define IPHC_ADDR_ELIDED 3
+#define IPHC_ADDR_MASK 0x03
+
+#define IPHC_IPV4_TTL_64 0x08
+#define IPHC_IPV4_TOS_ZERO 0x04
+#define IPHC_IPV4_NOT_FRAGMENT 0x02
+#define IPHC_UDP 0x01
+#define IPHC_IPV4_DF 0x80
+
+#define IPHC_IPV6_HOP_SHIFT 2
+#define IPHC_IPV6_TF_ZERO 0x02
+
+#define IPHC_PORTS_SHIFT 5
+#define IPHC_PORTS_INLINE 0
+#define IPHC_PORTS_DST8 1
+#define IPHC_PORTS_SRC8 2
+#define IPHC_PORTS_NIBBLES 3
+
+#define IPHC_IPV4_HEADER_LENGTH 20
+#define IPHC_IPV6_HEADER_LENGTH 40
+#define IPHC_UDP_HEADER_LENGTH 8
+#define IPHC_MAX_PACKET 65535
+
+/* the IPv4 network shared by both ends, in host order */
+struct IphcContext
+{
+  uint32_t net;
+  uint32_t mask;
+};
+
+void
+iphc_context(struct IphcContext *ctx, uint32_t net, int prefix_len);
+
+ssize_t
+iphc_compress(const struct IphcContext *ctx, const uint8_t *packet, size_t len, uint8_t *out, size_t out_len);
+
+ssize_t
+iphc_decompress(const struct IphcContext *ctx, const uint8_t *buf, size_t len, uint8_t *packet, size_t packet_len);
+
+int
+iphc_dispatch(const uint8_t *buf, size_t len);
+
+#endif
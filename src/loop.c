@@ -0,0 +1,320 @@
+#include "loop.h"
+
+int
+loop_init(struct Loop *loop)
+{
+  memset(loop, 0, sizeof(struct Loop));
+  loop->fd_signal = -1;
+  sigemptyset(&loop->signals);
+
+  loop->sources = malloc(LOOP_INITIAL_CAPACITY * sizeof(struct LoopSource*));
+  if(loop->sources == NULL)
+    return -1;
+  loop->capacity = LOOP_INITIAL_CAPACITY;
+
+  loop->fd_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if(loop->fd_epoll == -1)
+  {
+    free(loop->sources);
+    loop->sources = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* the signals taken by the loop are unblocked again unless the caller gave the signalfd */
+void
+loop_destroy(struct Loop *loop)
+{
+  for(size_t i = 0; i < loop->size; i++)
+    free(loop->sources[i]);
+  free(loop->sources);
+
+  if(loop->fd_signal != -1 && !loop->signal_given)
+  {
+    close(loop->fd_signal);
+    sigprocmask(SIG_UNBLOCK, &loop->signals, NULL);
+  }
+
+  if(loop->fd_epoll != -1)
+    close(loop->fd_epoll);
+
+  memset(loop, 0, sizeof(struct Loop));
+  loop->fd_epoll = -1;
+  loop->fd_signal = -1;
+}
+
+static struct LoopSource*
+loop_find(struct Loop *loop, int fd)
+{
+  for(size_t i = 0; i < loop->size; i++)
+  {
+    if(loop->sources[i]->fd == fd)
+      return loop->sources[i];
+  }
+
+  return NULL;
+}
+
+static int
+loop_ctl(struct Loop *loop, struct LoopSource *source, int enable)
+{
+  struct epoll_event event;
+
+  if(source->always_ready)
+  {
+    source->enabled = enable;
+    return 0;
+  }
+
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = enable ? source->events : 0;
+  event.data.ptr = source;
+
+  if(epoll_ctl(loop->fd_epoll, EPOLL_CTL_MOD, source->fd, &event) == -1)
+    return -1;
+
+  source->enabled = enable;
+  return 0;
+}
+
+/* register a descriptor enabled, the id is passed back to the callback */
+int
+loop_add(struct Loop *loop, int fd, uint32_t events, LoopHandler handler, void *data, int id)
+{
+  struct LoopSource *source, **sources;
+  struct epoll_event event;
+
+  if(fd < 0 || loop_find(loop, fd) != NULL)
+    return -1;
+
+  if(loop->size == loop->capacity)
+  {
+    sources = realloc(loop->sources, 2 * loop->capacity * sizeof(struct LoopSource*));
+    if(sources == NULL)
+      return -1;
+    loop->sources = sources;
+    loop->capacity *= 2;
+  }
+
+  source = calloc(1, sizeof(struct LoopSource));
+  if(source == NULL)
+    return -1;
+
+  source->fd = fd;
+  source->events = events;
+  source->enabled = 1;
+  source->order = loop->order++;
+  source->handler = handler;
+  source->data = data;
+  source->id = id;
+
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = events;
+  event.data.ptr = source;
+
+  if(epoll_ctl(loop->fd_epoll, EPOLL_CTL_ADD, fd, &event) == -1)
+  {
+    if(errno != EPERM)
+    {
+      free(source);
+      return -1;
+    }
+    source->always_ready = 1;
+  }
+
+  loop->sources[loop->size++] = source;
+  return 0;
+}
+
+/* start or stop waiting on a descriptor, only changes epoll when it has to */
+int
+loop_enable(struct Loop *loop, int fd, int enable)
+{
+  struct LoopSource *source;
+
+  source = loop_find(loop, fd);
+  if(source == NULL)
+    return -1;
+
+  enable = enable != 0;
+  if(source->enabled == enable)
+    return 0;
+
+  return loop_ctl(loop, source, enable);
+}
+
+/*
+  Removing a descriptor only takes it out of epoll here, it's freed when
+  the loop isn't in the middle of running callbacks.
+*/
+int
+loop_remove(struct Loop *loop, int fd)
+{
+  struct LoopSource *source;
+
+  source = loop_find(loop, fd);
+  if(source == NULL)
+    return -1;
+
+  if(!source->always_ready)
+    epoll_ctl(loop->fd_epoll, EPOLL_CTL_DEL, fd, NULL);
+
+  source->fd = -1;
+  source->handler = NULL;
+  return 0;
+}
+
+static void
+loop_collect(struct Loop *loop)
+{
+  size_t kept = 0;
+
+  for(size_t i = 0; i < loop->size; i++)
+  {
+    if(loop->sources[i]->handler == NULL)
+      free(loop->sources[i]);
+    else
+      loop->sources[kept++] = loop->sources[i];
+  }
+
+  loop->size = kept;
+}
+
+static int
+loop_on_signal(void *data, int id, uint32_t events)
+{
+  struct Loop *loop = data;
+  struct signalfd_siginfo info;
+  int ret = 0;
+
+  while(read(loop->fd_signal, &info, sizeof(info)) == sizeof(info))
+  {
+    for(int i = 0; i < loop->nsignals; i++)
+    {
+      if(loop->signal[i].signo == (int) info.ssi_signo)
+        ret |= loop->signal[i].handler(loop->signal[i].data, info.ssi_signo, events);
+    }
+  }
+
+  return ret;
+}
+
+/*
+  Read signals from a signalfd the caller made with its signals already
+  blocked. The caller closes it and unblocks them after the loop.
+*/
+int
+loop_signal_fd(struct Loop *loop, int fd)
+{
+  if(loop->fd_signal != -1)
+    return -1;
+
+  if(loop_add(loop, fd, EPOLLIN, loop_on_signal, loop, 0))
+    return -1;
+
+  loop->fd_signal = fd;
+  loop->signal_given = 1;
+  return 0;
+}
+
+/*
+  Take a signal in the loop. It's blocked so it's only delivered through
+  the signalfd, the callback gets the signal number as its id.
+*/
+int
+loop_signal(struct Loop *loop, int signo, LoopHandler handler, void *data)
+{
+  sigset_t signals;
+  int fd;
+
+  if(loop->nsignals == LOOP_MAX_SIGNALS)
+    return -1;
+
+  signals = loop->signals;
+  sigaddset(&signals, signo);
+  if(sigprocmask(SIG_BLOCK, &signals, NULL) == -1)
+    return -1;
+
+  fd = signalfd(loop->fd_signal, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if(fd == -1)
+    return -1;
+
+  if(loop->fd_signal == -1)
+  {
+    loop->fd_signal = fd;
+    if(loop_add(loop, fd, EPOLLIN, loop_on_signal, loop, 0))
+      return -1;
+  }
+
+  loop->signals = signals;
+  loop->signal[loop->nsignals].signo = signo;
+  loop->signal[loop->nsignals].handler = handler;
+  loop->signal[loop->nsignals].data = data;
+  loop->nsignals++;
+  return 0;
+}
+
+/*
+  Wait up to timeout_ms, -1 for no timeout, and run the callbacks of
+  what's ready. Returns how many callbacks failed, -1 if waiting failed.
+*/
+int
+loop_run(struct Loop *loop, int timeout_ms)
+{
+  struct epoll_event events[LOOP_MAX_EVENTS];
+  struct LoopSource *ready[LOOP_MAX_EVENTS + LOOP_MAX_EVENTS], *source;
+  uint32_t revents[LOOP_MAX_EVENTS + LOOP_MAX_EVENTS], ev;
+  int n, nready, ret;
+
+  nready = 0;
+  for(size_t i = 0; i < loop->size; i++)
+  {
+    if(loop->sources[i]->always_ready && loop->sources[i]->enabled && loop->sources[i]->handler != NULL)
+      timeout_ms = 0;
+  }
+
+  n = epoll_wait(loop->fd_epoll, events, LOOP_MAX_EVENTS, timeout_ms);
+  if(n == -1)
+    return errno == EINTR ? 0 : -1;
+
+  for(int i = 0; i < n; i++)
+  {
+    ready[nready] = events[i].data.ptr;
+    revents[nready++] = events[i].events;
+  }
+
+  for(size_t i = 0; i < loop->size && nready < LOOP_MAX_EVENTS + LOOP_MAX_EVENTS; i++)
+  {
+    if(loop->sources[i]->always_ready && loop->sources[i]->enabled && loop->sources[i]->handler != NULL)
+    {
+      ready[nready] = loop->sources[i];
+      revents[nready++] = loop->sources[i]->events;
+    }
+  }
+
+  /* in the order they were registered */
+  for(int i = 1; i < nready; i++)
+  {
+    source = ready[i];
+    ev = revents[i];
+    for(n = i; n > 0 && ready[n-1]->order > source->order; n--)
+    {
+      ready[n] = ready[n-1];
+      revents[n] = revents[n-1];
+    }
+    ready[n] = source;
+    revents[n] = ev;
+  }
+
+  ret = 0;
+  for(int i = 0; i < nready; i++)
+  {
+    if(ready[i]->handler != NULL && ready[i]->enabled)
+      ret += ready[i]->handler(ready[i]->data, ready[i]->id, revents[i]) != 0;
+  }
+
+  loop_collect(loop);
+  return ret;
+}
@@ -0,0 +1,90 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/*
+ An event loop on epoll. Each file descriptor is registered with the
+ events it waits for and a callback, and can be enabled and disabled
+ without being registered again. Callbacks of the descriptors which are
+ ready run in the order they were registered.
+
+ Regular files can't be waited on with epoll, they're always ready so
+ while one is enabled the loop doesn't block.
+
+ Signals are taken with a signalfd so their callbacks run in the loop
+ like any other, not in a signal handler. The signalfd can be made by the
+ caller before the loop so signals are held from the start of the program.
+*/
+#define LOOP_MAX_EVENTS 32
+#define LOOP_MAX_SIGNALS 8
+#define LOOP_INITIAL_CAPACITY 16
+
+typedef int (*LoopHandler)(void *data, int id, uint32_t events);
+
+struct LoopSource
+{
+  int fd;
+  uint32_t events;
+  int enabled;
+  int always_ready;
+  size_t order;
+  LoopHandler handler;
+  void *data;
+  int id;
+};
+
+struct LoopSignal
+{
+  int signo;
+  LoopHandler handler;
+  void *data;
+};
+
+struct Loop
+{
+  int fd_epoll;
+  int fd_signal;
+  int signal_given;
+  sigset_t signals;
+  struct LoopSignal signal[LOOP_MAX_SIGNALS];
+  int nsignals;
+  struct LoopSource **sources;
+  size_t size;
+  size_t capacity;
+  size_t order;
+};
+
+int
+loop_init(struct Loop *loop);
+
+void
+loop_destroy(struct Loop *loop);
+
+int
+loop_add(struct Loop *loop, int fd, uint32_t events, LoopHandler handler, void *data, int id);
+
+int
+loop_enable(struct Loop *loop, int fd, int enable);
+
+int
+loop_remove(struct Loop *loop, int fd);
+
+int
+loop_signal_fd(struct Loop *loop, int fd);
+
+int
+loop_signal(struct Loop *loop, int signo, LoopHandler handler, void *data);
+
+int
+loop_run(struct Loop *loop, int timeout_ms);
+
+#endif
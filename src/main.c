@@ -1,12 +1,16 @@
 #include "config.h"
 #include <stdio.h>
 
+#include <poll.h>
 #include <signal.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <sys/signalfd.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include "become_daemon.h"
+#include "compress.h"
 #include "error.h"
 #include "e32.h"
 #include "gpio.h"
@@ -15,34 +19,102 @@
 struct options opts;
 struct E32 dev;
 
-static
-void signal_handler(int sig)
+/*
+  Block SIGINT and SIGTERM and take them with a signalfd so a signal while
+  starting up doesn't skip the cleanup, the poll loop reads them once it's
+  running.
+*/
+static int
+signals_block(sigset_t *signals)
 {
-  int exit_status;
+  sigemptyset(signals);
+  sigaddset(signals, SIGINT);
+  sigaddset(signals, SIGTERM);
+  if(sigprocmask(SIG_BLOCK, signals, NULL) == -1)
+    return -1;
 
-  if(opts.daemon)
-    info_output("daemon stopping pid=%d sig=%d", getpid(), sig);
+  return signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC);
+}
 
-  options_deinit(&opts);
-  exit_status = e32_deinit(&dev, &opts);
-  exit(exit_status);
+/*
+  Train a dictionary from traffic captured in the input file or stdin. The
+  signals are blocked so wait on them along with the input, a terminal on
+  stdin can still be interrupted.
+*/
+static int
+train_dictionary(struct options *opts, int fd_signal)
+{
+  struct Dictionary dict;
+  struct pollfd fds[2];
+  uint8_t *samples;
+  size_t len;
+  ssize_t bytes;
+  FILE *input;
+  int err;
+
+  input = opts->input_file != NULL ? opts->input_file : stdin;
+  samples = malloc(COMPRESS_TRAIN_MAX_SAMPLES);
+  if(samples == NULL)
+    return 1;
+
+  fds[0].fd = fileno(input);
+  fds[0].events = POLLIN;
+  fds[1].fd = fd_signal;
+  fds[1].events = POLLIN;
+
+  len = 0;
+  while(len < COMPRESS_TRAIN_MAX_SAMPLES)
+  {
+    if(poll(fds, 2, -1) == -1 || fds[1].revents)
+    {
+      err_output("training stopped\n");
+      free(samples);
+      return 1;
+    }
+    bytes = read(fds[0].fd, samples+len, COMPRESS_TRAIN_MAX_SAMPLES-len);
+    if(bytes <= 0)
+      break;
+    len += bytes;
+  }
+
+  compress_dictionary_init(&dict);
+  err = compress_dictionary_train(&dict, samples, len, COMPRESS_DICTIONARY_MAX);
+  if(err)
+    err_output("unable to train a dictionary\n");
+  else if(compress_dictionary_save(&dict, opts->dictionary_train_file))
+  {
+    errno_output("unable to write dictionary %s\n", opts->dictionary_train_file);
+    err = 1;
+  }
+  else
+    info_output("trained a %d byte dictionary from %d bytes\n", (int) dict.len, (int) len);
+
+  compress_dictionary_destroy(&dict);
+  free(samples);
+  return err;
 }
 
 int
 main(int argc, char *argv[])
 {
+  struct signalfd_siginfo info;
+  sigset_t signals;
   int err = 0;
+  int fd_signal;
 
-  if (signal(SIGINT, signal_handler) == SIG_ERR)
-    err_output("installing SIGNT signal handler");
-  if (signal(SIGTERM, signal_handler) == SIG_ERR)
-    err_output("installing SIGTERM signal handler");
+  fd_signal = signals_block(&signals);
+  if(fd_signal == -1)
+  {
+    errno_output("unable to block signals\n");
+    return 1;
+  }
 
   options_init(&opts);
   err = options_parse(&opts, argc, argv);
   if(err || opts.help)
   {
     usage(argv[0]);
+    close(fd_signal);
     return err;
   }
 
@@ -51,6 +123,15 @@ main(int argc, char *argv[])
     options_print(&opts);
   }
 
+  /* training doesn't need the e32 */
+  if(opts.dictionary_train_file[0])
+  {
+    err = train_dictionary(&opts, fd_signal);
+    options_deinit(&opts);
+    close(fd_signal);
+    return err;
+  }
+
   err = e32_init(&dev, &opts);
   if(err)
   {
@@ -111,6 +192,35 @@ main(int argc, char *argv[])
     err |= e32_cmd_write_settings(&dev, opts.settings_write_input);
   }
 
+  /*
+    the air data rate and FEC give how long each packet is on air, burst
+    mode, pacing and the duty cycle limit depend on them
+  */
+  if(e32_set_mode(&dev, SLEEP) || e32_cmd_read_version(&dev) || e32_cmd_read_settings(&dev))
+  {
+    if(opts.burst || opts.pace || opts.duty_cycle_ppm)
+    {
+      err_output("unable to read version and settings\n");
+      err = 1;
+      goto cleanup;
+    }
+    warn_output("unable to read version and settings, air time is unknown\n");
+  }
+
+  if(e32_pair_setup(&dev))
+  {
+    err_output("unable to pair the rx e32\n");
+    err = 1;
+    goto cleanup;
+  }
+
+  if(e32_bond_setup(&dev))
+  {
+    err_output("unable to set up the bonded e32 modules\n");
+    err = 1;
+    goto cleanup;
+  }
+
   /* switch back to normal mode for tx/rx */
   if(e32_set_mode(&dev, NORMAL))
   {
@@ -118,8 +228,39 @@ main(int argc, char *argv[])
     goto cleanup;
   }
 
+  /* test data only goes on the air when characterizing is asked for */
+  if(opts.burst_characterize)
+  {
+    if(e32_burst_characterize(&dev))
+    {
+      err_output("unable to characterize burst mode\n");
+      err = 1;
+    }
+    else
+      e32_print_burst(&dev);
+    goto cleanup;
+  }
+
+  if(opts.burst)
+  {
+    if(e32_burst_pacing(&dev, opts.burst_chunk ? opts.burst_chunk : E32_BURST_CHUNK))
+    {
+      err_output("unable to pace burst mode without the air time\n");
+      err = 1;
+      goto cleanup;
+    }
+    e32_print_burst(&dev);
+  }
+
   if(opts.daemon)
   {
+    /* a signal pending now isn't inherited by the daemon */
+    if(read(fd_signal, &info, sizeof(info)) == sizeof(info))
+    {
+      info_output("stopping on sig=%d before becoming a daemon\n", (int) info.ssi_signo);
+      goto cleanup;
+    }
+
     err = become_daemon();
     if(err)
     {
@@ -133,11 +274,14 @@ main(int argc, char *argv[])
     info_output("daemon started pid=%ld", getpid());
   }
 
-  err |= e32_poll(&dev, &opts);
+  err |= e32_poll(&dev, &opts, fd_signal);
   if(err)
     err_output("error polling %d", err);
 cleanup:
   err |= e32_deinit(&dev, &opts);
+  options_deinit(&opts);
+  close(fd_signal);
+  sigprocmask(SIG_UNBLOCK, &signals, NULL);
 
   return err;
 }
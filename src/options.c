@@ -1,4 +1,9 @@
 #include "options.h"
+#include "udp.h"
+#include <fcntl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include <sys/ioctl.h>
 
 // tells error.c when we print to use stdout, stderr, or syslog
 int use_syslog = 0;
@@ -26,12 +31,59 @@ usage(char *progname)
    --m0                  GPIO M0 Pin for output [%d]\n\
    --m1                  GPIO M1 Pin for output [%d]\n\
    --aux                 GPIO Aux Pin for input interrupt [%d]\n\
+   --rx-tty TTY          The UART of a second e32 which does all the receiving, on a different\n\
+                         channel, while the first only transmits. Needs --rx-m0, --rx-m1 and --rx-aux.\n\
+   --rx-m0               GPIO M0 Pin of the second e32\n\
+   --rx-m1               GPIO M1 Pin of the second e32\n\
+   --rx-aux              GPIO Aux Pin of the second e32\n\
+   --bond TTY,M0,M1,AUX  Stripe data over another e32 on a different channel given by its UART and\n\
+                         pins, up to %d times. The other end needs the same number of e32 modules on\n\
+                         the same channels.\n\
    --in-file  FILENAME   Transmit a file\n\
    --out-file FILENAME   Write received output to a file\n\
+   --frame               Add a header to each packet so data larger than a packet is fragmented\n\
+                         and reassembled. Data sent to the socket can be up to 16384 bytes. Both e32\n\
+                         modules need this option.\n\
+   --burst               Keep more than a packet in the TX buffer of the e32 while it's transmitting\n\
+   --burst-chunk BYTES   Bytes to keep in the TX buffer in burst mode, 116 if not given\n\
+   --burst-characterize  Find and print the burst chunk size and pacing for this e32 by transmitting\n\
+                         test data\n\
+   --pace                Write the next packet just before the e32 is expected to finish the one\n\
+                         it's transmitting using a model of the time on air\n\
+   --compress            Compress data before transmitting it, implies --frame. Both e32 modules\n\
+                         need this option.\n\
+   --dictionary FILE     Dictionary shared by both e32 modules to improve compression\n\
+   --train-dictionary FILE\n\
+                         Write a dictionary trained from captured traffic read from --in-file\n\
+                         or stdin to FILE\n\
+   --coalesce MS         Pack small messages sent together into one packet, a message waits at most\n\
+                         MS milliseconds for others to join it. Implies --frame.\n\
+   --reliable            Acknowledge frames and send lost ones again, implies --frame. Both e32\n\
+                         modules need this option.\n\
+   --fountain PERCENT    Broadcast --in-file to any number of e32 modules with erasure coding,\n\
+                         sending PERCENT more than the file to cover losses. Implies --frame,\n\
+                         receivers need --frame.\n\
+   --duty-cycle PERCENT  Keep the time on air under PERCENT of any hour, for example 1 or 0.1,\n\
+                         frames wait in the queue until the budget allows them\n\
+   --priority-prefix     The first byte of each datagram on the data socket is its priority class,\n\
+                         0 urgent, 1 normal or 2 bulk, and isn't transmitted\n\
+   --tx-notify           Answer each datagram on the data socket with a sequence number and tell\n\
+                         the client again once it has been sent on air\n\
 -x --sock-unix-data FILE Send and receive data from a Unix Domain Socket\n\
 -c --sock-unix-ctrl FILE Change and Read settings from a Unix Domain Socket\n\
+   --sock-unix-seqpacket FILE\n\
+                         Send and receive data over connections to a SOCK_SEQPACKET Unix Domain\n\
+                         Socket, with credits telling each client how much it can send\n\
+   --udp-listen [ADDR:]PORT\n\
+                         Transmit datagrams sent to a UDP port, on the loopback address unless\n\
+                         ADDR is given\n\
+   --udp-dest ADDR:PORT  Send what's received to a UDP address, can be given up to %d times\n\
+   --tun NAME            Create a TUN interface and send IP packets over the air with compressed\n\
+                         headers, implies --frame. Both e32 modules need this option.\n\
+   --tun-net ADDR/LEN    IPv4 network both ends of the TUN interface are in, addresses in it are\n\
+                         compressed the most\n\
 -d --daemon              Run as a Daemon\n\
-", opts.gpio_m0, opts.gpio_m1, opts.gpio_aux);
+", opts.gpio_m0, opts.gpio_m1, opts.gpio_aux, OPTIONS_BOND_MODULES, OPTIONS_UDP_DESTS);
 }
 
 void
@@ -68,10 +120,38 @@ options_init(struct options *opts)
   opts->input_file = NULL;
   opts->output_file = NULL;
   opts->fd_socket_unix_data = -1;
+  opts->fd_socket_unix_seqpacket = -1;
   opts->fd_socket_unix_control = -1;
+  opts->fd_socket_udp = -1;
+  opts->udp_dests = 0;
+  opts->udp_listen = 0;
+  opts->fd_tun = -1;
+  opts->tun_name[0] = '\0';
+  opts->tun_net = 0;
+  opts->tun_prefix = 0;
   opts->aux_transition_additional_delay = 0;
+  opts->frame = 0;
+  opts->burst = 0;
+  opts->burst_chunk = 0;
+  opts->burst_characterize = 0;
+  opts->pace = 0;
+  opts->compress = 0;
+  opts->priority_prefix = 0;
+  opts->tx_notify = 0;
+  opts->coalesce_ms = 0;
+  opts->reliable = 0;
+  opts->fountain = -1;
+  opts->duty_cycle_ppm = 0;
+  opts->dictionary_file[0] = '\0';
+  opts->dictionary_train_file[0] = '\0';
   memset(opts->settings_write_input, 0, sizeof(opts->settings_write_input));
   snprintf(opts->tty_name, 64, "/dev/serial0");
+  opts->rx_tty_name[0] = '\0';
+  opts->rx_gpio_m0 = -1;
+  opts->rx_gpio_m1 = -1;
+  opts->rx_gpio_aux = -1;
+  opts->bond_modules = 0;
+  memset(opts->bond, 0, sizeof(opts->bond));
 }
 
 void
@@ -86,9 +166,28 @@ options_print(struct options* opts)
   printf("option GPIO M1 Pin is %d\n", opts->gpio_m1);
   printf("option GPIO AUX Pin is %d\n", opts->gpio_aux);
   printf("option daemon %d\n", opts->daemon);
+  printf("option frame %d\n", opts->frame);
+  printf("option burst %d chunk %d\n", opts->burst, opts->burst_chunk);
+  printf("option pace %d\n", opts->pace);
+  printf("option compress %d dictionary %s\n", opts->compress, opts->dictionary_file);
+  printf("option priority prefix %d\n", opts->priority_prefix);
+  printf("option tx notify %d\n", opts->tx_notify);
+  printf("option coalesce %d ms\n", opts->coalesce_ms);
+  printf("option reliable %d\n", opts->reliable);
+  printf("option fountain %d\n", opts->fountain);
+  printf("option duty cycle %d ppm\n", opts->duty_cycle_ppm);
   printf("option TTY Name is %s\n", opts->tty_name);
+  if(opts->rx_tty_name[0])
+    printf("option RX TTY Name is %s M0 %d M1 %d AUX %d\n", opts->rx_tty_name, opts->rx_gpio_m0, opts->rx_gpio_m1, opts->rx_gpio_aux);
+  for(int i = 0; i < opts->bond_modules; i++)
+    printf("option bond %d TTY Name is %s M0 %d M1 %d AUX %d\n", i+1, opts->bond[i].tty_name, opts->bond[i].gpio_m0, opts->bond[i].gpio_m1, opts->bond[i].gpio_aux);
   printf("option socket unix data file desciptor %d\n", opts->fd_socket_unix_data);
+  printf("option socket unix seqpacket file desciptor %d\n", opts->fd_socket_unix_seqpacket);
   printf("option socket unix control file desciptor %d\n", opts->fd_socket_unix_control);
+  printf("option socket udp file desciptor %d\n", opts->fd_socket_udp);
+  printf("option tun %s file descriptor %d net %08x/%d\n", opts->tun_name, opts->fd_tun, opts->tun_net, opts->tun_prefix);
+  for(int i = 0; i < opts->udp_dests; i++)
+    printf("option udp dest %s:%d\n", inet_ntoa(opts->socket_udp_dest[i].sin_addr), ntohs(opts->socket_udp_dest[i].sin_port));
 
   if(opts->settings_write_input[0])
   {
@@ -113,9 +212,18 @@ options_deinit(struct options *opts)
   if(opts->fd_socket_unix_data != -1)
     close(opts->fd_socket_unix_data);
 
+  if(opts->fd_socket_unix_seqpacket != -1)
+    close(opts->fd_socket_unix_seqpacket);
+
   if(opts->fd_socket_unix_control != -1)
     close(opts->fd_socket_unix_control);
 
+  if(opts->fd_socket_udp != -1)
+    close(opts->fd_socket_udp);
+
+  if(opts->fd_tun != -1)
+    close(opts->fd_tun);
+
   return err;
 }
 
@@ -146,9 +254,9 @@ options_open_file(char *optarg, char *mode)
 }
 
 static int
-options_open_socket_unix(char *filename, int *fd, struct sockaddr_un *sock)
+options_open_socket_unix(char *filename, int type, int *fd, struct sockaddr_un *sock)
 {
-  *fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  *fd = socket(AF_UNIX, type, 0);
   if(*fd == -1)
   {
     errno_output("error opening socket\n");
@@ -176,6 +284,144 @@ options_open_socket_unix(char *filename, int *fd, struct sockaddr_un *sock)
     errno_output("error binding to socket\n");
     return 3;
   }
+
+  if(type == SOCK_SEQPACKET && listen(*fd, SOMAXCONN) == -1)
+  {
+    errno_output("error listening on socket\n");
+    return 4;
+  }
+  return 0;
+}
+
+static int
+options_open_socket_udp(char *arg)
+{
+  struct sockaddr_in addr;
+  int fd;
+
+  if(udp_parse_addr(&addr, arg))
+  {
+    err_output("--udp-listen needs [ADDR:]PORT not %s\n", arg);
+    return -1;
+  }
+
+  fd = udp_open(&addr);
+  if(fd == -1)
+    errno_output("unable to open udp socket on %s\n", arg);
+  return fd;
+}
+
+static int
+options_parse_udp_dest(struct options *opts, char *arg)
+{
+  if(opts->udp_dests == OPTIONS_UDP_DESTS)
+  {
+    err_output("--udp-dest can be given at most %d times\n", OPTIONS_UDP_DESTS);
+    return 1;
+  }
+
+  if(strchr(arg, ':') == NULL || udp_parse_addr(&opts->socket_udp_dest[opts->udp_dests], arg))
+  {
+    err_output("--udp-dest needs ADDR:PORT not %s\n", arg);
+    return 1;
+  }
+
+  opts->udp_dests++;
+  return 0;
+}
+
+/* a TUN interface without packet information, its MTU set to OPTIONS_TUN_MTU */
+static int
+options_open_tun(struct options *opts, char *name)
+{
+  struct ifreq ifr;
+  int sock;
+
+  if(strlen(name) >= IFNAMSIZ)
+  {
+    err_output("--tun name must be less than %d chars\n", IFNAMSIZ);
+    return 1;
+  }
+
+  opts->fd_tun = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if(opts->fd_tun == -1)
+  {
+    errno_output("error opening /dev/net/tun\n");
+    return 1;
+  }
+
+  memset(&ifr, 0, sizeof(struct ifreq));
+  ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+  strncpy(ifr.ifr_name, name, IFNAMSIZ-1);
+  if(ioctl(opts->fd_tun, TUNSETIFF, &ifr) == -1)
+  {
+    errno_output("error creating tun interface %s\n", name);
+    return 2;
+  }
+  snprintf(opts->tun_name, sizeof(opts->tun_name), "%s", ifr.ifr_name);
+
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  ifr.ifr_mtu = OPTIONS_TUN_MTU;
+  if(sock == -1 || ioctl(sock, SIOCSIFMTU, &ifr) == -1)
+  {
+    errno_output("error setting the mtu of %s\n", opts->tun_name);
+    if(sock != -1)
+      close(sock);
+    return 3;
+  }
+  close(sock);
+
+  return 0;
+}
+
+/* the IPv4 network of the TUN interface as ADDR/LEN */
+static int
+options_parse_tun_net(struct options *opts, char *arg)
+{
+  char addr[INET_ADDRSTRLEN];
+  struct in_addr in;
+  char *slash;
+
+  slash = strchr(arg, '/');
+  if(slash == NULL || slash - arg >= INET_ADDRSTRLEN)
+  {
+    err_output("--tun-net needs ADDR/LEN not %s\n", arg);
+    return 1;
+  }
+
+  memcpy(addr, arg, slash - arg);
+  addr[slash - arg] = '\0';
+  opts->tun_prefix = atoi(slash+1);
+  if(inet_pton(AF_INET, addr, &in) != 1 || opts->tun_prefix < 0 || opts->tun_prefix > 32)
+  {
+    err_output("--tun-net needs ADDR/LEN not %s\n", arg);
+    return 1;
+  }
+  opts->tun_net = ntohl(in.s_addr);
+
+  return 0;
+}
+
+/* an e32 to bond with as TTY,M0,M1,AUX */
+static int
+options_parse_bond(struct options *opts, char *arg)
+{
+  struct options_module *module;
+
+  if(opts->bond_modules == OPTIONS_BOND_MODULES)
+  {
+    err_output("--bond can be given at most %d times\n", OPTIONS_BOND_MODULES);
+    return 1;
+  }
+
+  module = &opts->bond[opts->bond_modules];
+  if(sscanf(arg, "%63[^,],%d,%d,%d", module->tty_name, &module->gpio_m0, &module->gpio_m1, &module->gpio_aux) != 4)
+  {
+    err_output("--bond needs TTY,M0,M1,AUX not %s\n", arg);
+    return 1;
+  }
+
+  opts->bond_modules++;
   return 0;
 }
 
@@ -249,10 +495,34 @@ options_parse(struct options *opts, int argc, char *argv[])
     {"m0",                 required_argument, 0,   0},
     {"m1",                 required_argument, 0,   0},
     {"aux",                required_argument, 0,   0},
+    {"rx-tty",             required_argument, 0,   0},
+    {"rx-m0",              required_argument, 0,   0},
+    {"rx-m1",              required_argument, 0,   0},
+    {"rx-aux",             required_argument, 0,   0},
+    {"bond",               required_argument, 0,   0},
     {"in-file",            required_argument, 0,   0},
     {"out-file",           required_argument, 0,   0},
+    {"frame",                    no_argument, 0,   0},
+    {"burst",                    no_argument, 0,   0},
+    {"burst-chunk",        required_argument, 0,   0},
+    {"burst-characterize",       no_argument, 0,   0},
+    {"pace",                     no_argument, 0,   0},
+    {"compress",                 no_argument, 0,   0},
+    {"dictionary",         required_argument, 0,   0},
+    {"train-dictionary",   required_argument, 0,   0},
+    {"priority-prefix",          no_argument, 0,   0},
+    {"tx-notify",                no_argument, 0,   0},
+    {"coalesce",           required_argument, 0,   0},
+    {"reliable",                 no_argument, 0,   0},
+    {"fountain",           required_argument, 0,   0},
+    {"duty-cycle",         required_argument, 0,   0},
     {"sock-unix-data",     required_argument, 0, 'x'},
     {"sock-unix-ctrl",     required_argument, 0, 'c'},
+    {"sock-unix-seqpacket", required_argument, 0,  0},
+    {"udp-listen",         required_argument, 0,   0},
+    {"udp-dest",           required_argument, 0,   0},
+    {"tun",                required_argument, 0,   0},
+    {"tun-net",            required_argument, 0,   0},
     {"binary",                   no_argument, 0, 'b'},
     {"daemon",                   no_argument, 0, 'd'},
     {0,                                    0, 0,   0}
@@ -275,18 +545,100 @@ options_parse(struct options *opts, int argc, char *argv[])
         opts->gpio_m1 = atoi(optarg);
       else if(strcmp("aux", long_options[option_index].name) == 0)
         opts->gpio_aux = atoi(optarg);
+      else if(strcmp("rx-tty", long_options[option_index].name) == 0)
+        strncpy(opts->rx_tty_name, optarg, sizeof(opts->rx_tty_name)-1);
+      else if(strcmp("rx-m0", long_options[option_index].name) == 0)
+        opts->rx_gpio_m0 = atoi(optarg);
+      else if(strcmp("rx-m1", long_options[option_index].name) == 0)
+        opts->rx_gpio_m1 = atoi(optarg);
+      else if(strcmp("rx-aux", long_options[option_index].name) == 0)
+        opts->rx_gpio_aux = atoi(optarg);
+      else if(strcmp("bond", long_options[option_index].name) == 0)
+        err |= options_parse_bond(opts, optarg);
       else if(strcmp("out-file", long_options[option_index].name) == 0)
         strncpy(outfile, optarg, BUF);
       else if(strcmp("in-file", long_options[option_index].name) == 0)
         strncpy(infile, optarg, BUF);
+      else if(strcmp("frame", long_options[option_index].name) == 0)
+        opts->frame = 1;
+      else if(strcmp("burst", long_options[option_index].name) == 0)
+        opts->burst = 1;
+      else if(strcmp("burst-chunk", long_options[option_index].name) == 0)
+      {
+        opts->burst = 1;
+        opts->burst_chunk = atoi(optarg);
+      }
+      else if(strcmp("burst-characterize", long_options[option_index].name) == 0)
+      {
+        opts->burst = 1;
+        opts->burst_characterize = 1;
+      }
+      else if(strcmp("pace", long_options[option_index].name) == 0)
+        opts->pace = 1;
+      else if(strcmp("compress", long_options[option_index].name) == 0)
+      {
+        opts->compress = 1;
+        opts->frame = 1;
+      }
+      else if(strcmp("dictionary", long_options[option_index].name) == 0)
+        strncpy(opts->dictionary_file, optarg, sizeof(opts->dictionary_file)-1);
+      else if(strcmp("train-dictionary", long_options[option_index].name) == 0)
+        strncpy(opts->dictionary_train_file, optarg, sizeof(opts->dictionary_train_file)-1);
+      else if(strcmp("priority-prefix", long_options[option_index].name) == 0)
+        opts->priority_prefix = 1;
+      else if(strcmp("tx-notify", long_options[option_index].name) == 0)
+        opts->tx_notify = 1;
+      else if(strcmp("coalesce", long_options[option_index].name) == 0)
+      {
+        opts->coalesce_ms = atoi(optarg);
+        opts->frame = 1;
+      }
+      else if(strcmp("reliable", long_options[option_index].name) == 0)
+      {
+        opts->reliable = 1;
+        opts->frame = 1;
+      }
+      else if(strcmp("fountain", long_options[option_index].name) == 0)
+      {
+        opts->fountain = atoi(optarg);
+        opts->frame = 1;
+      }
+      else if(strcmp("duty-cycle", long_options[option_index].name) == 0)
+      {
+        opts->duty_cycle_ppm = atof(optarg) * 10000 + 0.5;
+        if(opts->duty_cycle_ppm <= 0 || opts->duty_cycle_ppm > 1000000)
+        {
+          err_output("--duty-cycle needs a percent above 0 and up to 100\n");
+          err |= 1;
+        }
+      }
       else if(strcmp("tty", long_options[option_index].name) == 0)
         strncpy(opts->tty_name, optarg, 64);
       else if(strcmp("write-input", long_options[option_index].name) == 0)
         err |= options_parse_settings(opts, optarg);
       else if(strcmp("sock-unix-data", long_options[option_index].name) == 0)
-        err |= options_open_socket_unix(optarg, &opts->fd_socket_unix_data, &opts->socket_unix_data);
+        err |= options_open_socket_unix(optarg, SOCK_DGRAM, &opts->fd_socket_unix_data, &opts->socket_unix_data);
+      else if(strcmp("sock-unix-seqpacket", long_options[option_index].name) == 0)
+        err |= options_open_socket_unix(optarg, SOCK_SEQPACKET, &opts->fd_socket_unix_seqpacket, &opts->socket_unix_seqpacket);
+      else if(strcmp("udp-listen", long_options[option_index].name) == 0)
+      {
+        if(opts->fd_socket_udp != -1)
+          close(opts->fd_socket_udp);
+        opts->fd_socket_udp = options_open_socket_udp(optarg);
+        opts->udp_listen = opts->fd_socket_udp != -1;
+        err |= opts->fd_socket_udp == -1;
+      }
+      else if(strcmp("udp-dest", long_options[option_index].name) == 0)
+        err |= options_parse_udp_dest(opts, optarg);
+      else if(strcmp("tun", long_options[option_index].name) == 0)
+      {
+        err |= options_open_tun(opts, optarg);
+        opts->frame = 1;
+      }
+      else if(strcmp("tun-net", long_options[option_index].name) == 0)
+        err |= options_parse_tun_net(opts, optarg);
       else if(strcmp("sock-unix-ctrl", long_options[option_index].name) == 0)
-        err |= options_open_socket_unix(optarg, &opts->fd_socket_unix_control, &opts->socket_unix_control);
+        err |= options_open_socket_unix(optarg, SOCK_DGRAM, &opts->fd_socket_unix_control, &opts->socket_unix_control);
       break;
     case 'h':
       opts->help = 1;
@@ -314,10 +666,10 @@ options_parse(struct options *opts, int argc, char *argv[])
       }
       break;
     case 'x':
-      err |= options_open_socket_unix(optarg, &opts->fd_socket_unix_data, &opts->socket_unix_data);
+      err |= options_open_socket_unix(optarg, SOCK_DGRAM, &opts->fd_socket_unix_data, &opts->socket_unix_data);
       break;
     case 'c':
-      err |= options_open_socket_unix(optarg, &opts->fd_socket_unix_control, &opts->socket_unix_control);
+      err |= options_open_socket_unix(optarg, SOCK_DGRAM, &opts->fd_socket_unix_control, &opts->socket_unix_control);
       break;
     case 'd':
       opts->daemon = 1;
@@ -356,6 +708,43 @@ options_parse(struct options *opts, int argc, char *argv[])
   if(opts->output_file != NULL)
     opts->output_standard = 0;
 
+  if(opts->fountain != -1 && (opts->fountain < 0 || opts->input_file == NULL))
+  {
+    err_output("--fountain needs a percent of 0 or more and --in-file\n");
+    err |= 1;
+  }
+
+  if(opts->rx_tty_name[0] && (opts->rx_gpio_m0 == -1 || opts->rx_gpio_m1 == -1 || opts->rx_gpio_aux == -1))
+  {
+    err_output("--rx-tty needs --rx-m0, --rx-m1 and --rx-aux\n");
+    err |= 1;
+  }
+
+  if(opts->bond_modules && (opts->reliable || opts->burst || opts->pace || opts->duty_cycle_ppm || opts->rx_tty_name[0]))
+  {
+    err_output("--bond can't be used with --reliable, --burst, --pace, --duty-cycle or --rx-tty\n");
+    err |= 1;
+  }
+
+  if(opts->tx_notify && (opts->reliable || opts->coalesce_ms || opts->bond_modules))
+  {
+    err_output("--tx-notify can't be used with --reliable, --coalesce or --bond\n");
+    err |= 1;
+  }
+
+  if(opts->tx_notify && opts->fd_socket_unix_data == -1)
+  {
+    err_output("--tx-notify needs --sock-unix-data\n");
+    err |= 1;
+  }
+
+  /* without a port to listen on what's received is sent from any port */
+  if(opts->udp_dests && opts->fd_socket_udp == -1)
+  {
+    opts->fd_socket_udp = options_open_socket_udp("0.0.0.0:0");
+    err |= opts->fd_socket_udp == -1;
+  }
+
   if (optind < argc)
   {
     err_output("non-option ARGV-elements: ");
@@ -12,10 +12,28 @@
 #include <sys/types.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include "bond.h"
 #include "error.h"
 
 extern int use_syslog;
 
+/* another e32 given by its UART and pins, the first is the one bonded with */
+#define OPTIONS_BOND_MODULES (BOND_MAX_LINKS-1)
+
+/* where to send what's received over UDP, at most what one sendmmsg in udp_send takes */
+#define OPTIONS_UDP_DESTS 8
+
+/* the MTU of the TUN interface, the least IPv6 allows */
+#define OPTIONS_TUN_MTU 1280
+
+struct options_module
+{
+  char tty_name[64];
+  int gpio_m0;
+  int gpio_m1;
+  int gpio_aux;
+};
+
 struct options
 {
   int help;
@@ -31,13 +49,41 @@ struct options
   int input_standard;
   int output_standard;
   int aux_transition_additional_delay;
+  int frame;
+  int burst;
+  int burst_chunk;
+  int burst_characterize;
+  int pace;
+  int compress;
+  char dictionary_file[128];
+  char dictionary_train_file[128];
+  int priority_prefix;
+  int tx_notify;
+  int coalesce_ms;
+  int reliable;
+  int fountain;
+  int duty_cycle_ppm;
   char tty_name[64];
+  char rx_tty_name[64];
+  int rx_gpio_m0;
+  int rx_gpio_m1;
+  int rx_gpio_aux;
+  int bond_modules;
+  struct options_module bond[OPTIONS_BOND_MODULES];
   uint8_t settings_write_input[6];
   FILE* input_file;
   FILE* output_file;
-  struct sockaddr_in socket_udp_dest;
-  int fd_socket_unix_data, fd_socket_unix_control;
-  struct sockaddr_un socket_unix_data, socket_unix_control;
+  struct sockaddr_in socket_udp;
+  struct sockaddr_in socket_udp_dest[OPTIONS_UDP_DESTS];
+  int udp_dests;
+  int udp_listen;
+  int fd_socket_udp;
+  int fd_tun;
+  char tun_name[16];
+  uint32_t tun_net;
+  int tun_prefix;
+  int fd_socket_unix_data, fd_socket_unix_control, fd_socket_unix_seqpacket;
+  struct sockaddr_un socket_unix_data, socket_unix_control, socket_unix_seqpacket;
 };
 
 void
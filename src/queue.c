@@ -0,0 +1,358 @@
+#include "queue.h"
+
+int
+queue_init(struct Queue *queue, size_t capacity, size_t frame_bytes)
+{
+  memset(queue, 0, sizeof(struct Queue));
+
+  queue->frames = calloc(capacity, sizeof(struct QueueFrame));
+  if(queue->frames == NULL)
+    return -1;
+
+  queue->buf = malloc(capacity * frame_bytes);
+  if(queue->buf == NULL)
+  {
+    free(queue->frames);
+    queue->frames = NULL;
+    return -1;
+  }
+
+  /* every frame starts out on the free list */
+  for(size_t i = 0; i < capacity; i++)
+  {
+    queue->frames[i].data = queue->buf + i*frame_bytes;
+    queue->frames[i].next = i+1 < capacity ? i+1 : -1;
+  }
+
+  queue->capacity = capacity;
+  queue->frame_bytes = frame_bytes;
+  queue->quantum = frame_bytes;
+  queue->free = capacity > 0 ? 0 : -1;
+  queue->tail = -1;
+
+  for(int i = 0; i < QUEUE_SOURCES; i++)
+    queue->quota[i] = capacity;
+
+  for(int i = 0; i < QUEUE_CLASSES; i++)
+  {
+    queue->active_head[i] = -1;
+    queue->active_tail[i] = -1;
+  }
+
+  for(int i = 0; i < QUEUE_FLOWS; i++)
+  {
+    queue->flows[i].head = -1;
+    queue->flows[i].tail = -1;
+    queue->flows[i].next = -1;
+  }
+
+  return 0;
+}
+
+void
+queue_destroy(struct Queue *queue)
+{
+  free(queue->frames);
+  free(queue->buf);
+  memset(queue, 0, sizeof(struct Queue));
+}
+
+void
+queue_set_quota(struct Queue *queue, enum QueueSource source, size_t quota)
+{
+  if(quota > queue->capacity)
+    quota = queue->capacity;
+  queue->quota[source] = quota;
+}
+
+/* how much cost a flow may send each time it gets a turn */
+void
+queue_set_quantum(struct Queue *queue, uint64_t quantum)
+{
+  queue->quantum = quantum > 0 ? quantum : 1;
+}
+
+/* frames a source can push, what's reserved isn't counted */
+size_t
+queue_available(struct Queue *queue, enum QueueSource source)
+{
+  size_t free_quota, free_ring;
+
+  if(queue->used[source] + queue->reserved[source] >= queue->quota[source] ||
+      queue->size + queue->reserved_size >= queue->capacity)
+    return 0;
+
+  free_quota = queue->quota[source] - queue->used[source] - queue->reserved[source];
+  free_ring = queue->capacity - queue->size - queue->reserved_size;
+
+  return free_quota < free_ring ? free_quota : free_ring;
+}
+
+/* set aside frames for a source, fails if it doesn't have that many available */
+int
+queue_reserve(struct Queue *queue, enum QueueSource source, size_t frames)
+{
+  if(frames > queue_available(queue, source))
+    return -1;
+
+  queue->reserved[source] += frames;
+  queue->reserved_size += frames;
+  return 0;
+}
+
+/* give reserved frames back, to be pushed or for any source to use */
+void
+queue_release(struct Queue *queue, enum QueueSource source, size_t frames)
+{
+  if(frames > queue->reserved[source])
+    frames = queue->reserved[source];
+
+  queue->reserved[source] -= frames;
+  queue->reserved_size -= frames;
+}
+
+/*
+  Find the flow for a client in a class, or take over a flow with no
+  frames queued. Flows are taken over in turn so a flow which was just
+  handed out isn't handed out again before frames are pushed to it.
+  Returns -1 if every flow has frames.
+*/
+int
+queue_flow(struct Queue *queue, enum QueueSource source, enum QueueClass class, int channel, const char *name)
+{
+  struct QueueFlow *flow;
+  int unused = -1;
+
+  for(int i = 0; i < QUEUE_FLOWS; i++)
+  {
+    flow = &queue->flows[i];
+    if(flow->source == source && flow->class == class && flow->channel == channel &&
+        strncmp(flow->name, name, QUEUE_FLOW_NAME) == 0)
+      return i;
+  }
+
+  for(int i = 0; i < QUEUE_FLOWS && unused == -1; i++)
+  {
+    if(queue->flows[(queue->next_flow + i) % QUEUE_FLOWS].frames == 0)
+      unused = (queue->next_flow + i) % QUEUE_FLOWS;
+  }
+
+  if(unused == -1)
+    return -1;
+  queue->next_flow = (unused + 1) % QUEUE_FLOWS;
+
+  flow = &queue->flows[unused];
+  flow->source = source;
+  flow->class = class;
+  flow->channel = channel;
+  strncpy(flow->name, name, QUEUE_FLOW_NAME-1);
+  flow->name[QUEUE_FLOW_NAME-1] = '\0';
+  flow->deficit = 0;
+
+  return unused;
+}
+
+/*
+  A flow with frames waits its turn after the last flow in its class to
+  the same channel, or at the end of its class if there are none or a
+  flow it would pass has been passed QUEUE_MAX_PASSED times already.
+*/
+static void
+queue_activate(struct Queue *queue, int flow)
+{
+  struct QueueFlow *qflow;
+  int after = -1;
+
+  qflow = &queue->flows[flow];
+  for(int i = queue->active_head[qflow->class]; i != -1; i = queue->flows[i].next)
+  {
+    if(queue->flows[i].channel == qflow->channel)
+      after = i;
+  }
+
+  for(int i = after != -1 ? queue->flows[after].next : -1; i != -1; i = queue->flows[i].next)
+  {
+    if(queue->flows[i].passed >= QUEUE_MAX_PASSED)
+    {
+      after = -1;
+      break;
+    }
+  }
+
+  if(after == -1)
+    after = queue->active_tail[qflow->class];
+  else
+  {
+    for(int i = queue->flows[after].next; i != -1; i = queue->flows[i].next)
+      queue->flows[i].passed++;
+  }
+
+  qflow->active = 1;
+  qflow->passed = 0;
+  if(after == -1)
+  {
+    qflow->next = -1;
+    queue->active_head[qflow->class] = flow;
+  }
+  else
+  {
+    qflow->next = queue->flows[after].next;
+    queue->flows[after].next = flow;
+  }
+
+  if(qflow->next == -1)
+    queue->active_tail[qflow->class] = flow;
+}
+
+int
+queue_push(struct Queue *queue, int flow, const uint8_t *data, size_t len, uint64_t cost)
+{
+  struct QueueFlow *qflow;
+  struct QueueFrame *frame;
+  int index;
+
+  if(flow < 0 || flow >= QUEUE_FLOWS || len > queue->frame_bytes)
+    return -1;
+
+  qflow = &queue->flows[flow];
+  if(queue_available(queue, qflow->source) == 0)
+    return -1;
+
+  index = queue->free;
+  frame = &queue->frames[index];
+  queue->free = frame->next;
+
+  frame->source = qflow->source;
+  frame->flow = flow;
+  frame->next = -1;
+  frame->len = len;
+  frame->cost = cost > 0 ? cost : 1;
+  frame->queued_us = 0;
+  frame->done_us = 0;
+  frame->seq = 0;
+  memcpy(frame->data, data, len);
+
+  if(qflow->tail == -1)
+    qflow->head = index;
+  else
+    queue->frames[qflow->tail].next = index;
+  qflow->tail = index;
+  qflow->frames++;
+
+  if(!qflow->active)
+    queue_activate(queue, flow);
+
+  queue->cost[qflow->class] += frame->cost;
+  queue->tail = index;
+  queue->size++;
+  queue->used[qflow->source]++;
+  return 0;
+}
+
+/*
+  The next frame to send is the head of the first flow in the lowest
+  class with frames whose deficit covers it. A flow which can't afford
+  its frame is given a quantum and goes to the back of its class. Once
+  a frame is found peeking again returns the same frame until it's
+  popped or a frame of a lower class is pushed.
+*/
+struct QueueFrame*
+queue_peek(struct Queue *queue)
+{
+  struct QueueFlow *flow;
+  struct QueueFrame *frame;
+  int index;
+
+  for(int class = 0; class < QUEUE_CLASSES; class++)
+  {
+    while((index = queue->active_head[class]) != -1)
+    {
+      flow = &queue->flows[index];
+      frame = &queue->frames[flow->head];
+      if(flow->deficit >= (int64_t) frame->cost)
+        return frame;
+
+      flow->deficit += queue->quantum;
+      if(flow->next != -1)
+      {
+        queue->active_head[class] = flow->next;
+        queue->flows[queue->active_tail[class]].next = index;
+        queue->active_tail[class] = index;
+        flow->next = -1;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* the frame pushed last */
+struct QueueFrame*
+queue_tail(struct Queue *queue)
+{
+  if(queue->size == 0 || queue->tail == -1)
+    return NULL;
+
+  return &queue->frames[queue->tail];
+}
+
+int
+queue_pop(struct Queue *queue)
+{
+  struct QueueFrame *frame;
+  struct QueueFlow *flow;
+  int index;
+
+  frame = queue_peek(queue);
+  if(frame == NULL)
+    return -1;
+
+  flow = &queue->flows[frame->flow];
+  index = flow->head;
+
+  flow->deficit -= frame->cost;
+  flow->head = frame->next;
+  flow->frames--;
+  flow->passed = 0;
+
+  /* an empty flow leaves the round and gives up what it had left */
+  if(flow->frames == 0)
+  {
+    flow->tail = -1;
+    flow->deficit = 0;
+    flow->active = 0;
+    queue->active_head[flow->class] = flow->next;
+    if(flow->next == -1)
+      queue->active_tail[flow->class] = -1;
+    flow->next = -1;
+  }
+
+  if(queue->tail == index)
+    queue->tail = -1;
+
+  queue->cost[flow->class] -= frame->cost;
+  queue->used[frame->source]--;
+  queue->size--;
+
+  frame->next = queue->free;
+  queue->free = index;
+  return 0;
+}
+
+size_t
+queue_size(struct Queue *queue)
+{
+  return queue->size;
+}
+
+/* the cost of every frame queued in this class or a lower one */
+uint64_t
+queue_cost_ahead(struct Queue *queue, enum QueueClass class)
+{
+  uint64_t cost = 0;
+
+  for(int i = 0; i <= class; i++)
+    cost += queue->cost[i];
+
+  return cost;
+}
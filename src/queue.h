@@ -0,0 +1,155 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* each input which can feed frames into the transmit queue */
+enum QueueSource
+{
+  QUEUE_SOURCE_STDIN,
+  QUEUE_SOURCE_FILE,
+  QUEUE_SOURCE_SOCKET_UNIX_DATA,
+  QUEUE_SOURCE_SOCKET_UNIX_SESSION,
+  QUEUE_SOURCE_SOCKET_UDP,
+  QUEUE_SOURCE_TUN,
+  QUEUE_SOURCES
+};
+
+/*
+ Priority classes, a lower class is always sent first. A frame of a
+ lower class waits at most for the frame being transmitted, a large
+ message in a higher class is preempted between its fragments.
+*/
+enum QueueClass
+{
+  QUEUE_CLASS_URGENT,
+  QUEUE_CLASS_NORMAL,
+  QUEUE_CLASS_BULK,
+  QUEUE_CLASSES
+};
+
+#define QUEUE_FLOWS 64
+#define QUEUE_FLOW_NAME 108
+
+/*
+ A flow joining its class next to flows to the same channel passes the
+ flows waiting behind them, a waiting flow is passed at most this many
+ times before it has its turn.
+*/
+#define QUEUE_MAX_PASSED 4
+
+struct QueueFrame
+{
+  enum QueueSource source;
+  int flow;
+  int next;
+  size_t len;
+  uint8_t *data;
+  uint64_t cost;
+  uint64_t queued_us;
+  uint64_t done_us;
+  uint32_t seq;
+};
+
+/*
+ The frames from one client in one class to one channel, sent in the
+ order queued
+*/
+struct QueueFlow
+{
+  enum QueueSource source;
+  enum QueueClass class;
+  int channel;
+  char name[QUEUE_FLOW_NAME];
+  size_t frames;
+  int head;
+  int tail;
+  int next;
+  int active;
+  int passed;
+  int64_t deficit;
+};
+
+/*
+ A bounded pool of frames waiting to be transmitted. The frame data
+ lives in one contiguous buffer allocated up front so pushing and
+ popping never allocate. Every source has its own quota of frames
+ so a busy source fills its share and is throttled without blocking
+ the others. Frames promised to a client can be reserved, they count
+ against the quota of the source and the ring until they're released
+ so no other source fills them first.
+
+ Frames are kept in flows, one for each client and class. The next
+ frame comes from the lowest class with frames queued and within a
+ class flows take turns by deficit round robin. The cost of a frame
+ is its time on air, so a client sending many small frames gets no
+ more of the radio than one sending full ones. A flow joins its class
+ next to flows to the same channel and keeps its place in the round,
+ so frames to a channel tend to go out together.
+*/
+struct Queue
+{
+  size_t capacity;
+  size_t frame_bytes;
+  size_t size;
+  size_t used[QUEUE_SOURCES];
+  size_t quota[QUEUE_SOURCES];
+  size_t reserved[QUEUE_SOURCES];
+  size_t reserved_size;
+  uint64_t quantum;
+  uint64_t cost[QUEUE_CLASSES];
+  int active_head[QUEUE_CLASSES];
+  int active_tail[QUEUE_CLASSES];
+  int free;
+  int tail;
+  int next_flow;
+  struct QueueFlow flows[QUEUE_FLOWS];
+  struct QueueFrame *frames;
+  uint8_t *buf;
+};
+
+int
+queue_init(struct Queue *queue, size_t capacity, size_t frame_bytes);
+
+void
+queue_destroy(struct Queue *queue);
+
+void
+queue_set_quota(struct Queue *queue, enum QueueSource source, size_t quota);
+
+void
+queue_set_quantum(struct Queue *queue, uint64_t quantum);
+
+size_t
+queue_available(struct Queue *queue, enum QueueSource source);
+
+int
+queue_reserve(struct Queue *queue, enum QueueSource source, size_t frames);
+
+void
+queue_release(struct Queue *queue, enum QueueSource source, size_t frames);
+
+int
+queue_flow(struct Queue *queue, enum QueueSource source, enum QueueClass class, int channel, const char *name);
+
+int
+queue_push(struct Queue *queue, int flow, const uint8_t *data, size_t len, uint64_t cost);
+
+struct QueueFrame*
+queue_peek(struct Queue *queue);
+
+struct QueueFrame*
+queue_tail(struct Queue *queue);
+
+int
+queue_pop(struct Queue *queue);
+
+size_t
+queue_size(struct Queue *queue);
+
+uint64_t
+queue_cost_ahead(struct Queue *queue, enum QueueClass class);
+
+#endif
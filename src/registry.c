@@ -0,0 +1,302 @@
+#include "registry.h"
+
+/* FNV-1a of the socket path */
+static uint32_t
+registry_hash(const char *path)
+{
+  uint32_t hash = 2166136261u;
+
+  for(size_t i = 0; i < sizeof(((struct sockaddr_un*) 0)->sun_path) && path[i]; i++)
+  {
+    hash ^= (uint8_t) path[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static int
+registry_path_match(struct Registry *registry, int32_t position, const char *path)
+{
+  return position >= 0 && strncmp(registry->clients[position].addr.sun_path, path, sizeof(registry->clients[position].addr.sun_path)) == 0;
+}
+
+/* the slot in the index for a path, -1 if it isn't registered */
+static ssize_t
+registry_slot(struct Registry *registry, const char *path)
+{
+  size_t mask, slot;
+
+  mask = registry->index_size - 1;
+  for(slot = registry_hash(path) & mask; registry->index[slot] != REGISTRY_EMPTY; slot = (slot + 1) & mask)
+  {
+    if(registry_path_match(registry, registry->index[slot], path))
+      return slot;
+  }
+
+  return -1;
+}
+
+/* the first free slot for a path which isn't registered */
+static size_t
+registry_free_slot(struct Registry *registry, const char *path)
+{
+  size_t mask, slot;
+
+  mask = registry->index_size - 1;
+  for(slot = registry_hash(path) & mask; registry->index[slot] >= 0; slot = (slot + 1) & mask)
+    ;
+
+  return slot;
+}
+
+/* rebuild the index at a size which keeps it at most half full */
+static int
+registry_rehash(struct Registry *registry, size_t clients)
+{
+  int32_t *index;
+  size_t index_size;
+
+  index_size = REGISTRY_INITIAL_CAPACITY * 2;
+  while(index_size < clients * 2)
+    index_size *= 2;
+
+  index = malloc(index_size * sizeof(int32_t));
+  if(index == NULL)
+    return -1;
+
+  free(registry->index);
+  registry->index = index;
+  registry->index_size = index_size;
+  registry->deleted = 0;
+  for(size_t i = 0; i < index_size; i++)
+    index[i] = REGISTRY_EMPTY;
+
+  for(size_t i = 0; i < registry->size; i++)
+    index[registry_free_slot(registry, registry->clients[i].addr.sun_path)] = i;
+
+  return 0;
+}
+
+int
+registry_init(struct Registry *registry)
+{
+  memset(registry, 0, sizeof(struct Registry));
+
+  registry->clients = malloc(REGISTRY_INITIAL_CAPACITY * sizeof(struct RegistryClient));
+  if(registry->clients == NULL)
+    return -1;
+  registry->capacity = REGISTRY_INITIAL_CAPACITY;
+
+  if(registry_rehash(registry, REGISTRY_INITIAL_CAPACITY))
+  {
+    registry_destroy(registry);
+    return -1;
+  }
+
+  return 0;
+}
+
+void
+registry_destroy(struct Registry *registry)
+{
+  free(registry->clients);
+  free(registry->index);
+  memset(registry, 0, sizeof(struct Registry));
+}
+
+struct RegistryClient*
+registry_find(struct Registry *registry, const struct sockaddr_un *addr)
+{
+  ssize_t slot;
+
+  slot = registry_slot(registry, addr->sun_path);
+  if(slot == -1)
+    return NULL;
+
+  return &registry->clients[registry->index[slot]];
+}
+
+/* register a client, returns it if it already was, NULL if out of memory */
+struct RegistryClient*
+registry_add(struct Registry *registry, const struct sockaddr_un *addr)
+{
+  struct RegistryClient *client, *clients;
+
+  client = registry_find(registry, addr);
+  if(client != NULL)
+    return client;
+
+  if(registry->size == registry->capacity)
+  {
+    clients = realloc(registry->clients, 2 * registry->capacity * sizeof(struct RegistryClient));
+    if(clients == NULL)
+      return NULL;
+    registry->clients = clients;
+    registry->capacity *= 2;
+  }
+
+  if(2 * (registry->size + registry->deleted + 1) > registry->index_size &&
+      registry_rehash(registry, registry->size + 1))
+    return NULL;
+
+  client = &registry->clients[registry->size];
+  memset(client, 0, sizeof(struct RegistryClient));
+  memcpy(&client->addr, addr, sizeof(struct sockaddr_un));
+  client->class = QUEUE_CLASS_NORMAL;
+
+  registry->index[registry_free_slot(registry, addr->sun_path)] = registry->size;
+  registry->size++;
+  return client;
+}
+
+/* remove the client at a place in the array, the last client takes its place */
+void
+registry_remove_at(struct Registry *registry, size_t position)
+{
+  size_t last;
+  ssize_t slot;
+
+  if(position >= registry->size)
+    return;
+
+  slot = registry_slot(registry, registry->clients[position].addr.sun_path);
+  registry->index[slot] = REGISTRY_DELETED;
+  registry->deleted++;
+
+  last = registry->size - 1;
+  if(position != last)
+  {
+    slot = registry_slot(registry, registry->clients[last].addr.sun_path);
+    registry->index[slot] = position;
+    memcpy(&registry->clients[position], &registry->clients[last], sizeof(struct RegistryClient));
+  }
+
+  registry->size--;
+}
+
+int
+registry_remove(struct Registry *registry, const struct sockaddr_un *addr)
+{
+  ssize_t slot;
+
+  slot = registry_slot(registry, addr->sun_path);
+  if(slot == -1)
+    return -1;
+
+  registry_remove_at(registry, registry->index[slot]);
+  return 0;
+}
+
+size_t
+registry_size(struct Registry *registry)
+{
+  return registry->size;
+}
+
+/* the leading bytes of a message as a word, the first byte highest */
+static uint64_t
+registry_head(const uint8_t *buf, size_t len)
+{
+  uint64_t head = 0;
+
+  for(size_t i = 0; i < REGISTRY_FILTER_BYTES; i++)
+    head = (head << 8) | (i < len ? buf[i] : 0);
+
+  return head;
+}
+
+/* returns -1 if there are more leading bytes than a filter holds */
+int
+registry_filter_compile(struct RegistryFilter *filter, uint16_t source_min, uint16_t source_max, const uint8_t *mask, const uint8_t *value, size_t len)
+{
+  if(len > REGISTRY_FILTER_BYTES || source_min > source_max)
+    return -1;
+
+  filter->active = 1;
+  filter->source_min = source_min;
+  filter->source_max = source_max;
+  filter->len = len;
+  filter->mask = registry_head(mask, len);
+  filter->value = registry_head(value, len) & filter->mask;
+  return 0;
+}
+
+void
+registry_message(struct RegistryMessage *message, const uint8_t *buf, size_t len, int source)
+{
+  message->source = source;
+  message->len = len;
+  message->head = registry_head(buf, len);
+}
+
+int
+registry_filter_match(const struct RegistryFilter *filter, const struct RegistryMessage *message)
+{
+  if(!filter->active)
+    return 1;
+
+  if(message->source == REGISTRY_NO_SOURCE)
+  {
+    if(filter->source_min != 0 || filter->source_max != 0xFFFF)
+      return 0;
+  }
+  else if(message->source < filter->source_min || message->source > filter->source_max)
+    return 0;
+
+  return message->len >= filter->len && (message->head & filter->mask) == filter->value;
+}
+
+/*
+  Send a message to every client whose filter matches it. A batch stops
+  at the first client it can't send to and the rest of it is sent again.
+  Clients which failed are removed after their batch, the batches go
+  from the end of the registry so the clients moved into their places
+  have already been sent to. Returns how many were removed.
+*/
+int
+registry_send(struct Registry *registry, struct RegistryBatch *batch, int fd, const struct msghdr *msg, const struct RegistryMessage *message)
+{
+  struct RegistryClient *client;
+  size_t start, end;
+  int clients, sent, failed;
+
+  failed = 0;
+  for(end = registry->size; end > 0; end = start)
+  {
+    start = end > REGISTRY_SEND_BATCH ? end - REGISTRY_SEND_BATCH : 0;
+    clients = 0;
+    for(size_t position = start; position < end; position++)
+    {
+      client = &registry->clients[position];
+      if(!registry_filter_match(&client->filter, message))
+        continue;
+
+      batch->msgs[clients].msg_hdr = *msg;
+      batch->msgs[clients].msg_hdr.msg_name = &client->addr;
+      batch->msgs[clients].msg_hdr.msg_namelen = sizeof(struct sockaddr_un);
+      batch->positions[clients] = position;
+      batch->failed[clients] = 0;
+      clients++;
+    }
+
+    for(int i = 0; i < clients; i += sent)
+    {
+      sent = sendmmsg(fd, batch->msgs+i, clients-i, 0);
+      if(sent == -1)
+      {
+        batch->failed[i] = 1;
+        failed++;
+        sent = 1;
+      }
+    }
+
+    for(int i = clients; i-- > 0; )
+    {
+      if(batch->failed[i])
+        registry_remove_at(registry, batch->positions[i]);
+    }
+  }
+
+  return failed;
+}
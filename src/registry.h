@@ -0,0 +1,123 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include "queue.h"
+
+/*
+ The clients registered on the data socket. Clients are kept packed in
+ an array so sending to all of them is a walk over contiguous memory,
+ removing one moves the last client into its place. An open addressing
+ hash table on the socket path, with linear probing, maps a path to its
+ place in the array so registering, finding and removing a client don't
+ depend on how many there are.
+
+ A client's place changes when another is removed, pointers into the
+ array are only good until the next add or remove.
+*/
+#define REGISTRY_INITIAL_CAPACITY 16
+#define REGISTRY_EMPTY -1
+#define REGISTRY_DELETED -2
+
+/*
+ A client can ask for only some of what's received. A filter has a range
+ of sender addresses and a mask and value for the leading bytes of the
+ message, a byte with a mask of 0xFF is a tag to match and 0x00 is a
+ byte which doesn't matter. Messages without a sender, outside of fixed
+ mode, only match when the range covers every address.
+
+ The leading bytes are compiled into a 64 bit mask and value and each
+ message has its leading bytes loaded into a word once, so checking a
+ client is a couple of compares however the filter was written.
+*/
+#define REGISTRY_FILTER_BYTES 8
+#define REGISTRY_NO_SOURCE -1
+
+struct RegistryFilter
+{
+  int active;
+  uint16_t source_min;
+  uint16_t source_max;
+  size_t len;
+  uint64_t mask;
+  uint64_t value;
+};
+
+struct RegistryMessage
+{
+  int source;
+  size_t len;
+  uint64_t head;
+};
+
+struct RegistryClient
+{
+  struct sockaddr_un addr;
+  enum QueueClass class;
+  struct RegistryFilter filter;
+};
+
+struct Registry
+{
+  struct RegistryClient *clients;
+  size_t size;
+  size_t capacity;
+  int32_t *index;
+  size_t index_size;
+  size_t deleted;
+};
+
+/*
+ A message goes to every client whose filter matches with one sendmmsg
+ for each REGISTRY_SEND_BATCH clients, the most the kernel takes in a
+ call. A client which can't be sent to is removed.
+*/
+#define REGISTRY_SEND_BATCH 1024
+
+struct RegistryBatch
+{
+  struct mmsghdr msgs[REGISTRY_SEND_BATCH];
+  size_t positions[REGISTRY_SEND_BATCH];
+  int failed[REGISTRY_SEND_BATCH];
+};
+
+int
+registry_init(struct Registry *registry);
+
+void
+registry_destroy(struct Registry *registry);
+
+struct RegistryClient*
+registry_find(struct Registry *registry, const struct sockaddr_un *addr);
+
+struct RegistryClient*
+registry_add(struct Registry *registry, const struct sockaddr_un *addr);
+
+int
+registry_remove(struct Registry *registry, const struct sockaddr_un *addr);
+
+void
+registry_remove_at(struct Registry *registry, size_t position);
+
+size_t
+registry_size(struct Registry *registry);
+
+int
+registry_filter_compile(struct RegistryFilter *filter, uint16_t source_min, uint16_t source_max, const uint8_t *mask, const uint8_t *value, size_t len);
+
+void
+registry_message(struct RegistryMessage *message, const uint8_t *buf, size_t len, int source);
+
+int
+registry_filter_match(const struct RegistryFilter *filter, const struct RegistryMessage *message);
+
+int
+registry_send(struct Registry *registry, struct RegistryBatch *batch, int fd, const struct msghdr *msg, const struct RegistryMessage *message);
+
+#endif
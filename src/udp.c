@@ -0,0 +1,130 @@
+#include "udp.h"
+
+/* ADDR:PORT or just PORT on the loopback address, returns -1 if it isn't either */
+int
+udp_parse_addr(struct sockaddr_in *addr, const char *arg)
+{
+  char host[INET_ADDRSTRLEN];
+  const char *colon, *port;
+  char *end;
+  long num;
+
+  memset(addr, 0, sizeof(struct sockaddr_in));
+  addr->sin_family = AF_INET;
+
+  colon = strrchr(arg, ':');
+  if(colon == NULL)
+  {
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    port = arg;
+  }
+  else
+  {
+    if(colon - arg == 0 || colon - arg >= INET_ADDRSTRLEN)
+      return -1;
+    memcpy(host, arg, colon - arg);
+    host[colon - arg] = '\0';
+    if(inet_pton(AF_INET, host, &addr->sin_addr) != 1)
+      return -1;
+    port = colon + 1;
+  }
+
+  num = strtol(port, &end, 10);
+  if(*port == '\0' || *end != '\0' || num < 0 || num > 65535)
+    return -1;
+  addr->sin_port = htons(num);
+
+  return 0;
+}
+
+/* a non-blocking socket bound to addr, -1 on an error with errno set */
+int
+udp_open(const struct sockaddr_in *addr)
+{
+  int fd;
+
+  fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(fd == -1)
+    return -1;
+
+  if(bind(fd, (struct sockaddr*) addr, sizeof(struct sockaddr_in)) == -1)
+  {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/*
+  Read up to count datagrams waiting on fd with one recvmmsg. The length
+  of each is in msgs[i].msg_len and who sent it in addrs[i]. A datagram
+  longer than UDP_DATAGRAM_BYTES is cut short, its msg_flags has
+  MSG_TRUNC. Returns how many were read, 0 if there were none.
+*/
+int
+udp_recv(struct UdpBatch *batch, int fd, int count)
+{
+  struct msghdr *hdr;
+  int received;
+
+  if(count > UDP_RECV_BATCH)
+    count = UDP_RECV_BATCH;
+
+  for(int i = 0; i < count; i++)
+  {
+    batch->iov[i].iov_base = batch->bufs[i];
+    batch->iov[i].iov_len = UDP_DATAGRAM_BYTES;
+
+    hdr = &batch->msgs[i].msg_hdr;
+    memset(hdr, 0, sizeof(struct msghdr));
+    hdr->msg_name = &batch->addrs[i];
+    hdr->msg_namelen = sizeof(struct sockaddr_in);
+    hdr->msg_iov = &batch->iov[i];
+    hdr->msg_iovlen = 1;
+  }
+
+  received = recvmmsg(fd, batch->msgs, count, MSG_DONTWAIT, NULL);
+  if(received == -1)
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+  return received;
+}
+
+/*
+  Send the pieces in iov as one datagram to every destination with one
+  sendmmsg. A destination which can't be sent to is skipped. Returns how
+  many weren't sent to.
+*/
+int
+udp_send(struct UdpBatch *batch, int fd, const struct sockaddr_in *dests, size_t ndests, struct iovec *iov, size_t iovlen)
+{
+  struct msghdr *hdr;
+  int sent, failed;
+
+  if(ndests > UDP_MAX_DESTS)
+    ndests = UDP_MAX_DESTS;
+
+  for(size_t i = 0; i < ndests; i++)
+  {
+    hdr = &batch->sends[i].msg_hdr;
+    memset(hdr, 0, sizeof(struct msghdr));
+    hdr->msg_name = (void*) &dests[i];
+    hdr->msg_namelen = sizeof(struct sockaddr_in);
+    hdr->msg_iov = iov;
+    hdr->msg_iovlen = iovlen;
+  }
+
+  failed = 0;
+  for(size_t i = 0; i < ndests; i += sent)
+  {
+    sent = sendmmsg(fd, batch->sends+i, ndests-i, MSG_DONTWAIT);
+    if(sent == -1)
+    {
+      failed++;
+      sent = 1;
+    }
+  }
+
+  return failed;
+}
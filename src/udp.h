@@ -0,0 +1,47 @@
+#ifndef UDP_H
+#define UDP_H
+
+#include "config.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/*
+ A bridge between UDP and the e32. Datagrams to a local port are read
+ UDP_RECV_BATCH at a time with recvmmsg and what's received over the air
+ goes to every destination with one sendmmsg. Addresses are given as
+ ADDR:PORT, a port on its own is on the loopback address so nothing off
+ the host can send over the radio unless asked to.
+*/
+#define UDP_MAX_DESTS 8
+#define UDP_RECV_BATCH 16
+#define UDP_DATAGRAM_BYTES 16400
+
+struct UdpBatch
+{
+  struct mmsghdr msgs[UDP_RECV_BATCH];
+  struct iovec iov[UDP_RECV_BATCH];
+  struct sockaddr_in addrs[UDP_RECV_BATCH];
+  uint8_t bufs[UDP_RECV_BATCH][UDP_DATAGRAM_BYTES];
+  struct mmsghdr sends[UDP_MAX_DESTS];
+};
+
+int
+udp_parse_addr(struct sockaddr_in *addr, const char *arg);
+
+int
+udp_open(const struct sockaddr_in *addr);
+
+int
+udp_recv(struct UdpBatch *batch, int fd, int count);
+
+int
+udp_send(struct UdpBatch *batch, int fd, const struct sockaddr_in *dests, size_t ndests, struct iovec *iov, size_t iovlen);
+
+#endif
@@ -0,0 +1,50 @@
+#include "airtime.h"
+#include <stdio.h>
+
+int
+main(int argc, char *argv[])
+{
+    struct Airtime airtime;
+    uint64_t us;
+
+    // Test an air data rate without a model
+    if(airtime_init(&airtime, 1234, 0, 9600) != -1)
+        return 1;
+    if(airtime_us(&airtime, 58) != 0)
+        return 2;
+
+    // Test a full packet at 300 bps against the LoRa modem calculator
+    if(airtime_init(&airtime, 300, 0, 9600))
+        return 3;
+    us = airtime_model_us(&airtime, 58);
+    printf("58 bytes at 300 bps takes %llu us\n", (unsigned long long) us);
+    if(us != 2690048)
+        return 4;
+
+    // Test the time on air of the LoRa modulation leaves out the UART
+    if(airtime_lora_us(&airtime, 58) + airtime_uart_us(&airtime, 58) != us)
+        return 10;
+
+    // Test FEC and longer payloads take longer
+    if(airtime_us(&airtime, 10) >= us)
+        return 5;
+    airtime_init(&airtime, 300, 1, 9600);
+    if(airtime_us(&airtime, 58) <= us)
+        return 6;
+
+    // Test faster air data rates take less time
+    airtime_init(&airtime, 2400, 0, 9600);
+    if(airtime_us(&airtime, 58) >= us)
+        return 7;
+
+    // Test calibration moves towards what was measured
+    us = airtime_us(&airtime, 58);
+    for(int i=0; i<64; i++)
+        airtime_calibrate(&airtime, 58, 2*us);
+    if(airtime.scale < 1900 || airtime.scale > 2000)
+        return 8;
+    if(airtime_us(&airtime, 58) < 19*us/10)
+        return 9;
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "arq.h"
+#include <stdio.h>
+
+#define FRAMES 200
+#define FRAME_LEN 20
+
+uint8_t received[FRAMES*FRAME_LEN];
+size_t received_len;
+unsigned int rand_state = 1;
+
+/* drop about one in every five frames */
+int
+lost()
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return ((rand_state >> 16) % 5) == 0;
+}
+
+void
+send(struct Arq *to, uint8_t *frame, size_t len, uint64_t now, int lossy)
+{
+    ssize_t bytes;
+
+    if(lossy && lost())
+        return;
+
+    arq_read(to, frame, len, now);
+    while((bytes = arq_deliver(to, received+received_len, sizeof(received)-received_len)) > 0)
+        received_len += bytes;
+}
+
+/* send from a to b over a channel which loses frames, returns the time taken */
+uint64_t
+transfer(struct Arq *a, struct Arq *b, int lossy)
+{
+    struct ArqSlot *slot;
+    uint8_t data[FRAME_LEN], ack[ARQ_ACK_LENGTH];
+    int pushed;
+    uint64_t now;
+
+    pushed = 0;
+    received_len = 0;
+    for(now = 0; now < 1000000000; now += 100000)
+    {
+        if(pushed == FRAMES && arq_outstanding(a) == 0)
+            return now;
+
+        if(arq_ack_due(b, now))
+            send(a, ack, arq_write_ack(b, ack, now), now, lossy);
+
+        if(arq_timeout(a, now))
+            return 0;
+
+        if((slot = arq_lost(a)) != NULL)
+        {
+            arq_write(a, slot, pushed < FRAMES, now);
+            send(b, slot->data, slot->len, now, lossy);
+        }
+        else if(a->poll_due)
+        {
+            send(b, ack, arq_write_ack(a, ack, now), now, lossy);
+        }
+        else if(pushed < FRAMES && arq_window_open(a))
+        {
+            memset(data, pushed, sizeof(data));
+            slot = arq_push(a, NULL, 0, data, sizeof(data));
+            pushed++;
+            arq_write(a, slot, pushed < FRAMES, now);
+            send(b, slot->data, slot->len, now, lossy);
+        }
+
+    }
+
+    return 0;
+}
+
+int
+check()
+{
+    if(received_len != sizeof(received))
+        return 1;
+    for(int i=0; i<FRAMES; i++)
+        for(int j=0; j<FRAME_LEN; j++)
+            if(received[i*FRAME_LEN+j] != (uint8_t) i)
+                return 1;
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct Arq a, b;
+    uint64_t clean, lossy;
+
+    // Test frames arrive in order without loss
+    arq_init(&a, 7, 1000000, 300000, 500000);
+    arq_init(&b, 9, 1000000, 300000, 500000);
+    clean = transfer(&a, &b, 0);
+    if(clean == 0 || check())
+        return 1;
+    if(a.retransmits != 0 || b.duplicates != 0)
+        return 2;
+
+    // Test the round trip time was measured
+    if(a.srtt_us == 0 || a.rto_us < 300000)
+        return 3;
+
+    // Test every frame still arrives in order when a fifth are lost
+    arq_init(&a, 8, 1000000, 300000, 500000);
+    lossy = transfer(&a, &b, 1);
+    printf("%d frames took %llu ms without loss, %llu ms with loss, %d retransmits\n", FRAMES,
+        (unsigned long long) clean / 1000, (unsigned long long) lossy / 1000, (int) a.retransmits);
+    if(lossy == 0 || check())
+        return 4;
+    if(a.retransmits == 0 || a.failed != 0)
+        return 5;
+
+    // Test the sender gives up and starts a new session when nothing answers
+    arq_init(&a, 10, 1000000, 300000, 500000);
+    arq_write(&a, arq_push(&a, NULL, 0, (uint8_t*) "x", 1), 0, 0);
+    for(uint64_t now = 0; now < 1000000000 && a.failed == 0; now += 100000)
+    {
+        uint8_t ack[ARQ_ACK_LENGTH];
+        arq_timeout(&a, now);
+        if(a.poll_due)
+            arq_write_ack(&a, ack, now);
+    }
+    if(a.failed != 1 || a.session != 11 || arq_outstanding(&a) != 0)
+        return 6;
+
+    return 0;
+}
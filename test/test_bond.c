@@ -0,0 +1,159 @@
+#include "bond.h"
+#include <stdio.h>
+
+#define LINKS 3
+#define PACKETS 30
+
+uint8_t packets[PACKETS][BOND_HEADER_LENGTH+1];
+int links[PACKETS];
+
+int
+main(int argc, char *argv[])
+{
+    struct Bond tx, rx;
+    uint64_t ready[LINKS], air[LINKS];
+    uint8_t buf[BOND_FRAME_BYTES];
+    int counts[LINKS];
+    ssize_t len;
+    int link, next;
+
+    // Test packets go to the link which finishes them first
+    bond_init(&tx, LINKS, 7, 0);
+    memset(counts, 0, sizeof(counts));
+    memset(ready, 0, sizeof(ready));
+    air[0] = 100;
+    air[1] = 100;
+    air[2] = 400;
+    for(int i = 0; i < PACKETS; i++)
+    {
+        link = bond_pick(&tx, ready, air);
+        ready[link] += air[link];
+        counts[link]++;
+        links[i] = link;
+        bond_header(&tx, link, packets[i]);
+        packets[i][BOND_HEADER_LENGTH] = i;
+    }
+    if(counts[0] != 14 || counts[1] != 13 || counts[2] != 3)
+        return 1;
+
+    // Test the receiver puts packets from each link back in order
+    bond_init(&rx, LINKS, 0, 1000);
+    for(link = LINKS; link-- > 0; )
+    {
+        for(int i = 0; i < PACKETS; i++)
+        {
+            if(links[i] == link && bond_receive(&rx, link, packets[i], sizeof(packets[i]), 0) == -1)
+                return 2;
+        }
+    }
+
+    // every packet arrives even though the first seen wasn't the first sent
+    next = 0;
+    while((len = bond_pop(&rx, buf, 0)) != -1)
+    {
+        if(len != 1 || buf[0] != next)
+            return 3;
+        next++;
+    }
+    if(next != PACKETS || rx.skipped != 0)
+        return 4;
+
+    // Test a duplicate isn't delivered again
+    if(bond_receive(&rx, links[PACKETS-1], packets[PACKETS-1], sizeof(packets[PACKETS-1]), 0) != 1)
+        return 5;
+
+    // Test a lost packet is skipped once every link has passed it
+    bond_init(&rx, LINKS, 0, 1000);
+    for(int i = 0; i < PACKETS; i++)
+    {
+        if(i == 5)
+            continue;
+        bond_receive(&rx, links[i], packets[i], sizeof(packets[i]), 0);
+    }
+    for(int i = 0; i < PACKETS-1; i++)
+    {
+        if(bond_pop(&rx, buf, 0) != 1 || buf[0] != (i < 5 ? i : i+1))
+            return 6;
+    }
+    if(rx.skipped != 1 || rx.link[links[5]].lost != 1)
+        return 7;
+
+    // Test a gap no link has passed waits for the timeout
+    bond_init(&rx, 2, 0, 1000);
+    bond_receive(&rx, links[0], packets[0], sizeof(packets[0]), 0);
+    bond_receive(&rx, 0, packets[2], sizeof(packets[2]), 10);
+    if(bond_pop(&rx, buf, 10) != 1 || buf[0] != 0)
+        return 8;
+    if(bond_pop(&rx, buf, 500) != -1 || bond_deadline(&rx) != 1010)
+        return 9;
+    if(bond_pop(&rx, buf, 1010) != 1 || buf[0] != 2)
+        return 10;
+
+    // Test a sender which starts over mid-stream is followed from its first packet
+    bond_init(&rx, LINKS, 0, 1000);
+    for(int i = 0; i < 20; i++)
+    {
+        bond_receive(&rx, links[i], packets[i], sizeof(packets[i]), 0);
+        if(bond_pop(&rx, buf, 0) != 1 || buf[0] != i)
+            return 11;
+    }
+    bond_init(&tx, LINKS, 8, 0);
+    memset(ready, 0, sizeof(ready));
+    for(int i = 0; i < PACKETS; i++)
+    {
+        link = bond_pick(&tx, ready, air);
+        ready[link] += air[link];
+        bond_header(&tx, link, packets[i]);
+        packets[i][BOND_HEADER_LENGTH] = 100 + i;
+        bond_receive(&rx, link, packets[i], sizeof(packets[i]), 0);
+        if(bond_pop(&rx, buf, 0) != 1 || buf[0] != 100 + i)
+            return 12;
+    }
+    if(rx.skipped != 0)
+        return 13;
+
+    // Test a link losing half of what it receives is only picked when it's well ahead
+    bond_init(&tx, 2, 9, 0);
+    tx.link[0].received = 20;
+    tx.link[0].lost = 20;
+    ready[0] = ready[1] = 0;
+    air[0] = air[1] = 100;
+    if(bond_pick(&tx, ready, air) != 1)
+        return 14;
+    ready[0] = 0;
+    ready[1] = 50;
+    if(bond_pick(&tx, ready, air) != 1)
+        return 15;
+    ready[1] = 120;
+    if(bond_pick(&tx, ready, air) != 0)
+        return 16;
+
+    // Test a sender which receives no data is weighted by the reports of the receiver
+    bond_init(&tx, 2, 10, 0);
+    bond_init(&rx, 2, 0, 1000);
+    for(int i = 0; i < 2*BOND_REPORT_PACKETS; i++)
+    {
+        bond_header(&tx, i % 2, packets[0]);
+        packets[0][BOND_HEADER_LENGTH] = i;
+        if(i % 2 == 1 || i % 4 == 0)
+            bond_receive(&rx, i % 2, packets[0], sizeof(packets[0]), 0);
+    }
+    ready[0] = ready[1] = 0;
+    air[0] = air[1] = 100;
+    if(bond_pick(&tx, ready, air) != 0 || bond_report(&rx, 0, buf) != 0 || bond_report(&rx, 1, buf) != BOND_HEADER_LENGTH)
+        return 17;
+    if(bond_receive(&tx, 1, buf, BOND_HEADER_LENGTH, 0) != 2 || tx.link[1].far_received != BOND_REPORT_PACKETS)
+        return 18;
+    for(int i = 0; i < 2*BOND_REPORT_PACKETS; i++)
+    {
+        bond_header(&tx, 0, packets[0]);
+        if(i % 2 == 0)
+            bond_receive(&rx, 0, packets[0], sizeof(packets[0]), 0);
+    }
+    if(bond_report(&rx, 0, buf) != BOND_HEADER_LENGTH || bond_receive(&tx, 0, buf, BOND_HEADER_LENGTH, 0) != 2)
+        return 19;
+    if(tx.link[0].received != 0 || tx.link[0].far_lost == 0 || bond_pick(&tx, ready, air) != 1)
+        return 20;
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "compress.h"
+
+uint8_t samples[65536];
+uint8_t in[1024], out[2048], back[2048];
+
+size_t
+sample(char *buf, int i)
+{
+    return sprintf(buf, "{\"sensor\":\"node-%02d\",\"temperature\":%d.%d,\"humidity\":%d,\"battery\":%d}\n",
+        i%17, 20+i%9, i%10, 40+i%23, 3000+i%700);
+}
+
+int
+roundtrip(const struct Codec *codec, struct Dictionary *dict, uint8_t *data, size_t len, ssize_t *compressed)
+{
+    ssize_t bytes;
+
+    *compressed = codec->compress(dict, data, len, out, sizeof(out));
+    if(*compressed < 0)
+        return 1;
+    bytes = codec->decompress(dict, out, *compressed, back, sizeof(back));
+    if(bytes != len || memcmp(back, data, len))
+        return 1;
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    const struct Codec *codec;
+    struct Dictionary dict;
+    ssize_t plain, trained;
+    size_t len, samples_len;
+
+    codec = compress_codec("lzss");
+    if(codec == NULL || compress_codec("none") != NULL)
+        return 1;
+
+    compress_dictionary_init(&dict);
+
+    // Test incompressible data round trips
+    for(int i=0; i<sizeof(in); i++)
+        in[i] = (i*2654435761u) >> 13;
+    if(roundtrip(codec, &dict, in, sizeof(in), &plain))
+        return 2;
+
+    // Test output which won't fit is an error
+    if(codec->compress(&dict, in, sizeof(in), out, 100) != -1)
+        return 3;
+
+    // Test repetitive data compresses and overlapping matches decode
+    memset(in, 'a', sizeof(in));
+    if(roundtrip(codec, &dict, in, sizeof(in), &plain) || plain > sizeof(in)/8)
+        return 4;
+
+    // Test a trained dictionary helps a short message
+    samples_len = 0;
+    for(int i=0; samples_len + 128 < sizeof(samples); i++)
+        samples_len += sample((char*) samples+samples_len, i);
+    if(compress_dictionary_train(&dict, samples, samples_len, COMPRESS_DICTIONARY_MAX))
+        return 5;
+    if(dict.len == 0 || dict.len > COMPRESS_DICTIONARY_MAX)
+        return 6;
+
+    len = sample((char*) in, 12345);
+    compress_dictionary_destroy(&dict);
+    if(roundtrip(codec, &dict, in, len, &plain))
+        return 7;
+    compress_dictionary_train(&dict, samples, samples_len, COMPRESS_DICTIONARY_MAX);
+    if(roundtrip(codec, &dict, in, len, &trained))
+        return 8;
+    printf("%d byte message compressed to %d bytes, %d bytes with a %d byte dictionary\n", (int) len, (int) plain, (int) trained, (int) dict.len);
+    if(trained >= plain || trained > len/2)
+        return 9;
+
+    // Test a dictionary is saved and loaded
+    if(compress_dictionary_save(&dict, "test_compress.dict"))
+        return 10;
+    len = dict.len;
+    memcpy(in, dict.data, len);
+    compress_dictionary_destroy(&dict);
+    if(compress_dictionary_load(&dict, "test_compress.dict"))
+        return 11;
+    remove("test_compress.dict");
+    if(dict.len != len || memcmp(dict.data, in, len))
+        return 12;
+
+    compress_dictionary_destroy(&dict);
+    return 0;
+}
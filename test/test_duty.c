@@ -0,0 +1,64 @@
+#include "duty.h"
+#include <stdio.h>
+
+#define FRAME_US 100000
+#define FRAMES 1200
+
+uint64_t sent_us[FRAMES];
+
+int
+main(int argc, char *argv[])
+{
+    struct Duty duty;
+    uint64_t now, air, budget;
+
+    // Test a 1% duty cycle starts with a tenth of the hour's budget
+    duty_init(&duty, 10000, FRAME_US, 0);
+    budget = DUTY_WINDOW_US / 100;
+    if(duty_capacity_us(&duty) != budget / 10 || duty_available_us(&duty, 0) != budget / 10)
+        return 1;
+
+    // Test the time until a frame can go refills at the rest of the budget
+    duty_charge(&duty, budget / 10, 0);
+    if(duty_available_us(&duty, 0) != 0)
+        return 2;
+    now = duty_ready_us(&duty, FRAME_US, 0);
+    if(now != (uint64_t) FRAME_US * 100 * 100 / 90 + 1)
+        return 3;
+    if(duty_available_us(&duty, now) < FRAME_US)
+        return 4;
+
+    // Test a frame longer than the burst can never go
+    if(duty_ready_us(&duty, budget, now) != 0)
+        return 5;
+
+    // Test the burst always fits the longest frame but stays within half the budget
+    duty_init(&duty, 10000, budget / 5, 0);
+    if(duty_capacity_us(&duty) != budget / 5)
+        return 6;
+    duty_init(&duty, 10000, budget, 0);
+    if(duty_capacity_us(&duty) != budget / 2)
+        return 7;
+
+    // Test sending as fast as allowed never goes over the budget in any hour
+    duty_init(&duty, 10000, FRAME_US, 0);
+    now = 0;
+    for(int i = 0; i < FRAMES; i++)
+    {
+        now = duty_ready_us(&duty, FRAME_US, now);
+        duty_charge(&duty, FRAME_US, now);
+        sent_us[i] = now;
+    }
+
+    for(int i = 0; i < FRAMES; i++)
+    {
+        air = 0;
+        for(int j = i; j < FRAMES && sent_us[j] < sent_us[i] + DUTY_WINDOW_US; j++)
+            air += FRAME_US;
+        if(air > budget)
+            return 8;
+    }
+    printf("%d frames of %d ms took %llu s\n", FRAMES, FRAME_US / 1000, (unsigned long long) now / 1000000);
+
+    return 0;
+}
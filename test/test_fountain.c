@@ -0,0 +1,79 @@
+#include "fountain.h"
+#include <stdio.h>
+
+#define FILE_LEN 5000
+#define SYMBOL_LEN 51
+
+uint8_t file[FILE_LEN];
+unsigned int rand_state = 1;
+
+unsigned int
+next_rand()
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 16;
+}
+
+/*
+  decode with every symbol lost with a chance of one in loss, returns
+  how many symbols it took or 0 if it failed
+*/
+int
+receive(struct FountainEncoder *enc, int loss)
+{
+    struct FountainDecoder dec;
+    uint8_t symbol[SYMBOL_LEN];
+    int received;
+
+    if(fountain_decoder_init(&dec, FILE_LEN, SYMBOL_LEN))
+        return 0;
+
+    received = 0;
+    for(int id = 0; id <= FOUNTAIN_MAX_ID; id++)
+    {
+        if(loss && next_rand() % loss == 0)
+            continue;
+
+        fountain_encode(enc, id, symbol);
+        received++;
+        if(fountain_decode(&dec, id, symbol))
+            break;
+    }
+
+    if(fountain_data(&dec) == NULL || memcmp(fountain_data(&dec), file, FILE_LEN) != 0)
+        received = 0;
+
+    fountain_decoder_destroy(&dec);
+    return received;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct FountainEncoder enc;
+    struct FountainDecoder dec;
+    int symbols, received;
+
+    for(int i = 0; i < FILE_LEN; i++)
+        file[i] = next_rand();
+
+    if(fountain_encoder_init(&enc, file, FILE_LEN, SYMBOL_LEN))
+        return 1;
+    symbols = enc.symbols;
+
+    // Test the source symbols alone rebuild the file
+    if(receive(&enc, 0) != symbols)
+        return 2;
+
+    // Test the file is rebuilt from repair symbols when a third are lost
+    received = receive(&enc, 3);
+    printf("%d symbols, %d received with a third lost\n", symbols, received);
+    if(received == 0 || received > symbols + 3)
+        return 3;
+
+    // Test a file too large for the decoder is refused
+    if(fountain_decoder_init(&dec, (FOUNTAIN_MAX_SYMBOLS+1) * SYMBOL_LEN, SYMBOL_LEN) != -1)
+        return 4;
+
+    return 0;
+}
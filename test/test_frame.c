@@ -0,0 +1,179 @@
+#include "frame.h"
+#include <stdio.h>
+
+#define PACKET 58
+#define FRAGMENT_PAYLOAD (PACKET-FRAME_FRAGMENT_HEADER_LENGTH)
+#define MESSAGE 1000
+
+uint8_t message[MESSAGE];
+uint8_t packets[FRAME_MAX_FRAGMENTS][PACKET];
+size_t packet_lens[FRAME_MAX_FRAGMENTS];
+
+int
+fragment(uint8_t id, size_t len)
+{
+    struct FrameHeader hdr;
+    size_t offset, chunk;
+    int n = 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.type = FRAME_TYPE_FRAGMENT;
+    hdr.id = id;
+    for(offset=0; offset<len; offset+=chunk, n++)
+    {
+        chunk = len-offset < FRAGMENT_PAYLOAD ? len-offset : FRAGMENT_PAYLOAD;
+        hdr.index = n;
+        hdr.last = offset+chunk == len;
+        packet_lens[n] = frame_encode(packets[n], PACKET, &hdr, message+offset, chunk);
+    }
+    return n;
+}
+
+int
+reassemble(struct FrameReassembly *r, int index, uint64_t now_ms, uint8_t **out, size_t *out_len)
+{
+    struct FrameHeader hdr;
+    uint8_t *payload;
+    size_t payload_len;
+
+    if(frame_decode(packets[index], packet_lens[index], &hdr, &payload, &payload_len))
+        return -2;
+    return frame_reassemble(r, &hdr, payload, payload_len, now_ms, out, out_len);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct FrameReassembly r;
+    struct FrameHeader hdr;
+    uint8_t packet[PACKET], *payload, *out;
+    size_t payload_len, out_len;
+    int n, ret;
+
+    for(int i=0; i<MESSAGE; i++)
+        message[i] = i*7;
+
+    // Test a data frame round trip
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.type = FRAME_TYPE_DATA;
+    if(frame_encode(packet, PACKET, &hdr, message, PACKET-1) != PACKET)
+        return 1;
+    if(frame_encode(packet, PACKET, &hdr, message, PACKET) != -1)
+        return 2;
+    if(frame_decode(packet, PACKET, &hdr, &payload, &payload_len))
+        return 3;
+    if(hdr.type != FRAME_TYPE_DATA || payload_len != PACKET-1 || memcmp(payload, message, payload_len))
+        return 4;
+
+    // Test the number of packets for a message
+    if(frame_count(PACKET-1, PACKET) != 1)
+        return 5;
+    if(frame_count(PACKET, PACKET) != 2)
+        return 6;
+    if(frame_count(16384, PACKET) != 298)
+        return 7;
+
+    // Test a fragment header with a 10 bit index
+    hdr.type = FRAME_TYPE_FRAGMENT;
+    hdr.id = 0xA5;
+    hdr.index = 0x2F1;
+    hdr.last = 1;
+    frame_encode(packet, PACKET, &hdr, message, 10);
+    memset(&hdr, 0, sizeof(hdr));
+    if(frame_decode(packet, 13, &hdr, &payload, &payload_len))
+        return 8;
+    if(hdr.type != FRAME_TYPE_FRAGMENT || hdr.id != 0xA5 || hdr.index != 0x2F1 || !hdr.last || payload_len != 10)
+        return 9;
+
+    // Test small messages packed as records
+    {
+        uint8_t *records, *record;
+        size_t records_len, record_len;
+        ssize_t used;
+        int compressed;
+
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.type = FRAME_TYPE_RECORDS;
+        used = frame_encode(packet, PACKET, &hdr, message, 0);
+        used = frame_record_add(packet, PACKET, used, message, 10, 0);
+        used = frame_record_add(packet, PACKET, used, message+10, 20, 1);
+        if(used != 33 || frame_record_add(packet, PACKET, used, message, 25, 0) != -1)
+            return 19;
+        if(frame_decode(packet, used, &hdr, &records, &records_len) || hdr.type != FRAME_TYPE_RECORDS)
+            return 20;
+        if(frame_record_next(&records, &records_len, &record, &record_len, &compressed) != 1 ||
+                record_len != 10 || compressed || memcmp(record, message, 10))
+            return 21;
+        if(frame_record_next(&records, &records_len, &record, &record_len, &compressed) != 1 ||
+                record_len != 20 || !compressed || memcmp(record, message+10, 20))
+            return 22;
+        if(frame_record_next(&records, &records_len, &record, &record_len, &compressed) != 0)
+            return 23;
+        records_len = 5;
+        records = packet+1;
+        if(frame_record_next(&records, &records_len, &record, &record_len, &compressed) != -1)
+            return 24;
+    }
+
+    // Test a fountain symbol keeps the file length and symbol id
+    {
+        uint8_t *symbol;
+        size_t symbol_len;
+
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.type = FRAME_TYPE_FOUNTAIN;
+        hdr.id = 7;
+        hdr.length = 70000;
+        hdr.index = 1234;
+        if(frame_encode(packet, PACKET, &hdr, message, 40) != 47)
+            return 25;
+        if(frame_decode(packet, 47, &hdr, &symbol, &symbol_len) || hdr.type != FRAME_TYPE_FOUNTAIN)
+            return 26;
+        if(hdr.id != 7 || hdr.length != 70000 || hdr.index != 1234 || symbol_len != 40 || memcmp(symbol, message, 40))
+            return 27;
+    }
+
+    // Test reassembly out of order with a duplicate
+    frame_reassembly_init(&r, FRAGMENT_PAYLOAD, 16384, 65536, 1000);
+    n = fragment(1, MESSAGE);
+    if(n != 19)
+        return 10;
+    for(int i=n-1; i>0; i--)
+        if(reassemble(&r, i, 0, &out, &out_len) != 0)
+            return 11;
+    if(reassemble(&r, 3, 0, &out, &out_len) != 0)
+        return 12;
+    if(reassemble(&r, 0, 0, &out, &out_len) != 1)
+        return 13;
+    if(out_len != MESSAGE || memcmp(out, message, MESSAGE))
+        return 14;
+    free(out);
+    if(r.bytes != 0)
+        return 15;
+
+    // Test a message times out when fragments stop arriving
+    n = fragment(2, MESSAGE);
+    for(int i=1; i<n; i++)
+        reassemble(&r, i, 0, &out, &out_len);
+    ret = reassemble(&r, 0, 1000, &out, &out_len);
+    if(ret != 0 || r.dropped != 1)
+        return 16;
+
+    // Test the memory cap drops the oldest message
+    frame_reassembly_destroy(&r);
+    frame_reassembly_init(&r, FRAGMENT_PAYLOAD, 16384, 1500, 1000);
+    n = fragment(3, MESSAGE);
+    for(int i=0; i<n-1; i++)
+        reassemble(&r, i, 0, &out, &out_len);
+    n = fragment(4, MESSAGE);
+    for(int i=0; i<n-1; i++)
+        reassemble(&r, i, 1, &out, &out_len);
+    if(r.dropped != 1 || r.bytes > 1500)
+        return 17;
+    if(reassemble(&r, n-1, 1, &out, &out_len) != 1 || memcmp(out, message, MESSAGE))
+        return 18;
+    free(out);
+
+    frame_reassembly_destroy(&r);
+    return 0;
+}
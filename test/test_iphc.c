@@ -0,0 +1,137 @@
+#include "iphc.h"
+#include <stdio.h>
+
+uint8_t packet[256], out[256], back[256];
+
+uint16_t
+checksum(const uint8_t *buf, size_t len, uint32_t sum)
+{
+    for(size_t i = 0; i < len; i += 2)
+        sum += (buf[i] << 8) | (i + 1 < len ? buf[i+1] : 0);
+    while(sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum & 0xFFFF;
+}
+
+void
+put16(uint8_t *buf, uint16_t value)
+{
+    buf[0] = value >> 8;
+    buf[1] = value & 0xFF;
+}
+
+/* an IPv4 UDP packet with correct checksums */
+size_t
+ipv4_udp(uint32_t src, uint32_t dst, uint16_t sport, uint16_t dport, uint16_t frag, const char *payload)
+{
+    size_t len = 28 + strlen(payload);
+    uint16_t sum;
+
+    memset(packet, 0, 28);
+    packet[0] = 0x45;
+    put16(packet+2, len);
+    put16(packet+6, frag);
+    packet[8] = 64;
+    packet[9] = 17;
+    put16(packet+12, src >> 16);
+    put16(packet+14, src);
+    put16(packet+16, dst >> 16);
+    put16(packet+18, dst);
+    put16(packet+20, sport);
+    put16(packet+22, dport);
+    put16(packet+24, len - 20);
+    memcpy(packet+28, payload, strlen(payload));
+    sum = checksum(packet+20, len - 20, 17 + (len - 20) + (src >> 16) + (src & 0xFFFF) + (dst >> 16) + (dst & 0xFFFF));
+    put16(packet+26, sum ? sum : 0xFFFF);
+    put16(packet+10, checksum(packet, 20, 0));
+    return len;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct IphcContext ctx;
+    size_t len;
+    ssize_t compressed;
+    uint32_t sum;
+
+    iphc_context(&ctx, 0x0A000000, 24);
+
+    // Test IPv4 and UDP headers in the network shrink from 28 to 6 bytes
+    len = ipv4_udp(0x0A000001, 0x0A000002, 0xF0B1, 0xF0B2, 0x4000, "hello");
+    compressed = iphc_compress(&ctx, packet, len, out, sizeof(out));
+    if(compressed != 6 + 5 || out[0] != IPHC_DISPATCH_IPV4 || !iphc_dispatch(out, compressed))
+        return 1;
+    if(iphc_decompress(&ctx, out, compressed, back, sizeof(back)) != len || memcmp(packet, back, len) != 0)
+        return 2;
+
+    // Test addresses outside the network, other ports and a fragment go inline
+    len = ipv4_udp(0xC0A80105, 0x0A000102, 5000, 6000, 0x2000, "fragment");
+    packet[5] = 0x42;
+    put16(packet+10, 0);
+    put16(packet+10, checksum(packet, 20, 0));
+    compressed = iphc_compress(&ctx, packet, len, out, sizeof(out));
+    if(compressed != 3 + 4 + 1 + 4 + 4 + 8 + 8)
+        return 3;
+    if(iphc_decompress(&ctx, out, compressed, back, sizeof(back)) != len || memcmp(packet, back, len) != 0)
+        return 4;
+
+    // Test the broadcast address, a port in 0xF0xx and a larger network
+    iphc_context(&ctx, 0x0A000000, 16);
+    len = ipv4_udp(0x0A000101, 0xFFFFFFFF, 1234, 0xF005, 0, "x");
+    compressed = iphc_compress(&ctx, packet, len, out, sizeof(out));
+    if(compressed != 3 + 2 + 3 + 1)
+        return 5;
+    if(iphc_decompress(&ctx, out, compressed, back, sizeof(back)) != len || memcmp(packet, back, len) != 0)
+        return 6;
+
+    // Test link local IPv6 and UDP headers shrink from 48 bytes
+    memset(packet, 0, 48);
+    packet[0] = 0x60;
+    put16(packet+4, 8 + 3);
+    packet[6] = 17;
+    packet[7] = 255;
+    packet[8] = 0xFE;
+    packet[9] = 0x80;
+    memcpy(packet+16, "\x00\x00\x00\xff\xfe\x00\x00\x01", 8);
+    packet[24] = 0xFF;
+    packet[25] = 0x02;
+    packet[39] = 0x01;
+    put16(packet+40, 0xF0B3);
+    put16(packet+42, 0xF0B4);
+    put16(packet+44, 8 + 3);
+    memcpy(packet+48, "abc", 3);
+    sum = 17 + 11;
+    for(int i = 8; i < 40; i += 2)
+        sum += (packet[i] << 8) | packet[i+1];
+    put16(packet+46, checksum(packet+40, 11, sum));
+    len = 51;
+    compressed = iphc_compress(&ctx, packet, len, out, sizeof(out));
+    if(compressed != 3 + 2 + 1 + 1 + 3 || out[0] != IPHC_DISPATCH_IPV6)
+        return 7;
+    if(iphc_decompress(&ctx, out, compressed, back, sizeof(back)) != len || memcmp(packet, back, len) != 0)
+        return 8;
+
+    // Test IPv4 with options is sent as it is
+    len = ipv4_udp(0x0A000001, 0x0A000002, 1, 2, 0, "options");
+    packet[0] = 0x46;
+    compressed = iphc_compress(&ctx, packet, len, out, sizeof(out));
+    if(compressed != len + 1 || out[0] != IPHC_DISPATCH_RAW)
+        return 9;
+    if(iphc_decompress(&ctx, out, compressed, back, sizeof(back)) != len || memcmp(packet, back, len) != 0)
+        return 10;
+
+    // Test a packet shorter than its header says, a cut short compressed packet and other data are refused
+    len = ipv4_udp(0x0A000001, 0x0A000002, 1, 2, 0, "short");
+    if(iphc_compress(&ctx, packet, len - 1, out, sizeof(out)) != -1)
+        return 11;
+    out[0] = IPHC_DISPATCH_IPV4;
+    out[1] = 0;
+    out[2] = 0;
+    if(iphc_decompress(&ctx, out, 5, back, sizeof(back)) != -1)
+        return 12;
+    if(iphc_dispatch((uint8_t*) "hello", 5) || iphc_decompress(&ctx, (uint8_t*) "hello", 5, back, sizeof(back)) != -1)
+        return 13;
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "loop.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/timerfd.h>
+
+int calls[8];
+int ncalls;
+
+int
+record(void *data, int id, uint32_t events)
+{
+    char c;
+
+    if(data != NULL)
+        read(*(int*) data, &c, 1);
+    calls[ncalls++] = id;
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct Loop loop;
+    struct itimerspec its;
+    sigset_t signals;
+    int first[2], second[2], timer, fd;
+    FILE *file;
+
+    if(loop_init(&loop))
+        return 1;
+
+    // Test callbacks of what's ready run in the order they were registered
+    if(pipe(first) || pipe(second))
+        return 2;
+    loop_add(&loop, first[0], EPOLLIN, record, &first[0], 1);
+    loop_add(&loop, second[0], EPOLLIN, record, &second[0], 2);
+    write(second[1], "b", 1);
+    write(first[1], "a", 1);
+    if(loop_run(&loop, 1000) != 0 || ncalls != 2 || calls[0] != 1 || calls[1] != 2)
+        return 3;
+
+    // Test a disabled descriptor isn't waited on
+    ncalls = 0;
+    loop_enable(&loop, first[0], 0);
+    write(first[1], "a", 1);
+    if(loop_run(&loop, 10) != 0 || ncalls != 0)
+        return 4;
+    loop_enable(&loop, first[0], 1);
+    if(loop_run(&loop, 1000) != 0 || ncalls != 1 || calls[0] != 1)
+        return 5;
+
+    // Test a regular file is always ready
+    ncalls = 0;
+    file = tmpfile();
+    if(file == NULL || loop_add(&loop, fileno(file), EPOLLIN, record, NULL, 3))
+        return 6;
+    if(loop_run(&loop, -1) != 0 || ncalls != 1 || calls[0] != 3)
+        return 7;
+    loop_remove(&loop, fileno(file));
+
+    // Test a timer wakes the loop
+    ncalls = 0;
+    timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = 1000000;
+    timerfd_settime(timer, 0, &its, NULL);
+    loop_add(&loop, timer, EPOLLIN, record, NULL, 4);
+    if(loop_run(&loop, 1000) != 0 || ncalls != 1 || calls[0] != 4)
+        return 8;
+    loop_remove(&loop, timer);
+
+    // Test a signal runs its callback in the loop
+    ncalls = 0;
+    if(loop_signal(&loop, SIGUSR1, record, NULL))
+        return 9;
+    raise(SIGUSR1);
+    if(loop_run(&loop, 1000) != 0 || ncalls != 1 || calls[0] != SIGUSR1)
+        return 10;
+
+    loop_destroy(&loop);
+
+    // Test a signalfd given to the loop holds a signal raised before the loop runs
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+    fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    raise(SIGUSR2);
+
+    ncalls = 0;
+    if(fd == -1 || loop_init(&loop) || loop_signal_fd(&loop, fd) || loop_signal(&loop, SIGUSR2, record, NULL))
+        return 11;
+    if(loop_run(&loop, 1000) != 0 || ncalls != 1 || calls[0] != SIGUSR2)
+        return 12;
+
+    // Test the loop leaves a given signalfd open
+    loop_destroy(&loop);
+    if(fcntl(fd, F_GETFD) == -1)
+        return 13;
+    close(fd);
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include "queue.h"
+#include <stdio.h>
+
+int
+main(int argc, char *argv[])
+{
+    struct Queue queue;
+    struct QueueFrame *frame;
+    uint8_t data[58];
+    uint64_t served[2];
+    int bulk, small, large, urgent, session, udp, flows[QUEUE_MAX_PASSED+3];
+
+    if(queue_init(&queue, 128, sizeof(data)))
+        return 1;
+    queue_set_quantum(&queue, 400);
+    memset(data, 0, sizeof(data));
+
+    // Test the frames of a flow come out in order
+    bulk = queue_flow(&queue, QUEUE_SOURCE_FILE, QUEUE_CLASS_BULK, 0, "file");
+    for(int i=0; i<10; i++)
+    {
+        data[0] = i;
+        if(queue_push(&queue, bulk, data, sizeof(data), 400))
+            return 2;
+    }
+    if(queue_tail(&queue)->data[0] != 9)
+        return 3;
+
+    frame = queue_peek(&queue);
+    if(frame == NULL || frame->data[0] != 0 || queue_peek(&queue) != frame)
+        return 4;
+    queue_pop(&queue);
+
+    // Test an urgent frame preempts the bulk transfer at the next frame
+    urgent = queue_flow(&queue, QUEUE_SOURCE_SOCKET_UNIX_DATA, QUEUE_CLASS_URGENT, 0, "/run/alarm");
+    data[0] = 100;
+    if(queue_push(&queue, urgent, data, 1, 50))
+        return 5;
+    if(queue_cost_ahead(&queue, QUEUE_CLASS_URGENT) != 50)
+        return 6;
+    frame = queue_peek(&queue);
+    if(frame->data[0] != 100 || frame->len != 1)
+        return 7;
+    queue_pop(&queue);
+
+    for(int i=1; i<10; i++)
+    {
+        frame = queue_peek(&queue);
+        if(frame == NULL || frame->data[0] != i)
+            return 8;
+        queue_pop(&queue);
+    }
+    if(queue_size(&queue) != 0 || queue_peek(&queue) != NULL || queue_pop(&queue) != -1)
+        return 9;
+
+    // Test clients in a class get the same air time, not the same frames
+    small = queue_flow(&queue, QUEUE_SOURCE_SOCKET_UNIX_DATA, QUEUE_CLASS_NORMAL, 0, "/run/small");
+    large = queue_flow(&queue, QUEUE_SOURCE_SOCKET_UNIX_DATA, QUEUE_CLASS_NORMAL, 0, "/run/large");
+    if(small == large)
+        return 10;
+    for(int i=0; i<40; i++)
+    {
+        if(queue_push(&queue, small, data, 1, 100))
+            return 11;
+        if(queue_push(&queue, large, data, sizeof(data), 400))
+            return 12;
+    }
+
+    served[0] = served[1] = 0;
+    while(served[0] + served[1] < 8000)
+    {
+        frame = queue_peek(&queue);
+        served[frame->flow == large] += frame->cost;
+        queue_pop(&queue);
+    }
+    printf("small client %llu us, large client %llu us\n", (unsigned long long) served[0], (unsigned long long) served[1]);
+    if(served[0] < 3600 || served[1] < 3600)
+        return 13;
+
+    // Test the quota of a source still holds
+    queue_set_quota(&queue, QUEUE_SOURCE_STDIN, 2);
+    small = queue_flow(&queue, QUEUE_SOURCE_STDIN, QUEUE_CLASS_NORMAL, 0, "stdin");
+    queue_push(&queue, small, data, 1, 100);
+    queue_push(&queue, small, data, 1, 100);
+    if(queue_available(&queue, QUEUE_SOURCE_STDIN) != 0 || queue_push(&queue, small, data, 1, 100) != -1)
+        return 14;
+
+    queue_destroy(&queue);
+
+    // Test flows to the same channel go out together
+    queue_init(&queue, 16, sizeof(data));
+    queue_set_quantum(&queue, 400);
+    for(int i=0; i<3; i++)
+    {
+        char name[8];
+        int flow;
+
+        sprintf(name, "%d", i);
+        flow = queue_flow(&queue, QUEUE_SOURCE_SOCKET_UNIX_DATA, QUEUE_CLASS_NORMAL, i == 1 ? 2 : 1, name);
+        data[0] = i;
+        queue_push(&queue, flow, data, 1, 100);
+    }
+    for(int i=0; i<3; i++)
+    {
+        frame = queue_peek(&queue);
+        if(frame->data[0] != (i == 0 ? 0 : i == 1 ? 2 : 1))
+            return 15;
+        queue_pop(&queue);
+    }
+
+    queue_destroy(&queue);
+
+    // Test frames reserved for a source aren't taken by another
+    queue_init(&queue, 16, sizeof(data));
+    queue_set_quota(&queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION, 8);
+    session = queue_flow(&queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION, QUEUE_CLASS_NORMAL, 0, "session");
+    udp = queue_flow(&queue, QUEUE_SOURCE_SOCKET_UDP, QUEUE_CLASS_NORMAL, 0, "udp");
+    if(queue_reserve(&queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION, 6) ||
+        queue_available(&queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION) != 2 ||
+        queue_available(&queue, QUEUE_SOURCE_SOCKET_UDP) != 10)
+        return 16;
+    if(queue_reserve(&queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION, 3) != -1)
+        return 17;
+    for(int i=0; i<10; i++)
+        queue_push(&queue, udp, data, 1, 100);
+    if(queue_available(&queue, QUEUE_SOURCE_SOCKET_UDP) != 0 || queue_push(&queue, udp, data, 1, 100) != -1)
+        return 18;
+
+    // Test released frames can be pushed and the rest stay reserved
+    queue_release(&queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION, 2);
+    if(queue_push(&queue, session, data, 1, 100) || queue_push(&queue, session, data, 1, 100) ||
+        queue_push(&queue, session, data, 1, 100) != -1)
+        return 19;
+
+    // Test releasing more than is reserved gives back only what is
+    queue_release(&queue, QUEUE_SOURCE_SOCKET_UNIX_SESSION, 10);
+    if(queue.reserved_size != 0 || queue_available(&queue, QUEUE_SOURCE_SOCKET_UDP) != 4)
+        return 20;
+
+    queue_destroy(&queue);
+
+    // Test a flow to another channel is passed by flows joining its channel only so many times
+    queue_init(&queue, 16, sizeof(data));
+    queue_set_quantum(&queue, 400);
+    for(int i=0; i<QUEUE_MAX_PASSED+3; i++)
+    {
+        char name[8];
+
+        sprintf(name, "%d", i);
+        flows[i] = queue_flow(&queue, QUEUE_SOURCE_SOCKET_UNIX_DATA, QUEUE_CLASS_NORMAL, i == 1 ? 2 : 1, name);
+        data[0] = i;
+        queue_push(&queue, flows[i], data, 1, 100);
+    }
+    for(int i=0; i<QUEUE_MAX_PASSED+2; i++)
+    {
+        frame = queue_peek(&queue);
+        if(frame == NULL || frame->data[0] == QUEUE_MAX_PASSED+2)
+            return 21;
+        queue_pop(&queue);
+    }
+
+    // Test a flow to another channel is served while flows to one channel keep rejoining
+    data[0] = 1;
+    queue_push(&queue, flows[1], data, 1, 100);
+    data[0] = 0;
+    queue_push(&queue, flows[0], data, 1, 100);
+    for(int i=0; i<QUEUE_MAX_PASSED+3; i++)
+    {
+        frame = queue_peek(&queue);
+        if(frame == NULL)
+            return 22;
+        data[0] = frame->data[0];
+        queue_pop(&queue);
+        if(data[0] == 1)
+            break;
+        queue_push(&queue, flows[data[0]], data, 1, 100);
+    }
+    if(data[0] != 1)
+        return 23;
+
+    queue_destroy(&queue);
+    return 0;
+}
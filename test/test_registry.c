@@ -0,0 +1,164 @@
+#include "registry.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define CLIENTS 3000
+#define SOCKET_CLIENTS 100
+
+struct RegistryBatch batch;
+
+struct sockaddr_un
+address(int i)
+{
+    struct sockaddr_un addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "/run/e32/client.%d", i);
+    return addr;
+}
+
+/* every registered client is found where the index says */
+int
+consistent(struct Registry *registry)
+{
+    for(size_t i = 0; i < registry->size; i++)
+        if(registry_find(registry, &registry->clients[i].addr) != &registry->clients[i])
+            return 0;
+    return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct Registry registry;
+    struct sockaddr_un addr;
+
+    if(registry_init(&registry))
+        return 1;
+
+    // Test registering many clients, twice is once
+    for(int i = 0; i < CLIENTS; i++)
+    {
+        addr = address(i);
+        if(registry_add(&registry, &addr) == NULL || registry_add(&registry, &addr) == NULL)
+            return 2;
+    }
+    if(registry_size(&registry) != CLIENTS || !consistent(&registry))
+        return 3;
+
+    // Test removing every other client keeps the rest findable
+    for(int i = 0; i < CLIENTS; i += 2)
+    {
+        addr = address(i);
+        if(registry_remove(&registry, &addr))
+            return 4;
+    }
+    if(registry_size(&registry) != CLIENTS/2 || !consistent(&registry))
+        return 5;
+    for(int i = 0; i < CLIENTS; i++)
+    {
+        addr = address(i);
+        if((registry_find(&registry, &addr) == NULL) != (i % 2 == 0))
+            return 6;
+    }
+
+    // Test a removed client isn't removed again and can register again
+    addr = address(0);
+    if(registry_remove(&registry, &addr) != -1 || registry_add(&registry, &addr) == NULL)
+        return 7;
+    if(registry_size(&registry) != CLIENTS/2 + 1 || !consistent(&registry))
+        return 8;
+
+    // Test removing by place moves the last client into it
+    addr = registry.clients[registry.size-1].addr;
+    registry_remove_at(&registry, 0);
+    if(strcmp(registry.clients[0].addr.sun_path, addr.sun_path) || !consistent(&registry))
+        return 9;
+
+    // Test a filter on the sender and a tag with a byte which doesn't matter
+    {
+        struct RegistryFilter filter;
+        struct RegistryMessage message;
+        uint8_t mask[3] = {0xFF, 0x00, 0xF0};
+        uint8_t value[3] = {'T', 0x00, 0x30};
+
+        memset(&filter, 0, sizeof(filter));
+        registry_message(&message, (uint8_t*) "anything", 8, REGISTRY_NO_SOURCE);
+        if(!registry_filter_match(&filter, &message))
+            return 10;
+        if(registry_filter_compile(&filter, 0x0100, 0x01FF, mask, value, 3))
+            return 11;
+        registry_message(&message, (uint8_t*) "Tx3", 3, 0x0105);
+        if(!registry_filter_match(&filter, &message))
+            return 12;
+        registry_message(&message, (uint8_t*) "Tx3", 3, 0x0205);
+        if(registry_filter_match(&filter, &message))
+            return 13;
+        registry_message(&message, (uint8_t*) "Tx@", 3, 0x0105);
+        if(registry_filter_match(&filter, &message))
+            return 14;
+        registry_message(&message, (uint8_t*) "Tx", 2, 0x0105);
+        if(registry_filter_match(&filter, &message))
+            return 15;
+        registry_message(&message, (uint8_t*) "Tx3", 3, REGISTRY_NO_SOURCE);
+        if(registry_filter_match(&filter, &message))
+            return 16;
+        if(registry_filter_compile(&filter, 0, 0xFFFF, mask, value, REGISTRY_FILTER_BYTES+1) != -1)
+            return 17;
+    }
+
+    registry_destroy(&registry);
+
+    // Test a message sent with sendmmsg reaches every client and one gone is removed
+    {
+        struct sockaddr_un from;
+        struct RegistryMessage message;
+        struct msghdr msg;
+        struct iovec iov;
+        int sender, fds[SOCKET_CLIENTS];
+        char path[64], buf[16];
+
+        if(registry_init(&registry))
+            return 18;
+        sender = socket(AF_UNIX, SOCK_DGRAM, 0);
+        for(int i = 0; i < SOCKET_CLIENTS; i++)
+        {
+            snprintf(path, sizeof(path), "/tmp/test_registry.%d.%d", getpid(), i);
+            unlink(path);
+            memset(&from, 0, sizeof(from));
+            from.sun_family = AF_UNIX;
+            strcpy(from.sun_path, path);
+            fds[i] = socket(AF_UNIX, SOCK_DGRAM, 0);
+            if(fds[i] == -1 || bind(fds[i], (struct sockaddr*) &from, sizeof(from)) || registry_add(&registry, &from) == NULL)
+                return 19;
+        }
+
+        // the last one has gone away
+        close(fds[SOCKET_CLIENTS-1]);
+        unlink(registry.clients[SOCKET_CLIENTS-1].addr.sun_path);
+
+        iov.iov_base = "frame";
+        iov.iov_len = 5;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        registry_message(&message, iov.iov_base, iov.iov_len, REGISTRY_NO_SOURCE);
+        if(registry_send(&registry, &batch, sender, &msg, &message) != 1 || registry_size(&registry) != SOCKET_CLIENTS-1)
+            return 20;
+
+        for(int i = 0; i < SOCKET_CLIENTS-1; i++)
+        {
+            if(recv(fds[i], buf, sizeof(buf), MSG_DONTWAIT) != 5 || memcmp(buf, "frame", 5) != 0)
+                return 21;
+            close(fds[i]);
+            snprintf(path, sizeof(path), "/tmp/test_registry.%d.%d", getpid(), i);
+            unlink(path);
+        }
+
+        close(sender);
+        registry_destroy(&registry);
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "udp.h"
+#include <poll.h>
+#include <stdio.h>
+
+struct UdpBatch batch;
+
+/* a socket on a free loopback port, its address in addr */
+int
+open_loopback(struct sockaddr_in *addr)
+{
+    socklen_t len = sizeof(struct sockaddr_in);
+    int fd;
+
+    udp_parse_addr(addr, "0");
+    fd = udp_open(addr);
+    if(fd == -1 || getsockname(fd, (struct sockaddr*) addr, &len))
+        return -1;
+    return fd;
+}
+
+void
+wait_readable(int fd)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    poll(&pfd, 1, 1000);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct sockaddr_in addr, bridge_addr, dests[2];
+    struct iovec iov[2];
+    int bridge, sender, collector[2], received;
+    char from[2] = { 0x12, 0x34 };
+    char buf[64];
+
+    // Test addresses are ADDR:PORT or a port on the loopback address
+    if(udp_parse_addr(&addr, "10.0.0.2:5000") || addr.sin_addr.s_addr != inet_addr("10.0.0.2") || ntohs(addr.sin_port) != 5000)
+        return 1;
+    if(udp_parse_addr(&addr, "6000") || addr.sin_addr.s_addr != htonl(INADDR_LOOPBACK) || ntohs(addr.sin_port) != 6000)
+        return 2;
+    if(udp_parse_addr(&addr, "10.0.0.2:") == 0 || udp_parse_addr(&addr, ":80") == 0 ||
+        udp_parse_addr(&addr, "host:80") == 0 || udp_parse_addr(&addr, "70000") == 0)
+        return 3;
+
+    bridge = open_loopback(&bridge_addr);
+    sender = open_loopback(&addr);
+    if(bridge == -1 || sender == -1)
+        return 4;
+
+    // Test nothing waiting isn't an error
+    if(udp_recv(&batch, bridge, UDP_RECV_BATCH) != 0)
+        return 5;
+
+    // Test datagrams waiting are read together with who sent them
+    for(int i = 0; i < 5; i++)
+    {
+        sprintf(buf, "message %d", i);
+        sendto(sender, buf, strlen(buf), 0, (struct sockaddr*) &bridge_addr, sizeof(bridge_addr));
+    }
+    wait_readable(bridge);
+    received = udp_recv(&batch, bridge, 3);
+    if(received != 3 || batch.msgs[2].msg_len != 9 || memcmp(batch.bufs[2], "message 2", 9) != 0)
+        return 6;
+    if(batch.addrs[0].sin_port != addr.sin_port)
+        return 7;
+    received = udp_recv(&batch, bridge, UDP_RECV_BATCH);
+    if(received != 2 || memcmp(batch.bufs[1], "message 4", 9) != 0)
+        return 8;
+
+    // Test what's sent reaches every destination as one datagram
+    collector[0] = open_loopback(&dests[0]);
+    collector[1] = open_loopback(&dests[1]);
+    if(collector[0] == -1 || collector[1] == -1)
+        return 9;
+    iov[0].iov_base = from;
+    iov[0].iov_len = sizeof(from);
+    iov[1].iov_base = "hello";
+    iov[1].iov_len = 5;
+    if(udp_send(&batch, bridge, dests, 2, iov, 2) != 0)
+        return 10;
+    for(int i = 0; i < 2; i++)
+    {
+        wait_readable(collector[i]);
+        if(recv(collector[i], buf, sizeof(buf), MSG_DONTWAIT) != 7 || memcmp(buf, "\x12\x34hello", 7) != 0)
+            return 11;
+    }
+
+    close(bridge);
+    close(sender);
+    close(collector[0]);
+    close(collector[1]);
+    return 0;
+}